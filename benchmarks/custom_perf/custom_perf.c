@@ -20,6 +20,17 @@
 //ioctl
 #include <sys/ioctl.h>
 #include <error.h>
+//waitpid
+#include <sys/wait.h>
+//mkdir
+#include <sys/stat.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+//clock_gettime
+#include <time.h>
+//live consumers, see `-p`
+#include "pebs_ring.h"
 
 #define DEBUG 0
 
@@ -45,6 +56,21 @@ const char *argp_program_version = "custom_perf 1.0";
 const char *default_output_dir = "comparison/";
 int default_counter = 1;
 int default_mmap_size = 8*1024;
+double default_overhead_budget = 0.; // == fixed sample period
+uint64_t default_max_counter = 1ul << 32;
+
+#define MAX_EVENTS 16
+#define EVENT_NAME_SIZE 32
+
+// One sampled event, see `parse_event_spec` for its textual representation
+struct event_spec{
+    char name[EVENT_NAME_SIZE];
+    uint64_t config;
+    uint64_t config1; // e.g. the load latency threshold (ldlat) of the load latency event
+    uint8_t precise_ip;
+    uint64_t period; // 0 == `-c`
+    uint8_t rw; // TRACE_RW_LOAD or TRACE_RW_STORE: how its samples appear in the trace
+};
 
 // Structure to store command line arguments
 struct arguments {
@@ -57,8 +83,134 @@ struct arguments {
     const char *output_dir;
     uint64_t counter;
     size_t mmap_size;
+    double overhead_budget; // fraction of the run the child may spend stopped for draining, 0 == never adapt `counter`
+    uint64_t max_counter;
+    uint64_t sample_type;
+    uint64_t load_latency_threshold; // 0 == sample all loads instead of the load latency event
+    struct event_spec events[MAX_EVENTS]; // none == all loads and all stores
+    size_t n_events;
+    uint8_t single_buffer; // all events output to the first one's ring
+    const char *ring_name; // NULL == don't publish the samples to a shared memory ring
+    uint8_t no_trace;
 };
 
+// Trace output: same on-disk format as the pin tool's, consumed by c_rewrite (`BIN_LINE_SIZE_BYTES`): 1 R/W byte
+// (0 == load) followed by the 8 bytes virtual address. The timestamps of the records go, in the same order, to a sidecar
+// file of raw uint64_t ; so do, when sampled, their raw `perf_mem_data_src` and weight (2 uint64_t per record)
+#define TRACE_FN "mem_trace"
+#define TRACE_TS_FN "mem_trace.ts"
+#define TRACE_WEIGHTS_FN "mem_trace.weights"
+#define TRACE_RW_LOAD 0
+#define TRACE_RW_STORE 1
+#define TRACE_WRITE_BUFFER_SIZE (1024*1024)
+
+// Parses a comma separated list of `key=value`, e.g. `name=l3_miss_loads,event=0xd1,umask=0x20,precise=2,period=100,rw=load`:
+//  - event, umask: form the raw config (config = umask << 8 | event), unless `config` is given directly
+//  - ldlat: config1, the load latency threshold of the load latency event (event=0xcd,umask=0x1)
+//  - precise: precise_ip, 0-3 (default: 2)
+//  - period: sample period (default: `-c`)
+//  - rw: load or store, the R/W byte of its samples in the trace (default: load)
+// Returns 0 on success, or a static string describing the error
+static const char* parse_event_spec(const char* text, struct event_spec* spec){
+    char buf[256];
+    if(strlen(text) >= sizeof(buf)) return "event specification too long";
+    strcpy(buf,text);
+    memset(spec,0,sizeof(*spec));
+    spec->precise_ip = 2;
+    spec->rw = TRACE_RW_LOAD;
+    uint64_t event = 0, umask = 0;
+    uint8_t has_config = 0, has_event = 0;
+    char* save = NULL;
+    for(char* kv = strtok_r(buf,",",&save); kv != NULL; kv = strtok_r(NULL,",",&save)){
+        char* value = strchr(kv,'=');
+        if(value == NULL) return "expected key=value";
+        *value++ = '\0';
+        char* end = NULL;
+        const uint64_t number = strtoull(value,&end,0);
+        const uint8_t is_number = end != value && *end == '\0';
+        if(strcmp(kv,"name") == 0){
+            if(strlen(value) >= EVENT_NAME_SIZE) return "event name too long";
+            strcpy(spec->name,value);
+            continue;
+        }
+        if(strcmp(kv,"rw") == 0){
+            if(strcmp(value,"load") == 0) spec->rw = TRACE_RW_LOAD;
+            else if(strcmp(value,"store") == 0) spec->rw = TRACE_RW_STORE;
+            else return "rw must be load or store";
+            continue;
+        }
+        if(!is_number) return "expected a number";
+        if(strcmp(kv,"event") == 0){ event = number; has_event = 1; }
+        else if(strcmp(kv,"umask") == 0) umask = number;
+        else if(strcmp(kv,"config") == 0){ spec->config = number; has_config = 1; }
+        else if(strcmp(kv,"ldlat") == 0) spec->config1 = number;
+        else if(strcmp(kv,"precise") == 0){
+            if(number > 3) return "precise must be in [0,3]";
+            spec->precise_ip = (uint8_t)number;
+        }
+        else if(strcmp(kv,"period") == 0){
+            if(number == 0) return "period must be positive";
+            spec->period = number;
+        }
+        else return "unknown key";
+    }
+    if(!has_config){
+        if(!has_event) return "missing event or config";
+        //umask = config:8-15 ; event = config:0-7
+        spec->config = (umask << 8) | event;
+    }
+    if(spec->name[0] == '\0') snprintf(spec->name,EVENT_NAME_SIZE,"raw_0x%lx",spec->config);
+    return 0;
+}
+
+static void add_event_spec(struct argp_state *state, struct arguments *arguments, const char* text){
+    if(arguments->n_events == MAX_EVENTS){
+        argp_error(state, "Too many events (max %d)\n",MAX_EVENTS);
+        return;
+    }
+    const char* error = parse_event_spec(text,&arguments->events[arguments->n_events]);
+    if(error != NULL){
+        argp_error(state, "Invalid event `%s`: %s\n",text,error);
+        return;
+    }
+    arguments->n_events++;
+}
+
+// One event specification per line, empty lines and lines starting with '#' are ignored
+static void add_event_specs_from_file(struct argp_state *state, struct arguments *arguments, const char* path){
+    FILE* f = fopen(path,"r");
+    if(f == NULL){
+        argp_failure(state, EXIT_FAILURE, errno, "Couldn't open event file %s",path);
+        return;
+    }
+    char line[256];
+    while(fgets(line,sizeof(line),f) != NULL){
+        line[strcspn(line,"\r\n")] = '\0';
+        const char* start = line + strspn(line," \t");
+        if(*start == '\0' || *start == '#') continue;
+        add_event_spec(state,arguments,start);
+    }
+    fclose(f);
+}
+
+// When no event is specified: mem_inst_retired.all_loads (or mem_trans_retired.load_latency with `-l`) and
+// mem_inst_retired.all_stores
+static void set_default_events(struct arguments *arguments){
+    struct event_spec* loads = &arguments->events[0];
+    struct event_spec* stores = &arguments->events[1];
+    if(arguments->load_latency_threshold != 0) {
+        // mem_trans_retired.load_latency -> cpu/event=0xcd,umask=0x1,ldlat=T/ ; ldlat = config1
+        *loads = (struct event_spec){.name="load", .config=0x1cd, .config1=arguments->load_latency_threshold, .precise_ip=2, .rw=TRACE_RW_LOAD};
+    }
+    else {
+        // mem_inst_retired.all_loads -> cpu/(null)=0x1e8483,umask=0x81,event=0xd0/
+        *loads = (struct event_spec){.name="load", .config=0x81d0, .precise_ip=2, .rw=TRACE_RW_LOAD};
+    }
+    // mem_inst_retired.all_stores -> cpu/(null)=0x1e8483,umask=0x82,event=0xd0/
+    *stores = (struct event_spec){.name="store", .config=0x82d0, .precise_ip=2, .rw=TRACE_RW_STORE};
+    arguments->n_events = 2;
+}
+
 // Option parser function
 error_t parse_opt(int key, char *arg, struct argp_state *state) {
     struct arguments *arguments = state->input;
@@ -84,23 +236,103 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
             }
             if (arguments->mmap_size <= 0) {
                 argp_error(state, "Mmap size must be a positive integer\n");
-            } else if (__builtin_popcount(arguments->mmap_size) != 1) {
+            } else if (__builtin_popcountl(arguments->mmap_size) != 1) {
                 // Not a power of 2 --> Approximate to the closest power of 2
-                arguments->mmap_size = (8 * sizeof(arguments->mmap_size)) - __builtin_clzl(arguments->mmap_size - 1);
+                arguments->mmap_size = 1ul << ((8 * sizeof(arguments->mmap_size)) - __builtin_clzl(arguments->mmap_size - 1));
             }
             break;
         }
+        case 'b': {
+            char *end = NULL;
+            double percentage = strtod(arg,&end);
+            if(end == arg || percentage <= 0. || percentage >= 100.){
+                argp_error(state, "Overhead budget must be a percentage in ]0,100[\n");
+            }
+            arguments->overhead_budget = percentage / 100.;
+            break;
+        }
+        case 'M':
+            arguments->max_counter = strtoul(arg,NULL,10);
+            if (arguments->max_counter <= 0) {
+                argp_error(state, "Max counter must be a positive integer\n");
+            }
+            break;
+        case 'w':
+#ifdef PERF_SAMPLE_WEIGHT_STRUCT
+            // -W already asked for the latency, and perf_event_open rejects both layouts at once
+            if (arguments->sample_type & PERF_SAMPLE_WEIGHT_STRUCT) break;
+#endif
+            arguments->sample_type |= PERF_SAMPLE_DATA_SRC | PERF_SAMPLE_WEIGHT;
+            break;
+        case 'W':
+#ifdef PERF_SAMPLE_WEIGHT_STRUCT
+            arguments->sample_type = (arguments->sample_type & ~PERF_SAMPLE_WEIGHT) | PERF_SAMPLE_DATA_SRC | PERF_SAMPLE_WEIGHT_STRUCT;
+#else
+            argp_error(state, "PERF_SAMPLE_WEIGHT_STRUCT unsupported by these kernel headers\n");
+#endif
+            break;
+        case 'l':
+            arguments->load_latency_threshold = strtoul(arg,NULL,10);
+            if (arguments->load_latency_threshold <= 0) {
+                argp_error(state, "Load latency threshold must be a positive integer\n");
+            }
+            break;
+        case 'e':
+            add_event_spec(state,arguments,arg);
+            break;
+        case 'E':
+            add_event_specs_from_file(state,arguments,arg);
+            break;
+        case 's':
+            arguments->single_buffer = 1;
+            break;
+        case 'p':
+            if (arg[0] != '/' || strchr(arg+1,'/') != NULL) {
+                argp_error(state, "Ring name must be of the form /NAME\n");
+            }
+            arguments->ring_name = (const char*) arg;
+            break;
+        case 'N':
+            arguments->no_trace = 1;
+            break;
         case ARGP_KEY_INIT:
             break; // Do nothing
         case ARGP_KEY_ARG: {
             arguments->executable_path = arg;
             arguments->executable_path_position = state->next - 1;
-            return -1; //Preemptively finish parsing arguments; we'll gather `executable_arguments` manually afterwards, as argp doesn't support python's `argparse` ARG_REMAINDER equivalent
+            // Preemptively finish parsing arguments; we'll gather `executable_arguments` manually afterwards, as argp doesn't
+            // support python's `argparse` ARG_REMAINDER equivalent. Skipping them (rather than failing) still gets us ARGP_KEY_END
+            state->next = state->argc;
+            break;
         }
         case ARGP_KEY_END:
             if (state->arg_num < 1) {
                 argp_usage(state);
             }
+            if (arguments->n_events == 0) {
+                set_default_events(arguments);
+            }
+            else if (arguments->load_latency_threshold != 0) {
+                argp_error(state, "-l only applies to the default events, use ldlat= in the event specification instead\n");
+            }
+            for (size_t i = 0; i < arguments->n_events; i++) {
+                if (arguments->events[i].period == 0) arguments->events[i].period = arguments->counter;
+                if (arguments->events[i].config1 != 0) arguments->load_latency_threshold = arguments->events[i].config1;
+            }
+            if (arguments->single_buffer && arguments->n_events > 1) {
+                // Tells which event each record of the shared ring comes from
+                arguments->sample_type |= PERF_SAMPLE_IDENTIFIER;
+            }
+            if (arguments->load_latency_threshold != 0 && !(arguments->sample_type & PERF_SAMPLE_DATA_SRC)) {
+                // The latency is the whole point of the load latency event
+                arguments->sample_type |= PERF_SAMPLE_DATA_SRC | PERF_SAMPLE_WEIGHT;
+            }
+            if (arguments->max_counter < arguments->counter) {
+                argp_error(state, "Max counter must be greater than the counter\n");
+            }
+            if (arguments->no_trace && arguments->ring_name == NULL) {
+                argp_error(state, "-N without -p would throw all the samples away\n");
+            }
             break;
         default:
             return ARGP_ERR_UNKNOWN;
@@ -112,9 +344,25 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
 static char args_doc[] = "<executable_path> [<executable_arguments>]";
 static char doc[] = "Custom Perf -- A program to execute a given executable and collect performance data.\n"
                     "OPTIONS:\n"
-                    "  -d DIR  Specify the output directory for the collected data. (default: comparison/)\n"
+                    "  -d DIR  Specify the output directory for the collected data: the `mem_trace`, in c_rewrite's binary format,\n"
+                    "          its `mem_trace.ts` timestamps, and a `summary.txt` of lost/throttled samples and drain latencies.\n"
+                    "          (default: comparison/)\n"
                     "  -c N    Set the period of the sampling to the positive integer N. (default: 1)\n"
                     "  -m M    Set the size of the mmap to positive integer M. (default:\n"
+                    "  -b PCT  Adapt the sampling period at runtime to keep the time the executable spends stopped for\n"
+                    "          draining under PCT percent; changes are logged to `mem_trace.periods`. (default: fixed period)\n"
+                    "  -M N    Upper bound of the adapted sampling period. (default: 2^32)\n"
+                    "  -w      Also sample the data source and access latency of each sample, to `mem_trace.weights`.\n"
+                    "  -W      Same as -w, using the PERF_SAMPLE_WEIGHT_STRUCT layout for the latency. Takes precedence over -w.\n"
+                    "  -l T    Sample loads with the load latency event (0x1cd), only those taking at least T cycles. Implies -w.\n"
+                    "  -e SPEC Sample the event described by SPEC, e.g. `name=stlb_miss_loads,event=0xd0,umask=0x11,period=100`\n"
+                    "          (keys: name, event, umask, config, ldlat, precise, period, rw=load|store). Can be repeated.\n"
+                    "          (default: all loads and all stores)\n"
+                    "  -E FILE Same as -e, for each line of FILE.\n"
+                    "  -s      Have all events share a single ring buffer, instead of one each.\n"
+                    "  -p NAME Also publish the samples, in trace order, to the shared memory ring NAME (e.g. /pebs), for a live\n"
+                    "          consumer such as c_rewrite_live. Samples are dropped (and counted) when the consumer falls behind.\n"
+                    "  -N      Don't write the trace files, only publish the samples. Requires -p.\n"
                     "\n"
                     "ARGUMENTS:\n"
                     "  executable         The name of the executable to execute.\n"
@@ -125,6 +373,16 @@ static struct argp_option options[] = {
         {"dir", 'd', "DIR", 0, "Specify output directory (default: comparison/)."},
         {"count", 'c', "N", 0, "Specify the period of the sampling (default: 1 == sample every event)."},
         {"mmap", 'm', "M", 0, "Specify mmap size (default: 8K). Will be rounded to closest power of 2. Can use 'K','M', and 'G' for convenience (e.g. `-m 8M`)"},
+        {"overhead", 'b', "PCT", 0, "Adapt the period of the sampling (never below `-c`) to keep the overhead under PCT percent (default: fixed period)."},
+        {"max-count", 'M', "N", 0, "Specify the maximum period the sampling can be adapted to (default: 2^32)."},
+        {"weights", 'w', 0, 0, "Sample data source and latency (PERF_SAMPLE_DATA_SRC|PERF_SAMPLE_WEIGHT) to `mem_trace.weights`."},
+        {"weight-struct", 'W', 0, 0, "Same as --weights, with PERF_SAMPLE_WEIGHT_STRUCT instead of PERF_SAMPLE_WEIGHT."},
+        {"load-latency", 'l', "T", 0, "Sample loads with the load latency event, for loads of at least T cycles (implies --weights)."},
+        {"event", 'e', "SPEC", 0, "Add an event to sample, e.g. `event=0xd0,umask=0x81,precise=2,period=100,rw=load` (default: all loads and stores)."},
+        {"event-file", 'E', "FILE", 0, "Add the events of FILE, one SPEC per line."},
+        {"single-buffer", 's', 0, 0, "All events share one ring buffer instead of one each."},
+        {"publish", 'p', "NAME", 0, "Publish the samples to the shared memory ring NAME (e.g. /pebs) for a live consumer."},
+        {"no-trace", 'N', 0, 0, "Don't write the trace files, only publish the samples (requires --publish)."},
         {0}
 };
 
@@ -143,35 +401,480 @@ perf_event_open(struct perf_event_attr *hw_event, pid_t pid,
     return ret;
 }
 
-#define GET_PERF_ATTR(var_name,config_struct,args_p_var_name) struct perf_event_attr var_name = { .type=PERF_TYPE_RAW, .size=sizeof(struct perf_event_attr), \
-.config=(config_struct), .sample_period=(args_p_var_name)->counter,.sample_type=PERF_SAMPLE_IP|PERF_SAMPLE_TIME|PERF_SAMPLE_ADDR|PERF_SAMPLE_PHYS_ADDR, \
-.read_format=PERF_FORMAT_TOTAL_TIME_RUNNING, .disabled=1, .exclude_kernel=1, .exclude_hv = 1 ,.freq=0, .enable_on_exec=1, .precise_ip=2}
+// Always sampled ; `-w/-W` add the data source and weight
+#define PEBS_SAMPLE_TYPE (PERF_SAMPLE_IP|PERF_SAMPLE_TIME|PERF_SAMPLE_ADDR|PERF_SAMPLE_PHYS_ADDR)
 
-struct perf_sample{ //TODO: update as ATTR above changes
+#define GET_PERF_ATTR(var_name,event_spec_p,args_p_var_name) struct perf_event_attr var_name = { .type=PERF_TYPE_RAW, .size=sizeof(struct perf_event_attr), \
+.config=(event_spec_p)->config, .config1=(event_spec_p)->config1, .sample_period=(event_spec_p)->period,.sample_type=(args_p_var_name)->sample_type, \
+.read_format=PERF_FORMAT_TOTAL_TIME_RUNNING, .disabled=1, .exclude_kernel=1, .exclude_hv = 1 ,.freq=0, .enable_on_exec=1, .precise_ip=(event_spec_p)->precise_ip, \
+.use_clockid=1, .clockid=CLOCK_MONOTONIC}
+
+struct perf_sample{ // Parsed from the sample records, see `parse_sample`
+    uint64_t   id; // PERF_SAMPLE_IDENTIFIER
     uint64_t   ip;
     uint64_t   time;
     uint64_t   addr;
+    uint64_t   weight; // PERF_SAMPLE_WEIGHT: latency in cycles ; PERF_SAMPLE_WEIGHT_STRUCT: `union perf_sample_weight`
+    uint64_t   data_src; // `union perf_mem_data_src`
     uint64_t   phys_addr;
 };
 
-enum event_type{NONE_EVENT=-1,LOAD,STORE,NM_EVENTS};
+struct trace_record{
+    uint64_t time;
+    uint64_t addr;
+    uint64_t data_src;
+    uint64_t weight;
+    uint8_t rw;
+};
 
+struct record_buffer{
+    struct trace_record* records;
+    size_t size;
+    size_t capacity;
+};
 
-static inline void switch_events(int loads_event_fd, int stores_event_fd, unsigned long int signal) {
-    int error = ioctl(loads_event_fd, signal);
-    if(error){
-        err("Failed to stop load event\n");
+struct trace_output{
+    FILE* trace; // NULL with `-N`, so are the timestamps and weights
+    FILE* timestamps;
+    FILE* weights; // NULL if not sampled
+    struct pebs_ring* ring; // NULL if not publishing
+    const char* ring_name;
+    uint64_t n_written;
+};
+
+static int record_buffer_push(struct record_buffer* rb, const struct trace_record* record){
+    if(unlikely(rb->size == rb->capacity)){
+        size_t new_capacity = rb->capacity ? 2*rb->capacity : 4096;
+        struct trace_record* new_records = realloc(rb->records,new_capacity*sizeof(struct trace_record));
+        if(new_records == NULL) return ENOMEM;
+        rb->records = new_records;
+        rb->capacity = new_capacity;
     }
-    error = ioctl(stores_event_fd,signal);
-    if(error){
-        err("Failed to stop load event");
+    rb->records[rb->size++] = *record;
+    return 0;
+}
+
+static FILE* open_in_dir(const char* dir, const char* fn){
+    char path[PATH_MAX];
+    if(snprintf(path,PATH_MAX,"%s/%s",dir,fn) >= PATH_MAX){
+        errno = ENAMETOOLONG;
+        return NULL;
     }
+    FILE* f = fopen(path,"wb");
+    if(f != NULL) setvbuf(f,NULL,_IOFBF,TRACE_WRITE_BUFFER_SIZE);
+    return f;
 }
 
-#define ENABLE_PEBS_EVENTS(load_fd,store_fd) switch_events((load_fd),(store_fd),PERF_EVENT_IOC_ENABLE)
-#define DISABLE_PEBS_EVENTS(load_fd,store_fd) switch_events((load_fd),(store_fd),PERF_EVENT_IOC_DISABLE)
+static int open_trace_output(const struct arguments* args, struct trace_output* out){
+    const char* output_dir = args->output_dir;
+    const uint8_t with_weights = (args->sample_type & PERF_SAMPLE_DATA_SRC) != 0;
+    if(mkdir(output_dir,0755) == -1 && errno != EEXIST){
+        err("Couldn't create output directory");
+        return -1;
+    }
+    out->n_written = 0;
+    out->trace = out->timestamps = out->weights = NULL;
+    out->ring = NULL;
+    out->ring_name = args->ring_name;
+    if(args->ring_name != NULL){
+        shm_unlink(args->ring_name); // left over by a previous run whose consumer didn't unlink it
+        out->ring = pebs_ring_create(args->ring_name,PEBS_RING_DEFAULT_CAPACITY);
+        if(out->ring == NULL){
+            err("Couldn't create the shared memory ring");
+            return -1;
+        }
+    }
+    if(args->no_trace) return 0;
+    out->trace = open_in_dir(output_dir,TRACE_FN);
+    if(out->trace == NULL){
+        err("Couldn't open trace file");
+        goto close_ring;
+    }
+    out->timestamps = open_in_dir(output_dir,TRACE_TS_FN);
+    if(out->timestamps == NULL){
+        err("Couldn't open trace timestamps file");
+        fclose(out->trace);
+        goto close_ring;
+    }
+    if(with_weights){
+        out->weights = open_in_dir(output_dir,TRACE_WEIGHTS_FN);
+        if(out->weights == NULL){
+            err("Couldn't open trace weights file");
+            fclose(out->trace);
+            fclose(out->timestamps);
+            goto close_ring;
+        }
+    }
+    return 0;
 
-#define GET_START_OFFSET() (addr_to_use + ((mmap_header->data_offset+at)%mmap_header->data_size))
+    close_ring:
+    if(out->ring != NULL){
+        pebs_ring_close(out->ring);
+        shm_unlink(args->ring_name);
+    }
+    return -1;
+}
+
+// The ring itself is left for the consumer to drain and unlink
+static void close_trace_output(struct trace_output* out){
+    if(out->trace != NULL && fclose(out->trace)) err("Couldn't close trace file");
+    if(out->timestamps != NULL && fclose(out->timestamps)) err("Couldn't close trace timestamps file");
+    if(out->weights != NULL && fclose(out->weights)) err("Couldn't close trace weights file");
+    out->trace = out->timestamps = out->weights = NULL;
+    if(out->ring != NULL){
+        pebs_ring_finish(out->ring);
+        if(pebs_ring_close(out->ring)) err("Couldn't unmap the shared memory ring");
+        out->ring = NULL;
+    }
+}
+
+// Copies `len` bytes starting at ring offset `at`, taking care of records wrapping around the end of the ring
+static inline void copy_from_ring(const unsigned char* data, uint64_t data_size, uint64_t at, void* dest, size_t len){
+    const uint64_t start = at % data_size;
+    if(likely(start + len <= data_size)){
+        memcpy(dest,data+start,len);
+    }
+    else{
+        const size_t first_part = data_size - start;
+        memcpy(dest,data+start,first_part);
+        memcpy((unsigned char*)dest+first_part,data,len-first_part);
+    }
+}
+
+// Collector health, per event: lets us tell whether low sample counts come from the workload or from us falling behind
+struct ring_stats{
+    uint64_t samples, unaddressed_samples, malformed_samples;
+    uint64_t lost, lost_records;
+    uint64_t throttles, unthrottles, throttled_ns;
+    uint64_t throttled_since; // 0 == not currently throttled
+    uint64_t other_records;
+};
+
+struct pebs_event{
+    struct event_spec spec;
+    int fd;
+    uint64_t id; // PERF_EVENT_IOC_ID, to demultiplex a shared ring
+    unsigned char* ring; // NULL if outputting to another event's ring
+    uint64_t period; // current one, might be adapted
+    struct record_buffer drained;
+    struct ring_stats stats;
+};
+
+static inline void switch_events(struct pebs_event* events, size_t n_events, unsigned long int signal) {
+    for(size_t i = 0; i < n_events; i++){
+        if(ioctl(events[i].fd, signal)){
+            err("Failed to switch event");
+        }
+    }
+}
+
+#define ENABLE_PEBS_EVENTS(events,n_events) switch_events((events),(n_events),PERF_EVENT_IOC_ENABLE)
+#define DISABLE_PEBS_EVENTS(events,n_events) switch_events((events),(n_events),PERF_EVENT_IOC_DISABLE)
+
+// Which of the events sharing a ring a record belongs to. Unknown ids are blamed on the ring's owner
+static inline struct pebs_event* event_of_id(struct pebs_event* events, size_t n_events, uint64_t id){
+    for(size_t i = 1; i < n_events; i++){
+        if(events[i].id == id) return &events[i];
+    }
+    return &events[0];
+}
+
+#ifdef PERF_SAMPLE_WEIGHT_STRUCT
+#define PERF_SAMPLE_WEIGHT_STRUCT_IF_ANY PERF_SAMPLE_WEIGHT_STRUCT
+#else
+#define PERF_SAMPLE_WEIGHT_STRUCT_IF_ANY 0
+#endif
+
+// Parses the body of a PERF_RECORD_SAMPLE according to `sample_type`, whose fields are laid out in the kernel's fixed
+// order. Returns 0 on success, -1 if the record is shorter than announced or uses a field we don't know the size of
+static int parse_sample(const unsigned char* body, size_t body_size, uint64_t sample_type, struct perf_sample* sample){
+    const unsigned char* at = body;
+    const unsigned char* const end = body + body_size;
+#define SAMPLE_FIELD(flag,dest) do{ if(sample_type & (flag)){                   \
+        if(unlikely(at + sizeof(uint64_t) > end)) return -1;                       \
+        uint64_t value_; memcpy(&value_,at,sizeof(uint64_t)); at+=sizeof(uint64_t); \
+        (void)value_; dest; } }while(0)
+    if(unlikely(sample_type & ~(PERF_SAMPLE_IDENTIFIER|PERF_SAMPLE_IP|PERF_SAMPLE_TID|PERF_SAMPLE_TIME|PERF_SAMPLE_ADDR|
+                                PERF_SAMPLE_ID|PERF_SAMPLE_STREAM_ID|PERF_SAMPLE_CPU|PERF_SAMPLE_PERIOD|PERF_SAMPLE_WEIGHT|
+                                PERF_SAMPLE_WEIGHT_STRUCT_IF_ANY|PERF_SAMPLE_DATA_SRC|PERF_SAMPLE_PHYS_ADDR))){
+        return -1;
+    }
+    memset(sample,0,sizeof(*sample));
+    SAMPLE_FIELD(PERF_SAMPLE_IDENTIFIER,sample->id = value_);
+    SAMPLE_FIELD(PERF_SAMPLE_IP,sample->ip = value_);
+    SAMPLE_FIELD(PERF_SAMPLE_TID,); // u32 pid, tid
+    SAMPLE_FIELD(PERF_SAMPLE_TIME,sample->time = value_);
+    SAMPLE_FIELD(PERF_SAMPLE_ADDR,sample->addr = value_);
+    SAMPLE_FIELD(PERF_SAMPLE_ID,);
+    SAMPLE_FIELD(PERF_SAMPLE_STREAM_ID,);
+    SAMPLE_FIELD(PERF_SAMPLE_CPU,); // u32 cpu, res
+    SAMPLE_FIELD(PERF_SAMPLE_PERIOD,);
+    // READ, CALLCHAIN, RAW, BRANCH_STACK, REGS_USER, STACK_USER would be here, but are variable sized
+    SAMPLE_FIELD(PERF_SAMPLE_WEIGHT | PERF_SAMPLE_WEIGHT_STRUCT_IF_ANY,sample->weight = value_);
+    SAMPLE_FIELD(PERF_SAMPLE_DATA_SRC,sample->data_src = value_);
+    SAMPLE_FIELD(PERF_SAMPLE_PHYS_ADDR,sample->phys_addr = value_);
+#undef SAMPLE_FIELD
+    return 0;
+}
+
+// Moves every sample currently in the ring of `events[0]` to its event's `drained`, accounts for the other records, and
+// hands the space back to the kernel. `events[1..n_events[` are the events outputting to that same ring, if any.
+// Returns the number of samples drained
+static size_t drain_ring(struct pebs_event* events, size_t n_events, uint64_t sample_type){
+    unsigned char* mmap_start = events[0].ring;
+    // A record's size is a u16
+    static unsigned char record[UINT16_MAX+1];
+    struct perf_event_mmap_page* mmap_header = (struct perf_event_mmap_page*)mmap_start;
+    const unsigned char* data = mmap_start + mmap_header->data_offset;
+    const uint64_t data_size = mmap_header->data_size;
+    const uint64_t head = __atomic_load_n(&mmap_header->data_head,__ATOMIC_ACQUIRE);
+    uint64_t at = mmap_header->data_tail;
+    size_t n_samples = 0;
+    while(at < head){
+        struct perf_event_header event_header;
+        copy_from_ring(data,data_size,at,&event_header,sizeof(event_header));
+        if(unlikely(event_header.size < sizeof(event_header) || at + event_header.size > head)){
+            printf("Malformed record in ring, dropping the rest of it\n");
+            at = head;
+            break;
+        }
+        const size_t body_size = event_header.size - sizeof(event_header);
+        copy_from_ring(data,data_size,at+sizeof(event_header),record,body_size);
+        switch(event_header.type){
+            case PERF_RECORD_SAMPLE: {
+                struct perf_sample sample;
+                if(unlikely(parse_sample(record,body_size,sample_type,&sample))){
+                    events[0].stats.malformed_samples++;
+                    break;
+                }
+                struct pebs_event* event = event_of_id(events,n_events,sample.id);
+                struct ring_stats* stats = &event->stats;
+                n_samples++;
+                stats->samples++;
+                if(unlikely(sample.addr == 0)) { // PEBS couldn't attribute an address, nothing to replay
+                    stats->unaddressed_samples++;
+                    break;
+                }
+                struct trace_record trace_record = {.time=sample.time, .addr=sample.addr, .data_src=sample.data_src,
+                                                    .weight=sample.weight, .rw=event->spec.rw};
+                if (unlikely(record_buffer_push(&event->drained, &trace_record))) {
+                    err("Couldn't grow sample buffer, dropping sample");
+                }
+                break;
+            }
+            case PERF_RECORD_LOST: { // u64 id, u64 lost
+                uint64_t id = 0, lost = 0;
+                if(likely(body_size >= 2*sizeof(uint64_t))){
+                    memcpy(&id,record,sizeof(uint64_t));
+                    memcpy(&lost,record+sizeof(uint64_t),sizeof(uint64_t));
+                }
+                struct ring_stats* stats = &event_of_id(events,n_events,id)->stats;
+                stats->lost += lost;
+                stats->lost_records++;
+                break;
+            }
+            case PERF_RECORD_THROTTLE:
+            case PERF_RECORD_UNTHROTTLE: { // u64 time, u64 id, u64 stream_id
+                uint64_t time = 0, id = 0;
+                if(likely(body_size >= 2*sizeof(uint64_t))){
+                    memcpy(&time,record,sizeof(uint64_t));
+                    memcpy(&id,record+sizeof(uint64_t),sizeof(uint64_t));
+                }
+                struct ring_stats* stats = &event_of_id(events,n_events,id)->stats;
+                if(event_header.type == PERF_RECORD_THROTTLE){
+                    stats->throttles++;
+                    if(stats->throttled_since == 0) stats->throttled_since = time;
+                }
+                else{
+                    stats->unthrottles++;
+                    if(stats->throttled_since != 0 && time >= stats->throttled_since) stats->throttled_ns += time - stats->throttled_since;
+                    stats->throttled_since = 0;
+                }
+                break;
+            }
+            default:
+                events[0].stats.other_records++;
+                break;
+        }
+        at += event_header.size;
+    }
+    __atomic_store_n(&mmap_header->data_tail,at,__ATOMIC_RELEASE);
+    return n_samples;
+}
+
+// Time spent, per wakeup, between poll() returning and the child being resumed
+#define DRAIN_LATENCY_BUCKETS 32
+struct drain_stats{
+    uint64_t wakeups;
+    uint64_t total_ns, max_ns;
+    uint64_t log2_us_histogram[DRAIN_LATENCY_BUCKETS]; // bucket i == [2^(i-1),2^i[ us, bucket 0 == < 1us
+};
+
+static void drain_stats_add(struct drain_stats* ds, uint64_t latency_ns){
+    ds->wakeups++;
+    ds->total_ns += latency_ns;
+    if(latency_ns > ds->max_ns) ds->max_ns = latency_ns;
+    const uint64_t us = latency_ns / 1000;
+    size_t bucket = us == 0 ? 0 : (size_t)(64 - __builtin_clzl(us));
+    if(bucket >= DRAIN_LATENCY_BUCKETS) bucket = DRAIN_LATENCY_BUCKETS - 1;
+    ds->log2_us_histogram[bucket]++;
+}
+
+#define SUMMARY_FN "summary.txt"
+
+static void write_summary(const char* output_dir, const struct pebs_event* events, size_t n_events, const struct drain_stats* ds,
+                          const struct trace_output* out){
+    FILE* f = open_in_dir(output_dir,SUMMARY_FN);
+    if(f == NULL){
+        err("Couldn't open summary file");
+        return;
+    }
+    for(size_t i = 0; i < n_events; i++){
+        const struct ring_stats* rs = &events[i].stats;
+        const char* name = events[i].spec.name;
+        fprintf(f,"%s_samples=%lu\n%s_unaddressed_samples=%lu\n%s_malformed_samples=%lu\n",name,rs->samples,name,rs->unaddressed_samples,name,rs->malformed_samples);
+        fprintf(f,"%s_lost=%lu\n%s_lost_records=%lu\n",name,rs->lost,name,rs->lost_records);
+        fprintf(f,"%s_throttles=%lu\n%s_unthrottles=%lu\n%s_throttled_ns=%lu\n%s_still_throttled=%d\n",name,rs->throttles,name,rs->unthrottles,
+                name,rs->throttled_ns,name,rs->throttled_since != 0);
+        fprintf(f,"%s_other_records=%lu\n%s_final_period=%lu\n",name,rs->other_records,name,events[i].period);
+    }
+    if(out->ring != NULL) fprintf(f,"published_dropped=%lu\n",__atomic_load_n(&out->ring->dropped,__ATOMIC_RELAXED));
+    fprintf(f,"written_records=%lu\nwakeups=%lu\ndrain_total_ns=%lu\ndrain_max_ns=%lu\ndrain_avg_ns=%lu\n",out->n_written,ds->wakeups,
+            ds->total_ns,ds->max_ns,ds->wakeups ? ds->total_ns/ds->wakeups : 0);
+    fprintf(f,"drain_log2_us_histogram=");
+    for(size_t b = 0; b < DRAIN_LATENCY_BUCKETS; b++) fprintf(f,"%lu%c",ds->log2_us_histogram[b],b+1 == DRAIN_LATENCY_BUCKETS ? '\n' : ',');
+    if(fclose(f)) err("Couldn't close summary file");
+}
+
+static int compare_record_time(const void* l, const void* r){
+    const uint64_t lt = ((const struct trace_record*)l)->time, rt = ((const struct trace_record*)r)->time;
+    return (lt > rt) - (lt < rt);
+}
+
+// Writes all the drained records of the `n_events` events, merged in timestamp order, and empties their buffers
+static int write_merged(struct pebs_event* events, size_t n_buffers, struct trace_output* out){
+    struct record_buffer* buffers[n_buffers];
+    size_t positions[n_buffers];
+    for(size_t b = 0; b < n_buffers; b++){
+        buffers[b] = &events[b].drained;
+        positions[b] = 0;
+        // A single ring is almost always already in time order (samples are appended as they're taken), sort otherwise
+        for(size_t i = 1; i < buffers[b]->size; i++){
+            if(buffers[b]->records[i-1].time > buffers[b]->records[i].time){
+                qsort(buffers[b]->records,buffers[b]->size,sizeof(struct trace_record),compare_record_time);
+                break;
+            }
+        }
+    }
+    int error = 0;
+    while(!error){
+        struct trace_record* next = NULL;
+        size_t next_buffer = 0;
+        for(size_t b = 0; b < n_buffers; b++){
+            if(positions[b] < buffers[b]->size && (next == NULL || buffers[b]->records[positions[b]].time < next->time)){
+                next = &buffers[b]->records[positions[b]];
+                next_buffer = b;
+            }
+        }
+        if(next == NULL) break;
+        positions[next_buffer]++;
+        if(out->ring != NULL){
+            const struct pebs_ring_record published = {.time=next->time, .addr=next->addr, .rw=next->rw};
+            pebs_ring_push(out->ring,&published); // drops are accounted for in the ring
+        }
+        if(out->trace == NULL){
+            out->n_written++;
+            continue;
+        }
+        if(unlikely(fwrite(&next->rw,sizeof(next->rw),1,out->trace) != 1 ||
+                    fwrite(&next->addr,sizeof(next->addr),1,out->trace) != 1 ||
+                    fwrite(&next->time,sizeof(next->time),1,out->timestamps) != 1 ||
+                    (out->weights != NULL && (fwrite(&next->data_src,sizeof(next->data_src),1,out->weights) != 1 ||
+                                              fwrite(&next->weight,sizeof(next->weight),1,out->weights) != 1)))){
+            error = EIO;
+        }
+        else out->n_written++;
+    }
+    for(size_t b = 0; b < n_buffers; b++) buffers[b]->size = 0;
+    return error;
+}
+
+// Adaptive sampling period: every PERIOD_CONTROL_WINDOW_NS, compares the share of wall time the child spent stopped
+// (== our draining overhead) to the budget and rescales the sample periods. The drain rate, hence the overhead, is
+// inversely proportional to the period, so scaling the period by overhead/budget brings the overhead back to budget
+#define TRACE_PERIODS_FN "mem_trace.periods"
+#define PERIOD_CONTROL_WINDOW_MS 100
+#define PERIOD_CONTROL_WINDOW_NS ((uint64_t)PERIOD_CONTROL_WINDOW_MS*1000*1000)
+#define PERIOD_MAX_SCALE 4.
+#define PERIOD_HYSTERESIS 0.1
+
+struct period_controller{
+    double overhead_budget;
+    uint64_t max_period; // each event's minimum is the period it was specified with
+    uint64_t window_start_ns, window_stopped_ns, window_samples;
+    FILE* log;
+};
+
+static inline uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts); // same clock as the samples' (`.clockid`), so the log lines up with the trace
+    return (uint64_t)ts.tv_sec*1000*1000*1000 + (uint64_t)ts.tv_nsec;
+}
+
+static inline void log_period(struct period_controller* pc, uint64_t now, uint64_t records_written, const struct pebs_event* event,
+                              double overhead, double drain_rate){
+    fprintf(pc->log,"%lu,%lu,%s,%lu,%.4f,%.1f\n",now,records_written,event->spec.name,event->period,overhead,drain_rate);
+}
+
+static int period_controller_init(struct period_controller* pc, const struct arguments* args, const struct pebs_event* events, size_t n_events){
+    pc->overhead_budget = args->overhead_budget;
+    pc->max_period = args->max_counter;
+    pc->log = open_in_dir(args->output_dir,TRACE_PERIODS_FN);
+    if(pc->log == NULL){
+        err("Couldn't open sample period log");
+        return -1;
+    }
+    // record == index, in `mem_trace`, of the first record sampled with the new period
+    fprintf(pc->log,"time,record,event,period,overhead,drain_rate\n"); // event: its name
+    pc->window_start_ns = now_ns();
+    pc->window_stopped_ns = pc->window_samples = 0;
+    for(size_t i = 0; i<n_events; i++){
+        log_period(pc,pc->window_start_ns,0,&events[i],0.,0.);
+    }
+    return 0;
+}
+
+static void period_controller_update(struct period_controller* pc, struct pebs_event* events, size_t n_events, uint64_t now, uint64_t records_written){
+    const uint64_t window = now - pc->window_start_ns;
+    if(window < PERIOD_CONTROL_WINDOW_NS) return;
+    const double overhead = (double)pc->window_stopped_ns / (double)window;
+    const double drain_rate = (double)pc->window_samples * 1e9 / (double)window;
+    double scale = overhead / pc->overhead_budget;
+    if(scale > PERIOD_MAX_SCALE) scale = PERIOD_MAX_SCALE;
+    else if(scale < 1./PERIOD_MAX_SCALE) scale = 1./PERIOD_MAX_SCALE;
+    if(scale > 1. + PERIOD_HYSTERESIS || scale < 1. - PERIOD_HYSTERESIS){
+        for(size_t i = 0; i<n_events; i++){
+            struct pebs_event* event = &events[i];
+            double scaled = (double)event->period * scale;
+            uint64_t new_period = scaled > (double)pc->max_period ? pc->max_period : (uint64_t)scaled;
+            if(new_period < event->spec.period) new_period = event->spec.period;
+            if(new_period == event->period) continue;
+            if(unlikely(ioctl(event->fd,PERF_EVENT_IOC_PERIOD,&new_period))){
+                err("Couldn't update the sample period");
+                continue;
+            }
+            event->period = new_period;
+            log_period(pc,now,records_written,event,overhead,drain_rate);
+        }
+    }
+    pc->window_start_ns = now;
+    pc->window_stopped_ns = pc->window_samples = 0;
+}
+
+static void period_controller_close(struct period_controller* pc){
+    if(pc->log != NULL && fclose(pc->log)) err("Couldn't close sample period log");
+    pc->log = NULL;
+}
 
 
 void gather_stats(struct arguments *args) {
@@ -230,95 +933,138 @@ void gather_stats(struct arguments *args) {
         if(close(pipefd[0])==-1)err("Parent couldn't close R side of pipe");
         // Set up the PEBS events
         //TODO: Usage of wakeup_watermark/events when sample_period is specified??
-        GET_PERF_ATTR(loads_event_arguments,0x81d0,args);
-        GET_PERF_ATTR(stores_event_arguments,0x82d0,args);
-
-        int loads_event_fd = perf_event_open(&loads_event_arguments,child_pid,-1,-1,0);
-        if(loads_event_fd == -1) goto terminate_child;
-        int stores_event_fd = perf_event_open(&stores_event_arguments,child_pid,-1,-1,0);
-        if(stores_event_fd == -1) goto close_load_fd;
-
-        //umask = config:8-15 ; event = config:0-7
-        // mem_inst_retired.all_loads -> cpu/(null)=0x1e8483,umask=0x81,event=0xd0/
-        // mem_inst_retired.all_stores -> cpu/(null)=0x1e8483,umask=0x82,event=0xd0/
-        const size_t mmap_size = sizeof(struct perf_event_mmap_page) + (args->mmap_size);
+        const size_t n_events = args->n_events;
+        struct pebs_event* events = calloc(n_events,sizeof(struct pebs_event));
+        if(events == NULL){
+            err("Couldn't allocate the events");
+            goto terminate_child;
+        }
         // Must 1 + 2^n pages big
-        unsigned char* load_mmap_addr_start = mmap(NULL, mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED, loads_event_fd, 0);
-        if(load_mmap_addr_start == MAP_FAILED){
-            err("Failed to create load map");
-            goto close_store_fd;
+        const size_t mmap_size = sizeof(struct perf_event_mmap_page) + (args->mmap_size);
+        size_t n_opened = 0;
+        for(; n_opened < n_events; n_opened++){
+            struct pebs_event* event = &events[n_opened];
+            event->spec = args->events[n_opened];
+            event->period = event->spec.period;
+            GET_PERF_ATTR(event_arguments,&event->spec,args);
+            event->fd = perf_event_open(&event_arguments,child_pid,-1,-1,0);
+            if(event->fd == -1){
+                fprintf(stderr,"Couldn't open event %s\n",event->spec.name);
+                goto close_events;
+            }
+            if(unlikely(ioctl(event->fd,PERF_EVENT_IOC_ID,&event->id))){
+                err("Couldn't get the id of an event");
+                n_opened++;
+                goto close_events;
+            }
+            if(args->single_buffer && n_opened > 0){
+                // Samples go to the first event's ring, demultiplexed by id when draining
+                if(ioctl(event->fd,PERF_EVENT_IOC_SET_OUTPUT,events[0].fd)){
+                    err("Couldn't redirect an event's output to the shared ring");
+                    n_opened++;
+                    goto close_events;
+                }
+                continue;
+            }
+            event->ring = mmap(NULL, mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED, event->fd, 0);
+            if(event->ring == MAP_FAILED){
+                event->ring = NULL;
+                fprintf(stderr,"Failed to create the map of event %s: %s\n",event->spec.name,strerror(errno));
+                n_opened++;
+                goto close_events;
+            }
         }
-        unsigned char* store_mmap_addr_start = mmap(NULL, mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED, stores_event_fd, 0);
-        if(store_mmap_addr_start == MAP_FAILED){
-            err("Failed to create store map");
-            goto unmap_load;
+        // The events sharing a ring follow its owner: drain_ring(&events[i], n_ring_events[i])
+        size_t n_ring_events[MAX_EVENTS];
+        size_t n_rings = 0;
+        for(size_t i = 0; i < n_events; i++){
+            n_ring_events[i] = events[i].ring == NULL ? 0 : (args->single_buffer ? n_events : 1);
+            n_rings += events[i].ring != NULL;
         }
 
         //Parent
-        struct pollfd to_poll[NM_EVENTS] = {{.fd=loads_event_fd,.events=POLLIN | POLLERR | POLLHUP},{.fd=stores_event_fd,.events=POLLIN | POLLERR | POLLHUP}};
+        struct trace_output trace_output = {0};
+        if(open_trace_output(args,&trace_output)){
+            goto close_events;
+        }
+        struct drain_stats drain_stats = {0};
+        const uint8_t adaptive = args->overhead_budget > 0.;
+        struct period_controller controller = {0};
+        if(adaptive && period_controller_init(&controller,args,events,n_events)){
+            close_trace_output(&trace_output);
+            goto close_events;
+        }
+
+        // Only the ring owners get notified
+        struct pollfd to_poll[MAX_EVENTS];
+        for(size_t i = 0, r = 0; i < n_events; i++){
+            if(events[i].ring != NULL) to_poll[r++] = (struct pollfd){.fd=events[i].fd,.events=POLLIN | POLLERR | POLLHUP};
+        }
             if(unlikely(close(pipefd[1])==-1)) err("Parent finished but couldn't close W side of pipefd "); //Starts child
-        uint64_t l_count = 0, s_count = 0, woken = 0;
+        uint64_t count = 0, woken = 0;
+        uint8_t child_exited = 0;
         while(1){
-            int read = poll(to_poll,NM_EVENTS,-1);
-            if(likely(read > 0)){
-                // One of the fds is ready to be read
-                //Stop the process
+            // When adapting the period, also wake up periodically, so that quiet phases get a chance to be sampled more
+            int read = poll(to_poll,n_rings,adaptive ? PERIOD_CONTROL_WINDOW_MS : -1);
+            if(unlikely(read == 0 && !adaptive)){
+                printf("Poll timed out yet no timeout set...\n");
+                break;
+            }
+            // Timed out: only stop the child once the control window is over, to apply the new period while it's stopped
+            if(read == 0 && now_ns() - controller.window_start_ns < PERIOD_CONTROL_WINDOW_NS) continue;
+            if(likely(read >= 0)){
+                // One of the fds is ready to be read, or the period is to be updated
+                //Stop the process, and wait for it to actually be stopped: otherwise it could still write samples to
+                // one ring while we're draining another, breaking the timestamp ordering of the merged trace
+                const uint64_t woken_at = now_ns();
                 error = kill(child_pid,SIGSTOP);
                 if(unlikely(error)){
                     err("Couldn't pause child process");
                 }
+                int child_status;
+                if(unlikely(waitpid(child_pid,&child_status,WUNTRACED) == -1)){
+                    err("Couldn't wait for child process to stop");
+                }
+                else if(WIFEXITED(child_status) || WIFSIGNALED(child_status)){
+                    child_exited = 1;
+                }
                 //Just in case, disable PEBS sampling
-                //DISABLE_PEBS_EVENTS(loads_event_fd, stores_event_fd);
+                //DISABLE_PEBS_EVENTS(events, n_events);
                 woken+=1;
                 #if DEBUG
                 printf("Woke up from read\n");
                 #endif
-                if(read!=1){
-                    printf("More than one event ready at the same time... Only parsing first, losing others\n");
-                }
-                uint8_t quit = 0;
-                for(int i = LOAD;i<NM_EVENTS;i++){
-                    if(to_poll[i].revents!=0){
-                        // Analyze the data
+                uint8_t quit = child_exited;
+                for(size_t i = 0;i<n_rings;i++){
 #if DEBUG
-                        printf("Got revent from %d: %d !\n",(uint8_t)i,to_poll[i].revents);
+                    printf("Got revent from %zu: %d !\n",i,to_poll[i].revents);
 #endif
-                        if(to_poll[i].revents != POLL_IN) {
-                            quit = 1;
-                            continue;
-                        }
-                        unsigned char* addr_to_use = ((i == LOAD )? load_mmap_addr_start : store_mmap_addr_start);
-                        struct perf_event_mmap_page* mmap_header = (struct perf_event_mmap_page* )addr_to_use;
-                        size_t at = mmap_header->data_tail;
-                        while(at<mmap_header->data_head){
-                            struct perf_event_header* event_header = (struct perf_event_header*)(addr_to_use + ((mmap_header->data_offset+at)%mmap_header->data_size));
-                            at += sizeof(struct perf_event_header);
-                            if(event_header->type == PERF_RECORD_SAMPLE){
-                                    printf("Different sizes...");
-                                }
-#if DEBUG
-#endif
-                            if(event_header->size != sizeof(struct perf_sample)){
-                                struct perf_sample* sample = (struct perf_sample*)GET_START_OFFSET();
-                                if(i == LOAD) l_count++;
-                                else if(i==STORE) s_count++;
-                                //printf("dsadsad");
-                            }
-#if DEBUG
-                            else{
-                                printf("Got non sample... weird");
-                            }
-#endif
-                            at+=sizeof(struct perf_sample);
-                        }
-                        mmap_header->data_tail = at;
+                    if(to_poll[i].revents != 0 && to_poll[i].revents != POLLIN) {
+                        quit = 1;
                     }
                 }
+                // The child is stopped: drain all rings (not only the ready ones), so that everything written to the
+                // trace so far precedes, in time, whatever the child will sample once resumed
+                size_t n_drained = 0;
+                for(size_t i = 0;i<n_events;i++){
+                    if(events[i].ring != NULL) n_drained += drain_ring(&events[i],n_ring_events[i],args->sample_type);
+                }
+                count += n_drained;
+                if(unlikely(write_merged(events,n_events,&trace_output))){
+                    err("Failed to write samples to the trace");
+                    quit = 1;
+                }
+                // The SIGCONT below is negligible next to the stop and drain
+                const uint64_t drain_latency = now_ns() - woken_at;
+                drain_stats_add(&drain_stats,drain_latency);
                 if(quit) break;
-            }
-            else if(unlikely(read == 0)){
-                printf("Poll timed out yet no timeout set...\n");
-                break;
+                if(adaptive){
+                    controller.window_stopped_ns += drain_latency;
+                    controller.window_samples += n_drained;
+                    // Still stopped and drained: every record written so far was sampled with the old period, and every
+                    // one after with the new period
+                    period_controller_update(&controller,events,n_events,now_ns(),trace_output.n_written);
+                }
             }
             else{
                 // Error
@@ -326,11 +1072,11 @@ void gather_stats(struct arguments *args) {
                 break;
             }
             //Reset revents
-            for(int i=0;i<NM_EVENTS;i++){
+            for(size_t i=0;i<n_rings;i++){
                 to_poll[i].revents=0;
             }
             //Reenable PEBS
-            //ENABLE_PEBS_EVENTS(loads_event_fd,stores_event_fd);
+            //ENABLE_PEBS_EVENTS(events,n_events);
             //Resume the process
             error = kill(child_pid,SIGCONT);
             if(unlikely(error)){
@@ -338,55 +1084,40 @@ void gather_stats(struct arguments *args) {
             }
         }
 
-        for(enum event_type i = LOAD;i<NM_EVENTS;i++) {
-            unsigned char *addr_to_use = ((i == LOAD) ? load_mmap_addr_start : store_mmap_addr_start);
-            struct perf_event_mmap_page *mmap_header = (struct perf_event_mmap_page *) addr_to_use;
-            size_t at = mmap_header->data_tail;
-            while (at < mmap_header->data_head) {
-                if(i == LOAD) l_count++;
-                else if(i==STORE) s_count++;
-                struct perf_event_header *event_header = (struct perf_event_header *) (addr_to_use +
-                                                                                       ((mmap_header->data_offset +
-                                                                                         at) % mmap_header->data_size));
-                at += sizeof(struct perf_event_header);
-                if (event_header->type == PERF_RECORD_SAMPLE) {
-                    struct perf_sample *sample = (struct perf_sample *) GET_START_OFFSET();
-                    //printf("dsadsad");
-                }
-                at += sizeof(struct perf_sample);
-            }
-            if(at > mmap_header->data_head) at = mmap_header->data_head;
-            mmap_header->data_tail = at;
+        //Whatever is left in the rings since the last wakeup
+        for(size_t i = 0;i<n_events;i++){
+            if(events[i].ring != NULL) count += drain_ring(&events[i],n_ring_events[i],args->sample_type);
+        }
+        if(unlikely(write_merged(events,n_events,&trace_output))){
+            err("Failed to write last samples to the trace");
         }
 
-        printf("Got load %llu,store %llu, woken %llu",l_count,s_count,woken);
+        uint64_t lost = 0;
+        for(size_t i = 0;i<n_events;i++){
+            printf("Got %s %lu, ",events[i].spec.name,events[i].stats.samples);
+            lost += events[i].stats.lost;
+        }
+        printf("(total %lu) woken %lu, wrote %lu trace records, lost %lu\n",count,woken,trace_output.n_written,lost);
+        write_summary(args->output_dir,events,n_events,&drain_stats,&trace_output);
 
+        for(size_t i = 0;i<n_events;i++) free(events[i].drained.records);
+        close_trace_output(&trace_output);
+        if(adaptive) period_controller_close(&controller);
 
-        unmap_store:
-        error = munmap(store_mmap_addr_start,mmap_size);
-        if(error == -1){
-            printf("Failed to unmap store map\n");
-        }
-        store_mmap_addr_start = NULL;
-        unmap_load:
-        error = munmap(load_mmap_addr_start,mmap_size);
-        if(error == -1){
-            printf("Failed to unmap load map\n");
-        }
-        load_mmap_addr_start = NULL;
-        close_store_fd:
-        error = close(stores_event_fd);
-        if(error==-1){
-            printf("Failed to close store perf event fd\n");
-        }
-        close_load_fd:
-        error = close(loads_event_fd);
-        if(error==-1) {
-            printf("Failed to close loads perf event fd\n");
+        close_events:
+        for(size_t i = n_opened; i-- > 0;){
+            if(events[i].ring != NULL && munmap(events[i].ring,mmap_size) == -1){
+                printf("Failed to unmap the map of event %s\n",events[i].spec.name);
+            }
+            if(close(events[i].fd) == -1){
+                printf("Failed to close the perf event fd of event %s\n",events[i].spec.name);
+            }
         }
+        free(events);
         terminate_child:
         if(kill(child_pid,0) == 0){ //child is still alive
             kill(child_pid,SIGTERM);
+            kill(child_pid,SIGCONT); // might have been left stopped, in which case SIGTERM would stay pending
         }
         goto free_args; //Skip close_pipe, as we've already closed some of the parts
     }
@@ -425,7 +1156,15 @@ int main(int argc, char* argv[]){
             .num_extra_executable_args = 0,
             .output_dir = default_output_dir,
             .counter = default_counter,
-            .mmap_size = default_mmap_size
+            .mmap_size = default_mmap_size,
+            .overhead_budget = default_overhead_budget,
+            .max_counter = default_max_counter,
+            .sample_type = PEBS_SAMPLE_TYPE,
+            .load_latency_threshold = 0,
+            .n_events = 0,
+            .single_buffer = 0,
+            .ring_name = NULL,
+            .no_trace = 0
     };
 
     argp_parse(&argp, argc, argv, ARGP_IN_ORDER, 0, &arguments);
@@ -0,0 +1,137 @@
+#ifndef CUSTOM_PERF_PEBS_RING_H
+#define CUSTOM_PERF_PEBS_RING_H
+
+// Single producer (custom_perf `-p`), single consumer (c_rewrite's `c_rewrite_live`) ring of samples in POSIX shared
+// memory: lets a policy consume the samples of a live workload as they're drained, without going through a trace file.
+// Plain C, also included from C++
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define PEBS_RING_MAGIC 0x474e495253424550ull // "PEBSRING", set last by the producer
+#define PEBS_RING_VERSION 1
+#define PEBS_RING_DEFAULT_CAPACITY (1ul << 20) // records, 24 MB
+#define PEBS_RING_CACHE_LINE 64
+
+struct pebs_ring_record{
+    uint64_t time; // CLOCK_MONOTONIC ns
+    uint64_t addr;
+    uint8_t rw; // 0 == load, same as the trace's R/W byte
+    uint8_t padding[7];
+};
+
+struct pebs_ring{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t producer_done; // no more records will be pushed
+    uint64_t capacity; // power of 2
+    uint64_t dropped; // records the producer couldn't push, the ring being full: it never waits on the consumer
+    // Written by one side each, on their own cache lines
+    uint64_t head __attribute__((aligned(PEBS_RING_CACHE_LINE)));
+    uint64_t tail __attribute__((aligned(PEBS_RING_CACHE_LINE)));
+} __attribute__((aligned(PEBS_RING_CACHE_LINE)));
+
+static inline size_t pebs_ring_mapping_size(uint64_t capacity){
+    return sizeof(struct pebs_ring) + capacity*sizeof(struct pebs_ring_record);
+}
+
+static inline struct pebs_ring_record* pebs_ring_records(struct pebs_ring* ring){
+    return (struct pebs_ring_record*)(ring+1);
+}
+
+// Producer side. Returns 0 if pushed, 1 if dropped
+static inline int pebs_ring_push(struct pebs_ring* ring, const struct pebs_ring_record* record){
+    const uint64_t head = ring->head;
+    if(head - __atomic_load_n(&ring->tail,__ATOMIC_ACQUIRE) == ring->capacity){
+        __atomic_store_n(&ring->dropped,ring->dropped+1,__ATOMIC_RELAXED);
+        return 1;
+    }
+    pebs_ring_records(ring)[head & (ring->capacity-1)] = *record;
+    __atomic_store_n(&ring->head,head+1,__ATOMIC_RELEASE);
+    return 0;
+}
+
+static inline void pebs_ring_finish(struct pebs_ring* ring){
+    __atomic_store_n(&ring->producer_done,1,__ATOMIC_RELEASE);
+}
+
+// Consumer side. Copies up to `max` records to `out`, returns how many
+static inline size_t pebs_ring_pop(struct pebs_ring* ring, struct pebs_ring_record* out, size_t max){
+    const uint64_t tail = ring->tail;
+    uint64_t available = __atomic_load_n(&ring->head,__ATOMIC_ACQUIRE) - tail;
+    if(available > max) available = max;
+    const struct pebs_ring_record* records = pebs_ring_records(ring);
+    for(uint64_t i = 0; i < available; i++){
+        out[i] = records[(tail+i) & (ring->capacity-1)];
+    }
+    __atomic_store_n(&ring->tail,tail+available,__ATOMIC_RELEASE);
+    return (size_t)available;
+}
+
+// `name` as for shm_open, e.g. "/pebs". `capacity` must be a power of 2. Returns NULL (and sets errno) on failure
+static inline struct pebs_ring* pebs_ring_create(const char* name, uint64_t capacity){
+    if(capacity == 0 || (capacity & (capacity-1)) != 0){
+        errno = EINVAL;
+        return NULL;
+    }
+    const int fd = shm_open(name,O_CREAT | O_EXCL | O_RDWR,0600);
+    if(fd == -1) return NULL;
+    const size_t size = pebs_ring_mapping_size(capacity);
+    void* mapping = MAP_FAILED;
+    if(ftruncate(fd,(off_t)size) == 0){
+        mapping = mmap(NULL,size,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+    }
+    const int saved_errno = errno;
+    close(fd);
+    if(mapping == MAP_FAILED){
+        shm_unlink(name);
+        errno = saved_errno;
+        return NULL;
+    }
+    struct pebs_ring* ring = (struct pebs_ring*)mapping;
+    ring->version = PEBS_RING_VERSION;
+    ring->capacity = capacity;
+    __atomic_store_n(&ring->magic,PEBS_RING_MAGIC,__ATOMIC_RELEASE);
+    return ring;
+}
+
+// Returns NULL (and sets errno) if the ring doesn't exist, or isn't initialized yet (EAGAIN)
+static inline struct pebs_ring* pebs_ring_open(const char* name){
+    const int fd = shm_open(name,O_RDWR,0);
+    if(fd == -1) return NULL;
+    void* mapping = mmap(NULL,sizeof(struct pebs_ring),PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+    if(mapping == MAP_FAILED){
+        const int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return NULL;
+    }
+    struct pebs_ring* header = (struct pebs_ring*)mapping;
+    if(__atomic_load_n(&header->magic,__ATOMIC_ACQUIRE) != PEBS_RING_MAGIC || header->version != PEBS_RING_VERSION){
+        munmap(mapping,sizeof(struct pebs_ring));
+        close(fd);
+        errno = EAGAIN;
+        return NULL;
+    }
+    const size_t size = pebs_ring_mapping_size(header->capacity);
+    munmap(mapping,sizeof(struct pebs_ring));
+    mapping = mmap(NULL,size,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+    const int saved_errno = errno;
+    close(fd);
+    if(mapping == MAP_FAILED){
+        errno = saved_errno;
+        return NULL;
+    }
+    return (struct pebs_ring*)mapping;
+}
+
+static inline int pebs_ring_close(struct pebs_ring* ring){
+    return munmap(ring,pebs_ring_mapping_size(ring->capacity));
+}
+
+#endif //CUSTOM_PERF_PEBS_RING_H
@@ -0,0 +1,60 @@
+#ifndef C_REWRITE_HYPERLOGLOG_H
+#define C_REWRITE_HYPERLOGLOG_H
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Flajolet et al.'s HyperLogLog, with 2^PRECISION registers of the longest run of leading zeros seen per bucket
+// (standard error 1.04/sqrt(2^PRECISION), ~0.8% with the default). Sketches of disjoint parts of a stream merge with
+// a register-wise max, so each thread can count its own part
+template<unsigned PRECISION = 14>
+class HyperLogLog{
+public:
+    static constexpr size_t N_REGISTERS = size_t(1) << PRECISION;
+
+    HyperLogLog() : registers(N_REGISTERS,0) {}
+
+    void insert(uint64_t value){
+        const auto h = mix(value);
+        const auto bucket = h >> (64 - PRECISION);
+        const auto rank = static_cast<uint8_t>(std::countl_zero(h << PRECISION | (uint64_t(1) << (PRECISION - 1))) + 1);
+        registers[bucket] = std::max(registers[bucket],rank);
+    }
+
+    void merge(const HyperLogLog& other){
+        for(size_t i = 0; i < N_REGISTERS; i++) registers[i] = std::max(registers[i],other.registers[i]);
+    }
+
+    [[nodiscard]] size_t estimate() const {
+        constexpr auto m = static_cast<double>(N_REGISTERS);
+        const double alpha = 0.7213/(1 + 1.079/m);
+        double sum = 0;
+        size_t zeros = 0;
+        for(auto r : registers){
+            sum += std::ldexp(1.,-r);
+            zeros += r == 0;
+        }
+        const double raw = alpha*m*m/sum;
+        // Linear counting is more accurate while many registers are still empty
+        if(raw <= 2.5*m && zeros != 0) return static_cast<size_t>(std::llround(m*std::log(m/static_cast<double>(zeros))));
+        return static_cast<size_t>(std::llround(raw));
+    }
+
+private:
+    // MurmurHash3's finalizer: every input bit affects every output bit
+    static uint64_t mix(uint64_t x){
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return x;
+    }
+
+    std::vector<uint8_t> registers;
+};
+
+#endif //C_REWRITE_HYPERLOGLOG_H
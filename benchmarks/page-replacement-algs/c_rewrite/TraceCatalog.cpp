@@ -0,0 +1,289 @@
+#include "TraceCatalog.h"
+
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr uint64_t CATALOG_MAGIC = 0x474c544143435254; // "TRCCATLG"
+static constexpr uint64_t CATALOG_VERSION = 1;
+static constexpr uint64_t INDEX_MAGIC = 0x5844494c54414354; // "TCATLIDX"
+static constexpr uint32_t RECORD_MAGIC = 0x44524354; // "TCRD"
+static constexpr uint64_t MIN_BUCKETS = 1024;
+
+struct CatalogHeader{
+    uint64_t magic;
+    uint64_t version;
+};
+
+struct RecordHeader{
+    uint32_t magic;
+    uint32_t kind;
+    uint64_t trace_size;
+    uint64_t trace_mtime_ns;
+    uint32_t path_length;
+    uint32_t payload_length;
+    uint64_t checksum; // of the path and payload
+};
+
+// Released when going out of scope
+class FileLock{
+public:
+    FileLock(int fd, int operation) : fd(fd) {flock(fd,operation);}
+    ~FileLock(){flock(fd,LOCK_UN);}
+    void relock(int operation){flock(fd,operation);} // not atomic: anything read before must be read again
+private:
+    int fd;
+};
+
+static uint64_t fnv1a(const char* data, size_t length, uint64_t h = 0xcbf29ce484222325ull){
+    for(size_t i = 0; i < length; i++){
+        h ^= static_cast<uint8_t>(data[i]);
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static uint64_t hash_of(const std::string& trace_path, uint64_t size, uint64_t mtime_ns, uint32_t k){
+    uint64_t h = fnv1a(trace_path.data(),trace_path.size());
+    for(uint64_t v : {size,mtime_ns,static_cast<uint64_t>(k)}){
+        h ^= v + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+    }
+    return h == 0 ? 1 : h;
+}
+
+static bool read_fully(int fd, void* buf, size_t length, uint64_t offset){
+    for(size_t done = 0; done < length;){
+        const auto ret = pread(fd,static_cast<char*>(buf) + done,length - done,static_cast<off_t>(offset + done));
+        if(ret <= 0) return false;
+        done += ret;
+    }
+    return true;
+}
+
+static bool write_fully(int fd, const void* buf, size_t length, uint64_t offset){
+    for(size_t done = 0; done < length;){
+        const auto ret = pwrite(fd,static_cast<const char*>(buf) + done,length - done,static_cast<off_t>(offset + done));
+        if(ret <= 0) return false;
+        done += ret;
+    }
+    return true;
+}
+
+static uint64_t file_size(int fd){
+    struct stat sb{};
+    return fstat(fd,&sb) == 0 ? static_cast<uint64_t>(sb.st_size) : 0;
+}
+
+// The record at `offset`, if whole and intact ; `path` and `payload` are only read if asked for
+static std::optional<RecordHeader> read_record(int fd, uint64_t offset, uint64_t end, std::string* path, std::string* payload){
+    RecordHeader header{};
+    if(offset + sizeof(header) > end || !read_fully(fd,&header,sizeof(header),offset) || header.magic != RECORD_MAGIC) return std::nullopt;
+    if(offset + sizeof(header) + header.path_length + header.payload_length > end) return std::nullopt;
+    std::string p(header.path_length,'\0'), d(header.payload_length,'\0');
+    if(!read_fully(fd,p.data(),p.size(),offset + sizeof(header)) ||
+       !read_fully(fd,d.data(),d.size(),offset + sizeof(header) + p.size())) return std::nullopt;
+    if(fnv1a(d.data(),d.size(),fnv1a(p.data(),p.size())) != header.checksum) return std::nullopt;
+    if(path != nullptr) *path = std::move(p);
+    if(payload != nullptr) *payload = std::move(d);
+    return header;
+}
+
+std::optional<TraceCatalog::Key> TraceCatalog::key_of(const std::string& trace_path){
+    struct stat sb{};
+    if(stat(trace_path.c_str(),&sb) == -1) return std::nullopt;
+    return Key{trace_path,static_cast<uint64_t>(sb.st_size),static_cast<uint64_t>(sb.st_mtim.tv_sec)*1000*1000*1000 + sb.st_mtim.tv_nsec};
+}
+
+TraceCatalog::TraceCatalog(const std::string& path) : path(path),index_path(path + ".idx"){
+    fd = open(path.c_str(),O_RDWR | O_CREAT | O_CLOEXEC,0644);
+    if(fd == -1) return;
+    FileLock lock(fd,LOCK_EX);
+    CatalogHeader header{};
+    if(file_size(fd) == 0){
+        header = {.magic=CATALOG_MAGIC, .version=CATALOG_VERSION};
+        if(write_fully(fd,&header,sizeof(header),0)) return;
+    }
+    else if(read_fully(fd,&header,sizeof(header),0) && header.magic == CATALOG_MAGIC && header.version == CATALOG_VERSION) return;
+    close(fd);
+    fd = -1;
+}
+
+TraceCatalog::~TraceCatalog(){
+    if(index_fd != -1) close(index_fd);
+    if(fd != -1) close(fd);
+}
+
+bool TraceCatalog::empty(){
+    FileLock lock(fd,LOCK_SH);
+    return file_size(fd) <= sizeof(CatalogHeader);
+}
+
+std::optional<std::string> TraceCatalog::find(const Key& key, kind k){
+    FileLock lock(fd,LOCK_SH);
+    if(!index_is_current()){
+        lock.relock(LOCK_EX);
+        catch_up();
+    }
+    const auto offset = locate(key,k);
+    if(!offset) return std::nullopt;
+    std::string payload;
+    read_record(fd,*offset,file_size(fd),nullptr,&payload);
+    return payload;
+}
+
+bool TraceCatalog::insert(const Key& key, kind k, const std::string& payload, bool supersede){
+    FileLock lock(fd,LOCK_EX);
+    catch_up();
+    if(!supersede && locate(key,k)) return false;
+    const RecordHeader header{.magic=RECORD_MAGIC, .kind=k, .trace_size=key.trace_size, .trace_mtime_ns=key.trace_mtime_ns,
+                              .path_length=static_cast<uint32_t>(key.trace_path.size()), .payload_length=static_cast<uint32_t>(payload.size()),
+                              .checksum=fnv1a(payload.data(),payload.size(),fnv1a(key.trace_path.data(),key.trace_path.size()))};
+    std::string record(reinterpret_cast<const char*>(&header),sizeof(header));
+    record += key.trace_path;
+    record += payload;
+    const auto offset = file_size(fd);
+    if(!write_fully(fd,record.data(),record.size(),offset) || fdatasync(fd) == -1) return false;
+    index_insert(key,k,offset);
+    index.indexed_length = offset + record.size();
+    write_index_header();
+    return true;
+}
+
+void TraceCatalog::locked(const std::function<void()>& f){
+    FileLock lock(fd,LOCK_EX);
+    f();
+}
+
+void TraceCatalog::for_each(const std::function<void(const Key&, kind, const std::string&)>& f) const {
+    const auto end = file_size(fd);
+    Key key;
+    std::string payload;
+    for(uint64_t offset = sizeof(CatalogHeader); offset < end;){
+        const auto header = read_record(fd,offset,end,&key.trace_path,&payload);
+        if(!header) break;
+        key.trace_size = header->trace_size;
+        key.trace_mtime_ns = header->trace_mtime_ns;
+        f(key,static_cast<kind>(header->kind),payload);
+        offset += sizeof(*header) + header->path_length + header->payload_length;
+    }
+}
+
+// (Re)opens the index, as another process may have replaced it
+bool TraceCatalog::index_is_current(){
+    if(index_fd != -1) close(index_fd);
+    index_fd = open(index_path.c_str(),O_RDWR | O_CLOEXEC);
+    if(index_fd == -1) return false;
+    if(!read_fully(index_fd,&index,sizeof(index),0) || index.magic != INDEX_MAGIC || index.version != CATALOG_VERSION ||
+       index.n_buckets == 0 || (index.n_buckets & (index.n_buckets - 1)) != 0 ||
+       file_size(index_fd) != sizeof(index) + index.n_buckets*sizeof(Bucket)){
+        close(index_fd);
+        index_fd = -1;
+        return false;
+    }
+    return index.indexed_length == file_size(fd);
+}
+
+// Exclusive lock held
+void TraceCatalog::catch_up(){
+    if(index_is_current()) return;
+    if(index_fd == -1) rebuild_index(MIN_BUCKETS);
+    if(index_fd == -1) return;
+    const auto end = file_size(fd);
+    uint64_t offset = index.indexed_length;
+    Key key;
+    while(offset < end){
+        const auto header = read_record(fd,offset,end,&key.trace_path,nullptr);
+        if(!header) break;
+        key.trace_size = header->trace_size;
+        key.trace_mtime_ns = header->trace_mtime_ns;
+        index_insert(key,static_cast<kind>(header->kind),offset);
+        offset += sizeof(*header) + header->path_length + header->payload_length;
+    }
+    if(offset < end && ftruncate(fd,static_cast<off_t>(offset)) == -1) return; // torn record
+    index.indexed_length = offset;
+    write_index_header();
+}
+
+// Into a new file, renamed over the current index, with the entries of the current one if any
+void TraceCatalog::rebuild_index(uint64_t n_buckets){
+    std::vector<Bucket> buckets(n_buckets,Bucket{0,0});
+    IndexHeader header{.magic=INDEX_MAGIC, .version=CATALOG_VERSION, .n_buckets=n_buckets, .n_entries=0, .indexed_length=sizeof(CatalogHeader)};
+    if(index_fd != -1){
+        std::vector<Bucket> old(index.n_buckets);
+        if(read_fully(index_fd,old.data(),old.size()*sizeof(Bucket),sizeof(index))){
+            for(const auto& b : old){
+                if(b.hash == 0) continue;
+                auto i = b.hash & (n_buckets - 1);
+                while(buckets[i].hash != 0) i = (i + 1) & (n_buckets - 1);
+                buckets[i] = b;
+                header.n_entries++;
+            }
+            header.indexed_length = index.indexed_length;
+        }
+    }
+    const std::string tmp_path = index_path + ".tmp" + std::to_string(getpid());
+    const int tmp_fd = open(tmp_path.c_str(),O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+    if(tmp_fd == -1) return;
+    if(!write_fully(tmp_fd,&header,sizeof(header),0) || !write_fully(tmp_fd,buckets.data(),buckets.size()*sizeof(Bucket),sizeof(header)) ||
+       rename(tmp_path.c_str(),index_path.c_str()) == -1){
+        close(tmp_fd);
+        unlink(tmp_path.c_str());
+        return;
+    }
+    if(index_fd != -1) close(index_fd);
+    index_fd = tmp_fd;
+    index = header;
+}
+
+// Exclusive lock held ; inserting the same entry twice (when catching up after a crash) leaves a single one
+// A record of a key already indexed takes over its bucket
+void TraceCatalog::index_insert(const Key& key, kind k, uint64_t offset){
+    if(index_fd == -1) return;
+    if((index.n_entries + 1)*2 > index.n_buckets){
+        rebuild_index(index.n_buckets*2);
+        if(index.n_buckets == 0) return;
+    }
+    const auto hash = hash_of(key.trace_path,key.trace_size,key.trace_mtime_ns,k);
+    Bucket b{};
+    auto i = hash & (index.n_buckets - 1);
+    bool superseded = false;
+    while(read_fully(index_fd,&b,sizeof(b),sizeof(index) + i*sizeof(Bucket)) && b.hash != 0){
+        if(b.hash == hash && b.offset == offset) return;
+        if(b.hash == hash && is_record_of(b.offset,key,k)){
+            superseded = true;
+            break;
+        }
+        i = (i + 1) & (index.n_buckets - 1);
+    }
+    b = {hash,offset};
+    if(write_fully(index_fd,&b,sizeof(b),sizeof(index) + i*sizeof(Bucket)) && !superseded) index.n_entries++;
+}
+
+// Hash collisions are told apart by the records themselves
+bool TraceCatalog::is_record_of(uint64_t offset, const Key& key, kind k){
+    std::string trace_path;
+    const auto header = read_record(fd,offset,file_size(fd),&trace_path,nullptr);
+    return header && header->kind == k && header->trace_size == key.trace_size && header->trace_mtime_ns == key.trace_mtime_ns &&
+           trace_path == key.trace_path;
+}
+
+std::optional<uint64_t> TraceCatalog::locate(const Key& key, kind k){
+    if(index_fd == -1) return std::nullopt;
+    const auto hash = hash_of(key.trace_path,key.trace_size,key.trace_mtime_ns,k);
+    Bucket b{};
+    for(auto i = hash & (index.n_buckets - 1); read_fully(index_fd,&b,sizeof(b),sizeof(index) + i*sizeof(Bucket)) && b.hash != 0;
+        i = (i + 1) & (index.n_buckets - 1)){
+        if(b.hash == hash && is_record_of(b.offset,key,k)) return b.offset;
+    }
+    return std::nullopt;
+}
+
+bool TraceCatalog::write_index_header(){
+    return index_fd != -1 && write_fully(index_fd,&index,sizeof(index),0);
+}
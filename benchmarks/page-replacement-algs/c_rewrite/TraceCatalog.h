@@ -0,0 +1,71 @@
+#ifndef C_REWRITE_TRACE_CATALOG_H
+#define C_REWRITE_TRACE_CATALOG_H
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+
+// What's known about each trace (db.json's characterization, the profile), shared by every run using the same
+// `--db-file`. Records are appended to a log and never rewritten ; an open addressing hash table in `<catalog>.idx` maps
+// (trace path, size, modification time, kind) to their offset, so that finding one reads a few buckets and one record.
+// A later record for the same key supersedes the earlier ones. Every access holds a flock on the log, so concurrent
+// sweeps can share a catalog. The index is caught up with the log (or rebuilt) whenever it lags behind, e.g. after a
+// crash between the two writes ; a torn record at the end of the log is cut off then
+class TraceCatalog{
+public:
+    enum kind : uint32_t {CHARACTERIZATION = 1, PROFILE = 2};
+
+    struct Key{
+        std::string trace_path;
+        uint64_t trace_size;
+        uint64_t trace_mtime_ns;
+    };
+    // Of the trace as it is now on disk
+    static std::optional<Key> key_of(const std::string& trace_path);
+
+    explicit TraceCatalog(const std::string& path);
+    ~TraceCatalog();
+    TraceCatalog(const TraceCatalog&) = delete;
+    TraceCatalog& operator=(const TraceCatalog&) = delete;
+
+    [[nodiscard]] bool valid() const {return fd != -1;}
+    [[nodiscard]] bool empty();
+    [[nodiscard]] std::optional<std::string> find(const Key& key, kind k);
+    // False if there already was a record for it, which is kept unless `supersede`
+    bool insert(const Key& key, kind k, const std::string& payload, bool supersede = false);
+
+    // Runs `f` holding the catalog's lock, so that it sees a consistent catalog: `for_each` may only be called from there
+    void locked(const std::function<void()>& f);
+    // In the order they were appended
+    void for_each(const std::function<void(const Key&, kind, const std::string&)>& f) const;
+
+private:
+    struct IndexHeader{
+        uint64_t magic;
+        uint64_t version;
+        uint64_t n_buckets;
+        uint64_t n_entries;
+        uint64_t indexed_length; // of the log
+    };
+    struct Bucket{
+        uint64_t hash; // 0 if empty
+        uint64_t offset;
+    };
+
+    bool index_is_current();
+    void catch_up();
+    void rebuild_index(uint64_t n_buckets);
+    void index_insert(const Key& key, kind k, uint64_t offset);
+    bool is_record_of(uint64_t offset, const Key& key, kind k);
+    std::optional<uint64_t> locate(const Key& key, kind k);
+    bool write_index_header();
+
+    const std::string path;
+    const std::string index_path;
+    int fd = -1;
+    int index_fd = -1;
+    IndexHeader index{};
+};
+
+#endif //C_REWRITE_TRACE_CATALOG_H
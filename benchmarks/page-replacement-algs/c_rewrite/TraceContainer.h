@@ -0,0 +1,180 @@
+#ifndef C_REWRITE_TRACE_CONTAINER_H
+#define C_REWRITE_TRACE_CONTAINER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "TraceReader.h"
+
+// Block-compressed traces: the trace (binary or text) cut into blocks of about BLOCK_BYTES on record boundaries, each
+// deflated on its own, so that blocks can be inflated in parallel and from anywhere in the trace. The file is a header,
+// the blocks, and an index of where each one is:
+//   Header | block 0 | block 1 | ... | BlockEntry[n_blocks]
+// Made with `--pack <container>` ; read wherever a trace path is expected, the header telling it apart from raw traces
+namespace trace_container{
+    inline constexpr uint64_t MAGIC = 0x315A4B4C42435254; // "TRCBLKZ1"
+    inline constexpr uint32_t VERSION = 1;
+    inline constexpr size_t BLOCK_BYTES = size_t(4) << 20;
+
+    struct Header{
+        uint64_t magic;
+        uint32_t version;
+        uint32_t text_format;
+        uint64_t n_blocks;
+        uint64_t uncompressed_size;
+        uint64_t index_offset;
+    };
+    struct BlockEntry{
+        uint64_t offset; // in the container
+        uint32_t compressed_size;
+        uint32_t uncompressed_size;
+    };
+
+    // Where each block goes once inflated
+    class Index{
+    public:
+        // nullopt if `fd` isn't a container, or a damaged one
+        static std::optional<Index> read(int fd){
+            Index index;
+            if(pread(fd,&index.header,sizeof(Header),0) != sizeof(Header) || index.header.magic != MAGIC || index.header.version != VERSION)
+                return std::nullopt;
+            index.blocks.resize(index.header.n_blocks);
+            const auto bytes = index.blocks.size()*sizeof(BlockEntry);
+            if(pread(fd,index.blocks.data(),bytes,static_cast<off_t>(index.header.index_offset)) != static_cast<ssize_t>(bytes)) return std::nullopt;
+            index.uncompressed_offsets.reserve(index.blocks.size()+1);
+            uint64_t offset = 0;
+            for(const auto& b : index.blocks){
+                index.uncompressed_offsets.push_back(offset);
+                offset += b.uncompressed_size;
+            }
+            index.uncompressed_offsets.push_back(offset);
+            if(offset != index.header.uncompressed_size) return std::nullopt;
+            return index;
+        }
+
+        Header header{};
+        std::vector<BlockEntry> blocks;
+        std::vector<uint64_t> uncompressed_offsets; // one more than blocks: the size of the trace
+    };
+
+    inline bool inflate_block(const char* compressed, const BlockEntry& block, char* out){
+        auto length = static_cast<uLongf>(block.uncompressed_size);
+        return uncompress(reinterpret_cast<Bytef*>(out),&length,reinterpret_cast<const Bytef*>(compressed),block.compressed_size) == Z_OK &&
+               length == block.uncompressed_size;
+    }
+
+    // Calls `f(i)` for every i in [from,to), spread over `n_threads` threads (the calling one included)
+    template<typename F>
+    void parallel_for(size_t from, size_t to, size_t n_threads, F&& f){
+        std::atomic<size_t> next = from;
+        const auto work = [&](){
+            for(size_t i; (i = next.fetch_add(1)) < to;) f(i);
+        };
+        std::vector<std::jthread> threads;
+        for(size_t t = 1; t < std::min(n_threads,to - from); t++) threads.emplace_back(work);
+        work();
+    }
+
+    // Into `path`, through a temporary file renamed once complete
+    inline bool pack(const TraceReader& trace, const std::string& path, size_t n_threads, int level = Z_DEFAULT_COMPRESSION){
+        std::vector<size_t> bounds{0};
+        while(bounds.back() < trace.size()) bounds.push_back(std::max(trace.align(bounds.back() + BLOCK_BYTES),bounds.back() + 1));
+        const size_t n_blocks = bounds.size() - 1;
+
+        const std::string tmp_path = path + ".tmp" + std::to_string(getpid());
+        const int fd = open(tmp_path.c_str(),O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+        if(fd == -1) return false;
+        Header header{.magic=MAGIC, .version=VERSION, .text_format=trace.text_format(), .n_blocks=n_blocks,
+                      .uncompressed_size=trace.size(), .index_offset=0};
+        std::vector<BlockEntry> index(n_blocks);
+        uint64_t offset = sizeof(Header);
+        bool ok = true;
+        // A batch of blocks at a time, deflated in parallel and written in order
+        const size_t batch = std::max<size_t>(n_threads,1)*4;
+        std::vector<std::vector<Bytef>> compressed(batch);
+        for(size_t first = 0; first < n_blocks && ok; first += batch){
+            const auto last = std::min(first + batch,n_blocks);
+            std::atomic<bool> deflated = true;
+            parallel_for(first,last,n_threads,[&](size_t i){
+                auto& out = compressed[i - first];
+                const auto length = bounds[i+1] - bounds[i];
+                auto out_length = compressBound(length);
+                out.resize(out_length);
+                if(compress2(out.data(),&out_length,reinterpret_cast<const Bytef*>(trace.data() + bounds[i]),length,level) != Z_OK) deflated = false;
+                out.resize(out_length);
+            });
+            ok = deflated;
+            for(size_t i = first; i < last && ok; i++){
+                const auto& out = compressed[i - first];
+                index[i] = {.offset=offset, .compressed_size=static_cast<uint32_t>(out.size()),
+                            .uncompressed_size=static_cast<uint32_t>(bounds[i+1] - bounds[i])};
+                ok = pwrite(fd,out.data(),out.size(),static_cast<off_t>(offset)) == static_cast<ssize_t>(out.size());
+                offset += out.size();
+            }
+        }
+        header.index_offset = offset;
+        const auto index_bytes = index.size()*sizeof(BlockEntry);
+        ok = ok && pwrite(fd,index.data(),index_bytes,static_cast<off_t>(offset)) == static_cast<ssize_t>(index_bytes) &&
+             pwrite(fd,&header,sizeof(header),0) == sizeof(header);
+        ok = close(fd) == 0 && ok && rename(tmp_path.c_str(),path.c_str()) == 0;
+        if(!ok) unlink(tmp_path.c_str());
+        return ok;
+    }
+
+    // nullopt if `path` isn't a container
+    inline std::optional<Header> read_header(const std::string& path){
+        const int fd = ::open(path.c_str(),O_RDONLY | O_CLOEXEC);
+        if(fd == -1) return std::nullopt;
+        Header header{};
+        const bool container = pread(fd,&header,sizeof(Header),0) == sizeof(Header) && header.magic == MAGIC && header.version == VERSION;
+        close(fd);
+        if(!container) return std::nullopt;
+        return header;
+    }
+
+    // The trace at `path`: mapped as is, or inflated in parallel (into memory, all of it) if it's a container. For the
+    // latter, the format recorded in the container wins over `text_format`, and of `hints` only huge pages matter
+    inline std::unique_ptr<TraceReader> open_trace(const std::string& path, bool text_format, const MappingHints& hints = {},
+                                                   size_t n_threads = std::thread::hardware_concurrency()){
+        std::optional<Index> index;
+        if(const int fd = ::open(path.c_str(),O_RDONLY | O_CLOEXEC); fd != -1){
+            index = Index::read(fd);
+            close(fd);
+        }
+        if(!index) return std::make_unique<TraceReader>(path,text_format,hints);
+        const bool text = index->header.text_format != 0;
+        const auto size = index->header.uncompressed_size;
+        const TraceReader container(path,text);
+        if(!container.valid()) return std::make_unique<TraceReader>(nullptr,0,text);
+        if(size == 0) return std::make_unique<TraceReader>("",0,text);
+        void* mapping = mmap(nullptr,size,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+        if(mapping == MAP_FAILED) return std::make_unique<TraceReader>(nullptr,0,text);
+        if(hints.huge_pages) madvise(mapping,size,MADV_HUGEPAGE); // before it's written, for the faults to take huge pages
+        char* const out = static_cast<char*>(mapping);
+        std::atomic<bool> inflated = true;
+        parallel_for(0,index->blocks.size(),std::max<size_t>(n_threads,1),[&](size_t i){
+            const auto& b = index->blocks[i];
+            if(b.offset + b.compressed_size > container.size() ||
+               !inflate_block(container.data() + b.offset,b,out + index->uncompressed_offsets[i])) inflated = false;
+        });
+        if(!inflated){
+            std::cerr << "Corrupted compressed trace: " << path << std::endl;
+            munmap(mapping,size);
+            return std::make_unique<TraceReader>(nullptr,0,text);
+        }
+        mprotect(mapping,size,PROT_READ);
+        return std::make_unique<TraceReader>(out,size,text,true);
+    }
+}
+
+#endif //C_REWRITE_TRACE_CONTAINER_H
@@ -0,0 +1,303 @@
+#ifndef C_REWRITE_TRACE_PHASES_H
+#define C_REWRITE_TRACE_PHASES_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <random>
+#include <type_traits>
+#include <vector>
+#include "TraceReader.h"
+
+// Sherwood et al.'s SimPoint, with pages instead of basic blocks: the trace is cut into intervals of `interval_records`
+// accesses, each summarized by the frequencies of its pages (randomly projected to DIMS dimensions), and the intervals
+// are clustered with k-means, k being the smallest whose BIC gets 90% of the way to the best one. The interval closest
+// to each cluster's centroid stands for the whole cluster: only those windows are simulated, each after
+// WARMUP_INTERVALS intervals that only bring the cache to its state there, and their counts are scaled by the accesses
+// of their cluster.
+// Either way, the first `skip` accesses of the trace can be left out, the `warm` last of them only updating the policy
+// (by default all of them ; before windows, `warm` defaults to WARMUP_INTERVALS intervals)
+class TracePhases{
+public:
+    static constexpr size_t DIMS = 32;
+    static constexpr size_t TARGET_INTERVALS = 300;
+    static constexpr size_t MIN_INTERVAL_RECORDS = size_t(1) << 16;
+    static constexpr size_t MAX_K = 10;
+    static constexpr size_t WARMUP_INTERVALS = 1;
+
+    struct Window{
+        size_t warm_from; // offset in the trace
+        uint64_t warm_from_record, measure_from_record, to_record;
+        size_t interval, cluster_intervals;
+        double scale; // accesses of the cluster / of the window
+    };
+
+    // All of the trace after `skip` as a single window, counted as is
+    static TracePhases whole(const TraceReader& trace, uint64_t skip = 0, std::optional<uint64_t> warm = std::nullopt){
+        auto phases = whole(trace.records(),skip,warm);
+        auto& w = phases.windows.front();
+        w.warm_from = trace.skip(0,w.warm_from_record);
+        return phases;
+    }
+    // Likewise, of a trace of `records` records which is only read through (TraceStream): the window's offset is left at 0
+    static TracePhases whole(uint64_t records, uint64_t skip = 0, std::optional<uint64_t> warm = std::nullopt){
+        TracePhases phases;
+        skip = std::min<uint64_t>(skip,records);
+        const auto warm_from = skip - std::min(warm.value_or(skip),skip);
+        phases.n_intervals = 1;
+        phases.interval_records = records - skip;
+        phases.k = 1;
+        phases.windows.push_back({.warm_from=0, .warm_from_record=warm_from, .measure_from_record=skip,
+                                  .to_record=records, .interval=0, .cluster_intervals=1, .scale=1.});
+        return phases;
+    }
+
+    static TracePhases analyze(const TraceReader& trace, uint64_t skip = 0, std::optional<uint64_t> warm = std::nullopt){
+        TracePhases phases;
+        const auto records = trace.records();
+        skip = std::min<uint64_t>(skip,records);
+        phases.interval_records = std::max<uint64_t>((records - skip)/TARGET_INTERVALS,MIN_INTERVAL_RECORDS);
+        const auto warm_records = warm.value_or(WARMUP_INTERVALS*phases.interval_records);
+
+        std::vector<Signature> signatures;
+        std::vector<size_t> offsets;
+        std::vector<uint64_t> lengths;
+        const auto skip_offset = trace.skip(0,skip);
+        auto cursor = trace.cursor(skip_offset);
+        TraceRecord record{};
+        for(uint64_t n = 0;; n++){
+            const auto offset = cursor.offset();
+            if(!cursor.next(record)) break;
+            if(n % phases.interval_records == 0){
+                signatures.emplace_back().fill(0.);
+                offsets.push_back(offset);
+                lengths.push_back(0);
+            }
+            project(record.address >> 12,signatures.back());
+            lengths.back()++;
+        }
+        phases.n_intervals = signatures.size();
+        if(signatures.empty()) return whole(trace,skip,warm);
+        for(size_t i = 0; i < signatures.size(); i++){
+            for(auto& d : signatures[i]) d /= static_cast<double>(lengths[i]);
+        }
+
+        // Same seed on every run, so that reruns simulate the same windows
+        std::mt19937_64 rng(0x5133504F494E54);
+        std::vector<Clustering> clusterings;
+        for(size_t k = 1; k <= std::min(MAX_K,std::max<size_t>(signatures.size()-1,1)); k++){ // k = n fits perfectly
+            Clustering best{};
+            for(size_t attempt = 0; attempt < KMEANS_ATTEMPTS; attempt++){
+                auto c = kmeans(signatures,k,rng);
+                if(attempt == 0 || c.sse < best.sse) best = std::move(c);
+            }
+            best.bic = bic(best,signatures.size());
+            clusterings.push_back(std::move(best));
+        }
+        const auto [min_bic,max_bic] = std::minmax_element(clusterings.begin(),clusterings.end(),
+                                                           [](const auto& l, const auto& r){return l.bic < r.bic;});
+        const double threshold = min_bic->bic + 0.9*(max_bic->bic - min_bic->bic);
+        const auto& chosen = *std::find_if(clusterings.begin(),clusterings.end(),[threshold](const auto& c){return c.bic >= threshold;});
+        phases.k = chosen.centroids.size();
+
+        // Closest to the centroid, preferring whole intervals over the last one
+        std::vector<std::optional<size_t>> representative(phases.k);
+        std::vector<uint64_t> cluster_records(phases.k,0);
+        std::vector<size_t> cluster_intervals(phases.k,0);
+        for(size_t i = 0; i < signatures.size(); i++){
+            const auto c = chosen.assignment[i];
+            cluster_records[c] += lengths[i];
+            cluster_intervals[c]++;
+            auto& r = representative[c];
+            if(!r || (lengths[*r] < phases.interval_records && lengths[i] == phases.interval_records) ||
+               (lengths[i] == lengths[*r] && distance(signatures[i],chosen.centroids[c]) < distance(signatures[*r],chosen.centroids[c]))) r = i;
+        }
+        std::vector<size_t> order;
+        for(size_t c = 0; c < phases.k; c++) if(representative[c]) order.push_back(c);
+        std::sort(order.begin(),order.end(),[&representative](size_t l, size_t r){return *representative[l] < *representative[r];});
+        // From the closest interval start known, as lines must be counted in text traces
+        const auto offset_of = [&](uint64_t record){
+            if(record < skip) return trace.skip(0,record);
+            const auto i = (record - skip)/phases.interval_records;
+            return trace.skip(offsets[i],record - skip - i*phases.interval_records);
+        };
+        uint64_t previous_end = 0;
+        for(auto c : order){
+            const auto i = *representative[c];
+            const auto measure_from = skip + i*phases.interval_records;
+            const auto warm_from = std::max(previous_end,measure_from - std::min(measure_from,warm_records));
+            phases.windows.push_back({.warm_from=offset_of(warm_from), .warm_from_record=warm_from,
+                                      .measure_from_record=measure_from, .to_record=measure_from + lengths[i], .interval=i,
+                                      .cluster_intervals=cluster_intervals[c],
+                                      .scale=static_cast<double>(cluster_records[c])/static_cast<double>(lengths[i])});
+            previous_end = measure_from + lengths[i];
+        }
+        return phases;
+    }
+
+    [[nodiscard]] const std::vector<Window>& get_windows() const {return windows;}
+    [[nodiscard]] size_t get_n_intervals() const {return n_intervals;}
+    [[nodiscard]] uint64_t get_interval_records() const {return interval_records;}
+    [[nodiscard]] size_t get_k() const {return k;}
+    [[nodiscard]] uint64_t measured_records() const {
+        uint64_t n = 0;
+        for(const auto& w : windows) n += w.to_record - w.measure_from_record;
+        return n;
+    }
+    [[nodiscard]] uint64_t simulated_records() const {
+        uint64_t n = 0;
+        for(const auto& w : windows) n += w.to_record - w.warm_from_record;
+        return n;
+    }
+
+    // Of the whole trace, from what was counted in each window
+    template<typename T>
+    [[nodiscard]] uint64_t extrapolate(const std::vector<T>& per_window, uint64_t T::* count) const {
+        double total = 0;
+        for(size_t w = 0; w < windows.size(); w++) total += static_cast<double>(per_window[w].*count)*windows[w].scale;
+        return static_cast<uint64_t>(std::llround(total));
+    }
+
+    // Through the windows, in trace order, of a TraceReader or of a TraceStream, which can only be read through
+    template<typename Source = const TraceReader>
+    class Cursor{
+    public:
+        Cursor(const TracePhases& phases, Source& source) : phases(phases),source(source){
+            if(phases.windows.empty()) return;
+            if constexpr (!SEEKABLE) cursor.emplace(source);
+            seek();
+        }
+        bool next(TraceRecord& record){
+            if(done() || !cursor->next(record)){
+                window = phases.windows.size();
+                return false;
+            }
+            last_position = next_position++;
+            last_window = window;
+            if(next_position == phases.windows[window].to_record && ++window < phases.windows.size() &&
+               phases.windows[window].warm_from_record != next_position) seek();
+            return true;
+        }
+        [[nodiscard]] bool done() const {return window == phases.windows.size() || cursor->done();}
+        // Of the last record
+        [[nodiscard]] uint64_t position() const {return last_position;}
+        [[nodiscard]] size_t window_index() const {return last_window;}
+        [[nodiscard]] bool measured() const {return last_position >= phases.windows[last_window].measure_from_record;}
+        // Of the next record
+        [[nodiscard]] size_t offset() const {return cursor->offset();}
+    private:
+        static constexpr bool SEEKABLE = std::is_same_v<std::remove_const_t<Source>,TraceReader>;
+
+        void seek(){
+            const auto& w = phases.windows[window];
+            if constexpr (SEEKABLE){
+                cursor.emplace(source,w.warm_from);
+                next_position = w.warm_from_record;
+            }
+            else{
+                TraceRecord skipped{};
+                while(next_position < w.warm_from_record && cursor->next(skipped)) next_position++;
+            }
+        }
+
+        const TracePhases& phases;
+        Source& source;
+        std::optional<typename Source::Cursor> cursor;
+        size_t window = 0, last_window = 0;
+        uint64_t next_position = 0, last_position = 0;
+    };
+
+private:
+    typedef std::array<double,DIMS> Signature;
+    static constexpr size_t KMEANS_ATTEMPTS = 5;
+    static constexpr size_t KMEANS_ITERATIONS = 100;
+    static constexpr size_t PROJECTED_ONTO = 4; // dimensions per page
+
+    struct Clustering{
+        std::vector<Signature> centroids;
+        std::vector<size_t> assignment;
+        double sse = 0, bic = 0;
+    };
+
+    // Sparse random projection: each page counts +-1 in PROJECTED_ONTO dimensions picked by its hash
+    static void project(uint64_t page, Signature& signature){
+        uint64_t h = page * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 32;
+        h *= 0xd6e8feb86659fd93ull;
+        h ^= h >> 32;
+        for(size_t i = 0; i < PROJECTED_ONTO; i++, h >>= 6) signature[h & (DIMS-1)] += (h & DIMS) ? 1. : -1.;
+    }
+
+    static double distance(const Signature& a, const Signature& b){
+        double d = 0;
+        for(size_t i = 0; i < DIMS; i++) d += (a[i]-b[i])*(a[i]-b[i]);
+        return d;
+    }
+
+    // k-means++ seeding, then Lloyd's iterations
+    static Clustering kmeans(const std::vector<Signature>& points, size_t k, std::mt19937_64& rng){
+        Clustering c;
+        c.centroids.push_back(points[std::uniform_int_distribution<size_t>(0,points.size()-1)(rng)]);
+        std::vector<double> closest(points.size(),std::numeric_limits<double>::max());
+        while(c.centroids.size() < k){
+            for(size_t i = 0; i < points.size(); i++) closest[i] = std::min(closest[i],distance(points[i],c.centroids.back()));
+            std::discrete_distribution<size_t> pick(closest.begin(),closest.end());
+            c.centroids.push_back(points[pick(rng)]);
+        }
+        c.assignment.assign(points.size(),k);
+        for(size_t it = 0; it < KMEANS_ITERATIONS; it++){
+            bool changed = false;
+            c.sse = 0;
+            for(size_t i = 0; i < points.size(); i++){
+                size_t best = 0;
+                double best_d = distance(points[i],c.centroids[0]);
+                for(size_t j = 1; j < k; j++){
+                    const double d = distance(points[i],c.centroids[j]);
+                    if(d < best_d){
+                        best = j;
+                        best_d = d;
+                    }
+                }
+                changed |= c.assignment[i] != best;
+                c.assignment[i] = best;
+                c.sse += best_d;
+            }
+            if(!changed) break;
+            std::vector<Signature> sums(k,Signature{});
+            std::vector<size_t> sizes(k,0);
+            for(size_t i = 0; i < points.size(); i++){
+                for(size_t d = 0; d < DIMS; d++) sums[c.assignment[i]][d] += points[i][d];
+                sizes[c.assignment[i]]++;
+            }
+            for(size_t j = 0; j < k; j++){
+                if(sizes[j] == 0) continue; // keeps its centroid, which no point is closest to
+                for(size_t d = 0; d < DIMS; d++) c.centroids[j][d] = sums[j][d]/static_cast<double>(sizes[j]);
+            }
+        }
+        return c;
+    }
+
+    // Pelleg and Moore's, for spherical gaussian clusters sharing one variance
+    static double bic(const Clustering& c, size_t n){
+        const auto k = c.centroids.size();
+        const auto r = static_cast<double>(n);
+        if(n <= k) return 0;
+        const double variance = std::max(c.sse/(static_cast<double>(n-k)*DIMS),1e-12);
+        std::vector<size_t> sizes(k,0);
+        for(auto a : c.assignment) sizes[a]++;
+        double log_likelihood = -r*DIMS/2*std::log(2*M_PI*variance) - static_cast<double>(n-k)*DIMS/2;
+        for(auto s : sizes) if(s != 0) log_likelihood += static_cast<double>(s)*std::log(static_cast<double>(s)/r);
+        const double parameters = static_cast<double>(k)*(DIMS+1);
+        return log_likelihood - parameters/2*std::log(r);
+    }
+
+    size_t n_intervals = 0;
+    uint64_t interval_records = 0;
+    size_t k = 0;
+    std::vector<Window> windows;
+};
+
+#endif //C_REWRITE_TRACE_PHASES_H
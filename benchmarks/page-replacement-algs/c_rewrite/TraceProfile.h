@@ -0,0 +1,181 @@
+#ifndef C_REWRITE_TRACE_PROFILE_H
+#define C_REWRITE_TRACE_PROFILE_H
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "TraceReader.h"
+
+// What a trace looks like to a cache, from one sequential pass:
+//  - reuse (LRU stack) distances: the number of distinct pages accessed since the previous access to the same page,
+//    log2-bucketed. An LRU cache of `c` pages hits exactly the reuses of distance < c, so this is the miss ratio curve
+//  - working set size over time: distinct pages of consecutive windows of `wss_window` accesses (Denning's W(t,τ), with
+//    non-overlapping windows)
+//  - page popularity: pages bucketed by their log2 number of accesses, and the exponent of a Zipf law fitted to the
+//    rank/frequency curve
+// Long traces are sampled spatially, as in Waldspurger et al.'s SHARDS: only pages whose hash falls below 2^-shift are
+// followed (with all their accesses), and counts and distances scaled back by 2^shift
+struct TraceProfile{
+    static constexpr size_t WSS_POINTS = 256;
+    static constexpr size_t EXACT_RECORDS = size_t(1) << 24; // above, pages are sampled so as to follow about as many accesses
+
+    unsigned sampling_shift = 0;
+    uint64_t records = 0;
+    uint64_t cold_misses = 0;
+    std::vector<uint64_t> reuse_distance_log2; // [0]: distance 0, [k]: [2^(k-1),2^k)
+    uint64_t wss_window = 1;
+    std::vector<uint64_t> wss;
+    std::vector<uint64_t> popularity_log2; // [k]: pages accessed [2^k,2^(k+1)) times
+    double zipf_alpha = 0, zipf_r2 = 0;
+
+    // Miss ratio of an LRU cache of 2^k pages, for each k the histogram covers
+    [[nodiscard]] std::vector<double> lru_miss_ratio_log2() const {
+        std::vector<double> ratios;
+        if(records == 0) return ratios;
+        uint64_t hits = 0;
+        for(auto bucket : reuse_distance_log2){
+            hits += bucket;
+            ratios.push_back(1. - static_cast<double>(std::min(hits,records))/static_cast<double>(records));
+        }
+        return ratios;
+    }
+};
+
+class TraceProfiler{
+public:
+    explicit TraceProfiler(size_t expected_records){
+        profile.sampling_shift = std::min<unsigned>(std::bit_width(expected_records/TraceProfile::EXACT_RECORDS),16);
+        profile.wss_window = std::max<uint64_t>(expected_records/TraceProfile::WSS_POINTS,1);
+    }
+
+    void consume(uint64_t page){
+        const auto position = profile.records++;
+        const auto window = position/profile.wss_window;
+        if(window >= profile.wss.size()) profile.wss.resize(window+1,0);
+        if(!sampled(page)) return;
+        sampled_records++;
+
+        auto [it,inserted] = pages.try_emplace(page);
+        auto& p = it->second;
+        p.accesses++;
+        if(p.window != window){
+            p.window = window;
+            profile.wss[window]++;
+        }
+        if(next_slot == slot_page.size()) compact();
+        if(inserted) profile.cold_misses++;
+        else{
+            // Live slots after the page's last one: the distinct pages accessed since
+            const auto distance = static_cast<uint64_t>(live - prefix(p.slot)) << profile.sampling_shift;
+            const auto bucket = static_cast<size_t>(std::bit_width(distance));
+            if(bucket >= profile.reuse_distance_log2.size()) profile.reuse_distance_log2.resize(bucket+1,0);
+            profile.reuse_distance_log2[bucket]++;
+            add(p.slot,-1);
+            slot_page[p.slot] = NO_PAGE;
+            live--;
+        }
+        p.slot = next_slot++;
+        slot_page[p.slot] = page;
+        add(p.slot,1);
+        live++;
+    }
+
+    TraceProfile finish(){
+        const auto scale = uint64_t(1) << profile.sampling_shift;
+        profile.cold_misses *= scale;
+        for(auto& b : profile.reuse_distance_log2) b *= scale;
+        // SHARDS-adj: hot pages make the sampled accesses stray from 2^-shift of them, the difference is assumed to be
+        // reuses at the shortest distance
+        if(profile.reuse_distance_log2.empty()) profile.reuse_distance_log2.push_back(0);
+        const auto sampled_total = static_cast<int64_t>(sampled_records*scale);
+        profile.reuse_distance_log2[0] = static_cast<uint64_t>(std::max<int64_t>(static_cast<int64_t>(profile.reuse_distance_log2[0]) +
+                                                                                 static_cast<int64_t>(profile.records) - sampled_total,0));
+        for(auto& w : profile.wss) w *= scale;
+
+        std::vector<uint64_t> counts;
+        counts.reserve(pages.size());
+        for(const auto& [page,p] : pages) counts.push_back(p.accesses);
+        std::sort(counts.begin(),counts.end(),std::greater<>());
+        for(auto c : counts){
+            const auto bucket = static_cast<size_t>(std::bit_width(c) - 1);
+            if(bucket >= profile.popularity_log2.size()) profile.popularity_log2.resize(bucket+1,0);
+            profile.popularity_log2[bucket] += scale;
+        }
+        fit_zipf(counts);
+        return profile;
+    }
+
+private:
+    static constexpr uint64_t NO_PAGE = UINT64_MAX;
+    static constexpr size_t MIN_SLOTS = 1024;
+
+    struct PageProfile{
+        uint32_t slot = 0;
+        uint64_t accesses = 0;
+        uint64_t window = UINT64_MAX;
+    };
+
+    [[nodiscard]] bool sampled(uint64_t page) const {
+        if(profile.sampling_shift == 0) return true;
+        uint64_t h = (page >> 12) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+        return h >> (64 - profile.sampling_shift) == 0;
+    }
+
+    // Fenwick tree over slots, 1 per slot holding a page's last access
+    void add(size_t slot, int64_t delta){
+        for(size_t i = slot+1; i <= tree.size(); i += i & (~i+1)) tree[i-1] += delta;
+    }
+    [[nodiscard]] int64_t prefix(size_t slot) const { // up to `slot` included
+        int64_t sum = 0;
+        for(size_t i = slot+1; i != 0; i &= i-1) sum += tree[i-1];
+        return sum;
+    }
+
+    // Out of slots: renumbers the live ones from 0 in the same order, with as many free ones after
+    void compact(){
+        std::vector<uint64_t> compacted;
+        compacted.reserve(std::max<size_t>(2*live,MIN_SLOTS));
+        for(size_t s = 0; s < next_slot; s++){
+            if(slot_page[s] == NO_PAGE) continue;
+            pages[slot_page[s]].slot = static_cast<uint32_t>(compacted.size());
+            compacted.push_back(slot_page[s]);
+        }
+        next_slot = compacted.size();
+        compacted.resize(std::max<size_t>(2*live,MIN_SLOTS),NO_PAGE);
+        slot_page = std::move(compacted);
+        // Linear time construction: every node adds itself to its parent
+        tree.assign(slot_page.size(),0);
+        for(size_t i = 1; i <= tree.size(); i++){
+            tree[i-1] += i <= next_slot;
+            const auto parent = i + (i & (~i+1));
+            if(parent <= tree.size()) tree[parent-1] += tree[i-1];
+        }
+    }
+
+    // Least squares of log(accesses) against log(rank), on ranks spaced geometrically so the tail doesn't drown the head
+    void fit_zipf(const std::vector<uint64_t>& counts){
+        double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+        for(double r = 1; r <= static_cast<double>(counts.size()); r = std::max(r+1,std::floor(r*1.1))){
+            const double x = std::log(r), y = std::log(static_cast<double>(counts[static_cast<size_t>(r)-1]));
+            n++; sx += x; sy += y; sxx += x*x; sxy += x*y; syy += y*y;
+        }
+        const double var_x = n*sxx - sx*sx, var_y = n*syy - sy*sy;
+        if(n < 2 || var_x <= 0) return;
+        const double cov = n*sxy - sx*sy;
+        profile.zipf_alpha = -cov/var_x;
+        profile.zipf_r2 = var_y > 0 ? cov*cov/(var_x*var_y) : 1.;
+    }
+
+    TraceProfile profile;
+    std::unordered_map<uint64_t,PageProfile> pages;
+    std::vector<uint64_t> slot_page; // NO_PAGE if free, or if the page was accessed again since
+    std::vector<int64_t> tree;
+    size_t next_slot = 0, live = 0;
+    uint64_t sampled_records = 0;
+};
+
+#endif //C_REWRITE_TRACE_PROFILE_H
@@ -0,0 +1,444 @@
+#ifndef C_REWRITE_TRACE_READER_H
+#define C_REWRITE_TRACE_READER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+struct TraceRecord{
+    uint64_t address;
+    bool is_load;
+};
+
+// Text lines: a type character, an optional "0x" and at most 16 hex digits. The SIMD decoders split 64 bytes worth of
+// lines at a time on their '\n's, then decode the digits of each line at once: classify the 16 bytes following the
+// prefix as hex digits, right-align the digits with a shuffle, and merge nibble pairs with a multiply-add. With AVX2,
+// two lines are decoded per instruction, one per 128-bit lane. The scalar decoder takes care of what's too close to the
+// end of the mapping to load whole blocks, of lines longer than a block, and of non-x86 hosts
+namespace trace_text{
+    enum isa{SCALAR,SSSE3,AVX2};
+
+    inline std::string get_name(isa i){
+        switch (i) {
+            case SCALAR: return "scalar";
+            case SSSE3: return "ssse3";
+            case AVX2: return "avx2";
+        }
+        return "";
+    }
+
+    inline constexpr uint8_t NOT_HEX = 0xff;
+    inline constexpr std::array<uint8_t,256> HEX_DIGITS = [](){
+        std::array<uint8_t,256> digits{};
+        digits.fill(NOT_HEX);
+        for(uint8_t c = 0; c < 10; c++) digits['0'+c] = c;
+        for(uint8_t c = 0; c < 6; c++) digits['a'+c] = digits['A'+c] = 10+c;
+        return digits;
+    }();
+
+    // Decodes the line starting at `at` ; returns the offset of the next one, or `at` if there's none
+    inline size_t decode_line(const char* addr, size_t length, size_t at, TraceRecord& record){
+        if(at >= length) return at;
+        const char* p = addr+at;
+        const char* const end = addr+length;
+        record.is_load = *p == 'R';
+        if(*p != '\n') p++;
+        if(end - p >= 2 && p[0] == '0' && (p[1] | 0x20) == 'x') p += 2;
+        uint64_t address = 0;
+        for(uint8_t digit; p < end && (digit = HEX_DIGITS[static_cast<uint8_t>(*p)]) != NOT_HEX; p++){
+            address = address << 4 | digit;
+        }
+        record.address = address;
+        while(p < end && *p++ != '\n'){} // skips the \n, and anything left before it
+        return p-addr;
+    }
+
+    // Offset of the `n`th line after the one starting at `at`
+    inline size_t skip_lines(const char* addr, size_t length, size_t at, size_t n){
+        for(; n != 0 && at < length; n--){
+            const auto* eol = static_cast<const char*>(memchr(addr+at,'\n',length-at));
+            at = eol == nullptr ? length : eol+1-addr;
+        }
+        return at;
+    }
+
+#if defined(__x86_64__)
+#define TRACE_READER_X86 1
+    // Loads of a line's digits, and of a block, must stay within the mapping
+    inline constexpr size_t BLOCK_BYTES = 64;
+    inline constexpr size_t SIMD_MARGIN = BLOCK_BYTES + 16;
+
+    // RIGHT_ALIGN[n] moves the first n bytes to the end of the vector, zeroing the others
+    alignas(16) inline constexpr std::array<std::array<uint8_t,16>,17> RIGHT_ALIGN = [](){
+        std::array<std::array<uint8_t,16>,17> shuffles{};
+        for(size_t n = 0; n <= 16; n++){
+            for(size_t i = 0; i < 16; i++) shuffles[n][i] = i + n >= 16 ? static_cast<uint8_t>(i + n - 16) : 0x80;
+        }
+        return shuffles;
+    }();
+
+    inline const isa best_isa = [](){
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) return AVX2;
+        if(__builtin_cpu_supports("ssse3")) return SSSE3;
+        return SCALAR;
+    }();
+
+    // Where the digits of `line`, ending at `eol`, start
+    inline const char* digits_of(const char* line, const char* eol){
+        const char* digits = line + 1 + (line[1] == '0' && (line[2] | 0x20) == 'x')*2;
+        return std::min(digits,eol);
+    }
+
+    __attribute__((target("ssse3")))
+    inline uint64_t parse_hex_ssse3(const char* digits){
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(digits));
+        const auto d = _mm_sub_epi8(v,_mm_set1_epi8('0'));
+        const auto is_d = _mm_cmpeq_epi8(_mm_min_epu8(d,_mm_set1_epi8(9)),d);
+        const auto l = _mm_sub_epi8(_mm_or_si128(v,_mm_set1_epi8(0x20)),_mm_set1_epi8('a'));
+        const auto is_l = _mm_cmpeq_epi8(_mm_min_epu8(l,_mm_set1_epi8(5)),l);
+        const auto values = _mm_or_si128(_mm_and_si128(is_d,d),_mm_and_si128(is_l,_mm_add_epi8(l,_mm_set1_epi8(10))));
+        const auto n = __builtin_ctz(~static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(is_d,is_l)))); // <= 16
+        const auto aligned = _mm_shuffle_epi8(values,_mm_load_si128(reinterpret_cast<const __m128i*>(RIGHT_ALIGN[n].data())));
+        const auto pairs = _mm_maddubs_epi16(aligned,_mm_set1_epi16(0x0110)); // high digit*16 + low digit
+        return __builtin_bswap64(_mm_cvtsi128_si64(_mm_packus_epi16(pairs,pairs)));
+    }
+
+    __attribute__((target("avx2")))
+    inline void parse_hex_x2_avx2(const char* digits_a, const char* digits_b, uint64_t& a, uint64_t& b){
+        const auto v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(digits_a))),
+                                               _mm_loadu_si128(reinterpret_cast<const __m128i*>(digits_b)),1);
+        const auto d = _mm256_sub_epi8(v,_mm256_set1_epi8('0'));
+        const auto is_d = _mm256_cmpeq_epi8(_mm256_min_epu8(d,_mm256_set1_epi8(9)),d);
+        const auto l = _mm256_sub_epi8(_mm256_or_si256(v,_mm256_set1_epi8(0x20)),_mm256_set1_epi8('a'));
+        const auto is_l = _mm256_cmpeq_epi8(_mm256_min_epu8(l,_mm256_set1_epi8(5)),l);
+        const auto values = _mm256_or_si256(_mm256_and_si256(is_d,d),_mm256_and_si256(is_l,_mm256_add_epi8(l,_mm256_set1_epi8(10))));
+        const auto not_hex = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(is_d,is_l)));
+        const auto n_a = __builtin_ctz(not_hex | 0x10000), n_b = __builtin_ctz(not_hex >> 16 | 0x10000);
+        const auto shuffle = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(RIGHT_ALIGN[n_a].data()))),
+                                                     _mm_load_si128(reinterpret_cast<const __m128i*>(RIGHT_ALIGN[n_b].data())),1);
+        const auto pairs = _mm256_maddubs_epi16(_mm256_shuffle_epi8(values,shuffle),_mm256_set1_epi16(0x0110));
+        const auto packed = _mm256_packus_epi16(pairs,pairs);
+        a = __builtin_bswap64(_mm256_extract_epi64(packed,0));
+        b = __builtin_bswap64(_mm256_extract_epi64(packed,2));
+    }
+
+    __attribute__((target("ssse3")))
+    inline size_t decode_lines_ssse3(const char* addr, size_t length, size_t& at, size_t to, TraceRecord* out, size_t max){
+        size_t n = 0;
+        const auto nl = _mm_set1_epi8('\n');
+        while(n < max && at < to && at + SIMD_MARGIN <= length){
+            const char* block = addr+at;
+            uint64_t eols = 0;
+            for(size_t i = 0; i < BLOCK_BYTES/16; i++){
+                const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block+16*i));
+                eols |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v,nl)))) << 16*i;
+            }
+            if(eols == 0) break;
+            size_t start = 0;
+            while(eols != 0 && n < max && at + start < to){
+                const size_t eol = __builtin_ctzll(eols);
+                eols &= eols - 1;
+                out[n].is_load = block[start] == 'R';
+                out[n].address = parse_hex_ssse3(digits_of(block+start,block+eol));
+                n++;
+                start = eol + 1;
+            }
+            at += start;
+        }
+        return n;
+    }
+
+    __attribute__((target("avx2")))
+    inline size_t decode_lines_avx2(const char* addr, size_t length, size_t& at, size_t to, TraceRecord* out, size_t max){
+        size_t n = 0;
+        const auto nl = _mm256_set1_epi8('\n');
+        std::array<uint32_t,BLOCK_BYTES+1> starts; // of the lines of the block, and past the last one
+        while(n < max && at < to && at + SIMD_MARGIN <= length){
+            const char* block = addr+at;
+            uint64_t eols = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(block)),nl)));
+            eols |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(block+32)),nl)))) << 32;
+            if(eols == 0) break;
+            size_t lines = 0;
+            starts[0] = 0;
+            while(eols != 0 && n + lines < max && at + starts[lines] < to){
+                starts[++lines] = __builtin_ctzll(eols) + 1;
+                eols &= eols - 1;
+            }
+            size_t i = 0;
+            for(; i + 2 <= lines; i += 2){
+                const char* a = block+starts[i], *b = block+starts[i+1];
+                out[n+i].is_load = *a == 'R';
+                out[n+i+1].is_load = *b == 'R';
+                parse_hex_x2_avx2(digits_of(a,block+starts[i+1]-1),digits_of(b,block+starts[i+2]-1),out[n+i].address,out[n+i+1].address);
+            }
+            if(i < lines){
+                out[n+i].is_load = block[starts[i]] == 'R';
+                out[n+i].address = parse_hex_ssse3(digits_of(block+starts[i],block+starts[i+1]-1));
+            }
+            n += lines;
+            at += starts[lines];
+        }
+        return n;
+    }
+#else
+    inline const isa best_isa = SCALAR;
+#endif
+
+    // Decodes up to `max` lines starting in [at,to) into `out`, and moves `at` past them ; returns how many were
+    inline size_t decode_lines(const char* addr, size_t length, size_t& at, size_t to, TraceRecord* out, size_t max, isa with = best_isa){
+        size_t n = 0;
+#ifdef TRACE_READER_X86
+        if(with == AVX2) n = decode_lines_avx2(addr,length,at,to,out,max);
+        else if(with == SSSE3) n = decode_lines_ssse3(addr,length,at,to,out,max);
+#else
+        (void)with;
+#endif
+        for(; n < max && at < to; n++){
+            const auto next = decode_line(addr,length,at,out[n]);
+            if(next == at) break;
+            at = next;
+        }
+        return n;
+    }
+}
+
+// How the trace is going to be read, for the kernel to map it accordingly (`--map`)
+struct MappingHints{
+    static constexpr size_t HUGE_PAGE_BYTES = size_t(2) << 20;
+
+    bool sequential = false; // MADV_SEQUENTIAL: read ahead aggressively, and reclaim what's been read first
+    // MADV_HUGEPAGE, mapped at a huge page boundary. Taken for files only by kernels with CONFIG_READ_ONLY_THP_FOR_FS,
+    // or whose file system's page cache has large folios ; always for inflated traces (TraceContainer.h)
+    bool huge_pages = false;
+    bool populate = false; // MAP_POPULATE: read and mapped before the first access, rather than faulted in page by page
+
+    void advise(const void* addr, size_t length) const {
+        if(length == 0) return;
+        if(sequential) madvise(const_cast<void*>(addr),length,MADV_SEQUENTIAL);
+        if(huge_pages) madvise(const_cast<void*>(addr),length,MADV_HUGEPAGE);
+    }
+};
+
+// Memory traces as written by custom_perf: binary records of 9 bytes (1 byte: 0 for a load, then the little endian
+// address), or, with text traces, one "R0x7fffffffd9a8\n" line per access (W for stores).
+// Records are decoded in place from the mmapped trace, and the handler given to `for_each` is a template parameter: the
+// decoding loop is inlined into every tool using it, with no copy of the record nor indirect call
+
+class TraceReader{
+public:
+    static constexpr size_t BIN_ADDR_BYTES = 8;
+    static constexpr size_t BIN_RW_BYTES = 1;
+    static constexpr size_t BIN_RECORD_BYTES = BIN_ADDR_BYTES+BIN_RW_BYTES;
+    static constexpr size_t TEXT_RECORD_BYTES = 16; // "W0x7fffffffd9a8\n", lines can be shorter or longer
+    static constexpr size_t TEXT_BATCH = 64; // lines decoded at once
+
+    // Maps the whole trace, `valid()` is false if it couldn't be
+    TraceReader(const std::string& path, bool text_format, const MappingHints& hints = {}) : text(text_format){
+        const int fd = open(path.c_str(),O_RDONLY);
+        if(fd == -1) return;
+        struct stat sb{};
+        if(fstat(fd,&sb) == 0){
+            length = sb.st_size;
+            if(length == 0) addr = ""; // mmap refuses empty mappings
+            else{
+                void* mapping = hints.huge_pages ? map_aligned(fd,length,hints.populate) :
+                                mmap(nullptr,length,PROT_READ,MAP_PRIVATE | (hints.populate ? MAP_POPULATE : 0),fd,0);
+                if(mapping != MAP_FAILED){
+                    addr = static_cast<const char*>(mapping);
+                    owning = true;
+                    hints.advise(addr,length);
+                }
+                else length = 0;
+            }
+        }
+        close(fd); // man 2 mmap : "After the mmap() call has returned, the file descriptor, fd, can be closed immediately without invalidating the mapping."
+    }
+    // Over a trace already in memory, which must outlive the reader, unless it was mmapped and is adopted: it's then
+    // unmapped with the reader
+    TraceReader(const char* data, size_t length, bool text_format, bool adopt_mapping = false)
+        : addr(data),length(length),text(text_format),owning(adopt_mapping && length != 0){}
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+    ~TraceReader(){
+        if(owning) munmap(const_cast<char*>(addr),length);
+    }
+
+    [[nodiscard]] bool valid() const {return addr != nullptr;}
+    [[nodiscard]] const char* data() const {return addr;}
+    [[nodiscard]] size_t size() const {return length;}
+    [[nodiscard]] bool text_format() const {return text;}
+    // Exact for binary traces
+    [[nodiscard]] size_t estimated_records() const {return length/(text ? TEXT_RECORD_BYTES : BIN_RECORD_BYTES);}
+    // Exact ; counts the lines of text traces once, on first call
+    [[nodiscard]] size_t records() const {
+        if(!text) return length/BIN_RECORD_BYTES;
+        std::call_once(counted,[this](){
+            n_lines = 0;
+            for(const char* p = addr; (p = static_cast<const char*>(memchr(p,'\n',addr+length-p))) != nullptr; p++) n_lines++;
+            if(length != 0 && addr[length-1] != '\n') n_lines++;
+        });
+        return n_lines;
+    }
+
+    // End of the last complete record
+    [[nodiscard]] size_t records_end() const {return text ? length : length - length%BIN_RECORD_BYTES;}
+
+    // Offset of the first record starting at or after `offset`
+    [[nodiscard]] size_t align(size_t offset) const {
+        if(offset >= length) return length;
+        if(!text) return (offset + BIN_RECORD_BYTES - 1)/BIN_RECORD_BYTES*BIN_RECORD_BYTES;
+        if(offset == 0 || addr[offset-1] == '\n') return offset;
+        const auto* eol = static_cast<const char*>(memchr(addr+offset,'\n',length-offset));
+        return eol == nullptr ? length : eol+1-addr;
+    }
+
+    // Offset of the `n`th record after the one starting at `at` ; scans the lines of text traces
+    [[nodiscard]] size_t skip(size_t at, size_t n) const {
+        if(text) return trace_text::skip_lines(addr,length,at,n);
+        return std::min(at + n*BIN_RECORD_BYTES,records_end());
+    }
+
+    // Decodes the record starting at `at` into `record`; returns the offset of the next one, or `at` if there's no
+    // complete record left
+    [[nodiscard]] size_t decode(size_t at, TraceRecord& record) const {
+        if(!text){
+            if(at + BIN_RECORD_BYTES > length) return at;
+            record.is_load = addr[at] == 0;
+            memcpy(&record.address,addr+at+BIN_RW_BYTES,BIN_ADDR_BYTES);
+            return at + BIN_RECORD_BYTES;
+        }
+        return trace_text::decode_line(addr,length,at,record);
+    }
+
+    // Calls `f(const TraceRecord&)` on every record starting in [from,to), in order ; `from` must be a record boundary.
+    // If `f` returns a bool, false stops the iteration. Returns the offset following the last record decoded
+    template<typename F>
+    size_t for_each(F&& f, size_t from = 0, size_t to = SIZE_MAX) const {
+        to = std::min(to,length);
+        size_t at = from;
+        if(text){
+            std::array<TraceRecord,TEXT_BATCH> batch;
+            while(at < to){
+                const auto batch_start = at;
+                const auto n = trace_text::decode_lines(addr,length,at,to,batch.data(),batch.size());
+                if(n == 0) break;
+                for(size_t i = 0; i < n; i++){
+                    if(!call(f,batch[i])) return trace_text::skip_lines(addr,length,batch_start,i+1);
+                }
+            }
+            return at;
+        }
+        TraceRecord record{};
+        while(at < to){
+            const auto next = decode(at,record);
+            if(next == at) break;
+            at = next;
+            if(!call(f,record)) break;
+        }
+        return at;
+    }
+
+    // Splits the trace in `n_chunks` chunks of about the same size, cut on record boundaries, and calls
+    // `f(chunk_index, from, to)` for each from its own thread (the calling one does the last chunk) ; `f` then typically
+    // calls `for_each(..., from, to)`. Returns once all chunks are done
+    template<typename F>
+    void for_each_chunk_parallel(size_t n_chunks, F&& f) const {
+        n_chunks = std::max<size_t>(n_chunks,1);
+        std::vector<size_t> bounds(n_chunks+1);
+        for(size_t i = 0; i <= n_chunks; i++) bounds[i] = align(static_cast<size_t>(static_cast<__uint128_t>(length)*i/n_chunks));
+        std::vector<std::jthread> threads;
+        threads.reserve(n_chunks-1);
+        for(size_t i = 0; i + 1 < n_chunks; i++) threads.emplace_back([&f,&bounds,i](){f(i,bounds[i],bounds[i+1]);});
+        f(n_chunks-1,bounds[n_chunks-1],bounds[n_chunks]);
+    }
+
+    // Pull-style iteration, for consumers that interleave decoding with other work. Text lines are decoded by batches
+    class Cursor{
+    public:
+        explicit Cursor(const TraceReader& reader, size_t from = 0) : reader(reader),at(from),end(reader.records_end()){}
+        bool next(TraceRecord& record){
+            if(!reader.text){
+                const auto following = reader.decode(at,record);
+                if(following == at) return false;
+                at = following;
+                return true;
+            }
+            if(buffered == n_buffered){
+                batch_start = at;
+                buffered = 0;
+                n_buffered = trace_text::decode_lines(reader.addr,reader.length,at,end,batch.data(),batch.size());
+                if(n_buffered == 0) return false;
+            }
+            record = batch[buffered++];
+            return true;
+        }
+        // Of the next record
+        [[nodiscard]] size_t offset() const {
+            if(buffered == n_buffered) return at;
+            return trace_text::skip_lines(reader.addr,reader.length,batch_start,buffered);
+        }
+        [[nodiscard]] bool done() const {return at >= end && buffered == n_buffered;}
+    private:
+        const TraceReader& reader;
+        size_t at;
+        const size_t end;
+        std::array<TraceRecord,TEXT_BATCH> batch;
+        size_t batch_start = 0, buffered = 0, n_buffered = 0;
+    };
+    [[nodiscard]] Cursor cursor(size_t from = 0) const {return Cursor(*this,from);}
+
+private:
+    // `f` returning a bool stops the iteration with false
+    template<typename F>
+    static bool call(F& f, const TraceRecord& record){
+        if constexpr (std::is_same_v<std::invoke_result_t<F&,const TraceRecord&>,bool>) return f(record);
+        else{
+            f(record);
+            return true;
+        }
+    }
+
+    // At a huge page boundary, for the file's huge pages to line up with the mapping's: within a reservation larger by
+    // a huge page, whose ends are then given back
+    static void* map_aligned(int fd, size_t length, bool populate){
+        constexpr auto HUGE = MappingHints::HUGE_PAGE_BYTES;
+        void* reservation = mmap(nullptr,length + HUGE,PROT_NONE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,-1,0);
+        if(reservation == MAP_FAILED) return MAP_FAILED;
+        auto* const start = static_cast<char*>(reservation);
+        auto* const aligned = start + (HUGE - reinterpret_cast<uintptr_t>(start) % HUGE) % HUGE;
+        void* mapping = mmap(aligned,length,PROT_READ,MAP_PRIVATE | MAP_FIXED | (populate ? MAP_POPULATE : 0),fd,0);
+        if(mapping == MAP_FAILED){
+            munmap(reservation,length + HUGE);
+            return MAP_FAILED;
+        }
+        if(aligned != start) munmap(start,aligned - start);
+        const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        auto* const mapped_end = aligned + (length + page - 1)/page*page;
+        if(mapped_end < start + length + HUGE) munmap(mapped_end,start + length + HUGE - mapped_end);
+        return mapping;
+    }
+
+    const char* addr = nullptr;
+    size_t length = 0;
+    bool text;
+    bool owning = false;
+    mutable std::once_flag counted;
+    mutable size_t n_lines = 0;
+};
+
+#endif //C_REWRITE_TRACE_READER_H
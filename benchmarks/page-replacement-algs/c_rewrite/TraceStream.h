@@ -0,0 +1,248 @@
+#ifndef C_REWRITE_TRACE_STREAM_H
+#define C_REWRITE_TRACE_STREAM_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "TraceContainer.h"
+#include "TraceReader.h"
+
+// A trace read once, sequentially, for several consumers walking it at their own pace: a thread reads it by chunks of
+// CHUNK_BYTES into N_BUFFERS buffers, and a buffer is only read into again once every consumer is done with the chunk it
+// holds. The trace is opened with O_DIRECT when the file system allows it, so it doesn't go through (nor evict) the page
+// cache: memory stays at N_BUFFERS chunks whatever the size of the trace, which is read from storage once per sweep
+// instead of once per consumer.
+// Compressed traces (see TraceContainer.h) are read through the page cache, a chunk's worth of blocks at once, and those
+// blocks are inflated in parallel into the buffer.
+// Each consumer gets a `Cursor` (exactly `n_consumers` of them), decoding every chunk through a TraceReader view
+class TraceStream{
+public:
+    static constexpr size_t CHUNK_BYTES = size_t(64) << 20;
+    static constexpr size_t N_BUFFERS = 2;
+    static constexpr size_t ALIGNMENT = 4096; // of O_DIRECT buffers, offsets and lengths
+    static constexpr size_t MAX_CARRY = ALIGNMENT; // bytes of a record cut by the end of a chunk, kept for the next one
+
+    TraceStream(const std::string& path, bool text_format, size_t n_consumers,
+                size_t n_inflaters = std::thread::hardware_concurrency()) : text(text_format),n_consumers(n_consumers),n_inflaters(n_inflaters){
+        fd = open(path.c_str(),O_RDONLY | O_CLOEXEC);
+        if(fd == -1) return;
+        // Its index can't be read with O_DIRECT's alignment constraints
+        index = trace_container::Index::read(fd);
+        if(index){
+            direct = false;
+            text = index->header.text_format != 0;
+            posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+        }
+        else{
+            close(fd);
+            fd = open(path.c_str(),O_RDONLY | O_DIRECT | O_CLOEXEC);
+        }
+        if(fd == -1){
+            direct = false;
+            fd = open(path.c_str(),O_RDONLY | O_CLOEXEC);
+            if(fd == -1) return;
+            posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+        }
+        for(auto& slot : slots){
+            slot.buffer.reset(static_cast<char*>(std::aligned_alloc(ALIGNMENT,MAX_CARRY + CHUNK_BYTES)));
+            if(slot.buffer == nullptr){
+                close(fd);
+                fd = -1;
+                return;
+            }
+        }
+        ended = false;
+        reader = std::jthread([this](const std::stop_token& stop){read_chunks(stop);});
+    }
+    TraceStream(const TraceStream&) = delete;
+    TraceStream& operator=(const TraceStream&) = delete;
+    ~TraceStream(){
+        if(reader.joinable()){
+            reader.request_stop();
+            {
+                std::lock_guard lk(mutex);
+            }
+            released.notify_all();
+            reader.join();
+        }
+        if(fd != -1) close(fd);
+    }
+
+    [[nodiscard]] bool valid() const {return fd != -1;}
+    [[nodiscard]] bool text_format() const {return text;}
+    [[nodiscard]] bool direct_io() const {return direct;}
+    [[nodiscard]] bool compressed() const {return index.has_value();}
+
+private:
+    struct Slot{
+        std::unique_ptr<char,decltype(&std::free)> buffer{nullptr,&std::free};
+        std::optional<TraceReader> view; // of the whole records in the buffer
+        size_t first_offset = 0; // in the trace, of the view's first byte
+        size_t pending = 0; // consumers yet to be done with it
+    };
+
+public:
+    class Cursor{
+    public:
+        explicit Cursor(TraceStream& stream) : stream(stream){}
+        Cursor(const Cursor&) = delete;
+        Cursor& operator=(const Cursor&) = delete;
+        // Stops holding the stream back
+        ~Cursor(){stream.unsubscribe(sequence,slot != nullptr);}
+
+        bool next(TraceRecord& record){
+            while(slot == nullptr || !chunk_cursor->next(record)){
+                if(!stream.next_chunk(sequence,slot)){
+                    finished = true;
+                    return false;
+                }
+                chunk_cursor.emplace(*slot->view);
+            }
+            return true;
+        }
+        // Of the next record, in the trace
+        [[nodiscard]] size_t offset() const {return slot == nullptr ? 0 : slot->first_offset + chunk_cursor->offset();}
+        [[nodiscard]] bool done() const {return finished;}
+    private:
+        TraceStream& stream;
+        size_t sequence = 0; // of the next chunk
+        const Slot* slot = nullptr;
+        std::optional<TraceReader::Cursor> chunk_cursor;
+        bool finished = false;
+    };
+    [[nodiscard]] Cursor cursor(){return Cursor(*this);}
+
+private:
+    void read_chunks(const std::stop_token& stop){
+        size_t file_offset = 0, carry = 0, block = 0;
+        for(size_t sequence = 0;; sequence++){
+            auto& slot = slots[sequence % N_BUFFERS];
+            {
+                std::unique_lock lk(mutex);
+                released.wait(lk,[&](){return slot.pending == 0 || stop.stop_requested();});
+                if(stop.stop_requested()) return;
+                slot.view.reset();
+            }
+            char* const data = slot.buffer.get() + MAX_CARRY;
+            if(index){
+                const auto first = block;
+                const auto inflated = inflate_chunk(block,data);
+                {
+                    std::lock_guard lk(mutex);
+                    slot.view.emplace(data,inflated ? index->uncompressed_offsets[block] - index->uncompressed_offsets[first] : 0,text);
+                    slot.first_offset = index->uncompressed_offsets[first];
+                    slot.pending = n_consumers - n_unsubscribed;
+                    published = sequence + 1;
+                    ended = block == index->blocks.size() || !inflated || slot.pending == 0;
+                }
+                available.notify_all();
+                if(ended) return;
+                continue;
+            }
+            // The previous chunk's cut record, right before this one's bytes
+            if(carry != 0){
+                const auto& previous = slots[(sequence + N_BUFFERS - 1) % N_BUFFERS];
+                memcpy(data - carry,previous.buffer.get() + MAX_CARRY + CHUNK_BYTES - carry,carry);
+            }
+            size_t n = 0;
+            while(n < CHUNK_BYTES){
+                const auto ret = pread(fd,data + n,CHUNK_BYTES - n,static_cast<off_t>(file_offset + n));
+                if(ret <= 0) break;
+                n += ret;
+                if(direct && n % ALIGNMENT != 0) break; // end of file
+            }
+            if(!direct && n != 0) posix_fadvise(fd,static_cast<off_t>(file_offset),static_cast<off_t>(n),POSIX_FADV_DONTNEED);
+            const bool last = n < CHUNK_BYTES;
+            const char* const start = data - carry;
+            size_t whole = carry + n;
+            if(!last){
+                if(text){
+                    const auto* eol = static_cast<const char*>(memrchr(start,'\n',whole));
+                    if(eol != nullptr && static_cast<size_t>(start + whole - (eol+1)) <= MAX_CARRY) whole = eol + 1 - start;
+                }
+                else whole -= whole % TraceReader::BIN_RECORD_BYTES;
+            }
+            {
+                std::lock_guard lk(mutex);
+                slot.view.emplace(start,whole,text);
+                slot.first_offset = file_offset - carry;
+                slot.pending = n_consumers - n_unsubscribed;
+                published = sequence + 1;
+                ended = last || slot.pending == 0;
+            }
+            available.notify_all();
+            if(ended) return;
+            carry = carry + n - whole;
+            file_offset += n;
+        }
+    }
+
+    // The blocks from `block` on that fit in a chunk, which `block` is moved past ; false if the container is damaged
+    bool inflate_chunk(size_t& block, char* data){
+        const auto first = block;
+        const auto chunk_start = index->uncompressed_offsets[first];
+        while(block < index->blocks.size() && index->uncompressed_offsets[block+1] - chunk_start <= CHUNK_BYTES) block++;
+        if(block == first) return false; // a block larger than a chunk isn't made by `pack`
+        const auto& last = index->blocks[block-1];
+        const auto from = index->blocks[first].offset, to = last.offset + last.compressed_size;
+        staging.resize(to - from);
+        if(pread(fd,staging.data(),staging.size(),static_cast<off_t>(from)) != static_cast<ssize_t>(staging.size())) return false;
+        posix_fadvise(fd,static_cast<off_t>(from),static_cast<off_t>(to - from),POSIX_FADV_DONTNEED);
+        std::atomic<bool> inflated = true;
+        trace_container::parallel_for(first,block,std::max<size_t>(n_inflaters,1),[&](size_t i){
+            const auto& b = index->blocks[i];
+            if(!trace_container::inflate_block(staging.data() + (b.offset - from),b,data + (index->uncompressed_offsets[i] - chunk_start)))
+                inflated = false;
+        });
+        return inflated;
+    }
+
+    // Releases the consumer's current chunk, if any, and waits for the next one ; false once the trace is over
+    bool next_chunk(size_t& sequence, const Slot*& slot){
+        std::unique_lock lk(mutex);
+        if(slot != nullptr) release(slots[(sequence - 1) % N_BUFFERS]);
+        slot = nullptr;
+        available.wait(lk,[&](){return published > sequence || ended;});
+        if(published <= sequence) return false;
+        slot = &slots[sequence++ % N_BUFFERS];
+        return true;
+    }
+
+    // Of the chunks published but not taken yet as well
+    void unsubscribe(size_t sequence, bool holding){
+        std::lock_guard lk(mutex);
+        if(holding) release(slots[(sequence - 1) % N_BUFFERS]);
+        for(; sequence < published; sequence++) release(slots[sequence % N_BUFFERS]);
+        n_unsubscribed++;
+    }
+
+    void release(Slot& slot){
+        if(--slot.pending == 0) released.notify_all();
+    }
+
+    bool text;
+    const size_t n_consumers, n_inflaters;
+    int fd = -1;
+    bool direct = true;
+    std::optional<trace_container::Index> index;
+    std::vector<char> staging; // compressed blocks of the chunk being inflated
+    std::array<Slot,N_BUFFERS> slots;
+
+    std::mutex mutex;
+    std::condition_variable available, released;
+    size_t published = 0, n_unsubscribed = 0;
+    bool ended = true; // until reading starts, so that cursors of an invalid stream don't wait
+    std::jthread reader;
+};
+
+#endif //C_REWRITE_TRACE_STREAM_H
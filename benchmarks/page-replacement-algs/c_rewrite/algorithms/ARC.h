@@ -3,18 +3,20 @@
 
 
 #include "GenericAlgorithm.h"
+#include "GhostDirectory.h"
 #include <list>
 #include <iostream>
 
 
 class ARC : public GenericAlgorithm{
 public:
-    explicit ARC(size_t page_cache_size,untracked_eviction::type evictionType) : GenericAlgorithm(page_cache_size,evictionType){};
+    ARC(size_t page_cache_size,untracked_eviction::type evictionType,ghost_directory::type ghostsType = ghost_directory::EXACT) :
+        GenericAlgorithm(page_cache_size,evictionType),ghosts(GhostDirectory::make(ghostsType,page_cache_size)){};
     evict_return_t consume_tracked(page_t page_start) override;
-    inline bool is_tracked_page_fault(page_t page) const  override {return !page_to_data_internal.contains(page) || page_to_data_internal.at(page).in_list == B1 || page_to_data_internal.at(page).in_list == B2;};
+    inline bool is_tracked_page_fault(page_t page) const  override {return !page_to_data_internal.contains(page);};
     evict_return_t evict_from_tracked() override;
     size_t tracked_size() override{return caches[T1].size()+caches[T2].size();};
-    std::string name() override {return "ARC";};
+    std::string name() override {return ghosts->approximate() ? "ARC-bloom" : "ARC";};
     std::unique_ptr<page_cache_copy_t> get_page_cache_copy() override;
     const auto* get_cache_iterable() const {return &dcr;}
 private:
@@ -33,13 +35,15 @@ private:
         }
         return ret;
     };
-    std::array<arc_cache_t,NUM_CACHES> caches{}; // idx 0 = LRU; idx size-1 = MRU
-    std::unordered_map<page_t,ARC_page_data_internal> page_to_data_internal;
+    std::array<arc_cache_t,2> caches{}; // idx T1, T2 ; idx 0 = LRU; idx size-1 = MRU
+    huge_pages::unordered_map<page_t,ARC_page_data_internal> page_to_data_internal; // T1 and T2 only
+    std::unique_ptr<GhostDirectory> ghosts; // B1 and B2
     double p = 0.;
     page_t replace(bool inB2);
 
     dual_container_range<arc_cache_t,arc_cache_t> dcr{caches[T1],caches[T2]};
     page_t lru_to_mru(cache_list_idx from, cache_list_idx to);
+    void insert_mru(cache_list_idx to, page_t page, ARC_page_data_internal& data);
 };
 
 
@@ -4,108 +4,100 @@
 
 #include "CAR.h"
 
-evict_return_t CAR::consume_tracked(page_t page_start) {
-    auto& page_data_internal = page_to_data_internal[page_start];
-    auto in_cache = (page_data_internal.in_list == T1 || page_data_internal.in_list == T2);
+CAR::CAR(size_t page_cache_size,untracked_eviction::type evictionType,ghost_directory::type ghostsType) :
+        GenericAlgorithm(page_cache_size,evictionType),ref_bits((page_cache_size+63)/64),
+        clocks{FrameRing(page_cache_size),FrameRing(page_cache_size)},ghosts(GhostDirectory::make(ghostsType,page_cache_size)){
+    frames.reserve(page_cache_size);
+}
 
+evict_return_t CAR::consume_tracked(page_t page_start) {
     evict_return_t ret = std::nullopt;
-    if (in_cache){
-        if(!page_data_internal.referenced) {
-            page_data_internal.referenced = true;
-        }
-        ret = std::nullopt;
+    const auto it = page_to_frame.find(page_start);
+    if (it != page_to_frame.end()){
+        set_referenced(it->second);
+        return ret;
     }
-    else{
-        if(tracked_size() == max_page_cache_size){
-            ret = replace();
-            if(page_data_internal.in_list != B1 && page_data_internal.in_list != B2 ){
-                if (caches[T1].size() + caches[B1].size() == max_page_cache_size) {
-                    // Discard LRU in B1
-                    page_to_data_internal.erase(caches[B1].front());
-                    caches[B1].pop_front();
-                }
-                else if (caches[T1].size() + caches[T2].size() + caches[B1].size() + caches[B2].size() == 2 * max_page_cache_size) {
-                    // Discard LRU in B2
-                    page_to_data_internal.erase(caches[B2].front());
-                    caches[B2].pop_front();
-                }
+
+    const auto in_ghost = ghosts->take(page_start);
+    if(tracked_size() == max_page_cache_size){
+        ret = replace();
+        if(in_ghost == std::nullopt){
+            if (clocks[T1].size() + ghosts->size(B1) == max_page_cache_size) {
+                // Discard LRU in B1
+                ghosts->pop_front(B1);
+            }
+            else if (tracked_size() + ghosts->size(B1) + ghosts->size(B2) == 2 * max_page_cache_size) {
+                // Discard LRU in B2
+                ghosts->pop_front(B2);
             }
         }
-        else if(page_cache_full()){
-            ret = U->evict();
-        }
-
+    }
+    else if(page_cache_full()){
+        ret = U->evict();
+    }
 
-        if(page_data_internal.in_list != B1 && page_data_internal.in_list != B2){
-            //History Miss
-            page_data_internal.at_iterator = caches[T1].insert(caches[T1].end(),page_start);
-            page_data_internal.in_list = T1;
+    if(in_ghost == std::nullopt){
+        //History Miss
+        make_resident(page_start,T1);
+    }
+    else{
+        //History Hit, sizes as if the page was still in its ghost list
+        const auto b1_size = static_cast<double>(ghosts->size(B1) + (in_ghost == B1));
+        const auto b2_size = static_cast<double>(ghosts->size(B2) + (in_ghost == B2));
+        if(in_ghost == B1){
+            p = std::min(p + std::max(1., b2_size / b1_size), static_cast<double>(max_page_cache_size));
         }
         else{
-            //History Hit
-            if(page_data_internal.in_list == B1){
-                p = std::min(p + std::max(1., static_cast<double>(caches[B2].size()) /  static_cast<double>(caches[B1].size())), static_cast<double>(max_page_cache_size));
-            }
-            else{
-                p = std::max(p - std::max(1., static_cast<double>(caches[B1].size()) / static_cast<double>(caches[B2].size()) ), 0.);
-            }
-            caches.at(page_data_internal.in_list).erase(page_data_internal.at_iterator);
-            page_data_internal.at_iterator = caches[T2].insert(caches[T2].end(),page_start);
-            page_data_internal.in_list = T2;
+            p = std::max(p - std::max(1., b1_size / b2_size), 0.);
         }
+        make_resident(page_start,T2);
     }
     return ret;
 }
 
+void CAR::make_resident(page_t page, cache_list_idx clock) {
+    frame_t frame;
+    if(!free_frames.empty()){
+        frame = free_frames.back();
+        free_frames.pop_back();
+    }
+    else{
+        frame = static_cast<frame_t>(frames.size());
+        frames.push_back(EMPTY_FRAME);
+    }
+    frames[frame] = page;
+    clear_referenced(frame);
+    clocks[clock].push_back(frame);
+    page_to_frame[page] = frame;
+}
+
 page_t CAR::replace() {
-    bool found = false;
-    page_t ret;
-    while(!found){
-        if(caches[T1].size() >= static_cast<size_t>(std::max(1., p))){
-            // T1 is oversized
-            auto& t1_head_data = page_to_data_internal[caches[T1].front()];
-            auto& t1_head_data_internal = page_to_data_internal[caches[T1].front()];
-            auto t1_head = *t1_head_data_internal.at_iterator;
-            if(!t1_head_data.referenced){
-                t1_head_data_internal.at_iterator = caches[B1].insert(caches[B1].end(),t1_head);
-                t1_head_data.in_list = B1;
-                num_unreferenced[T1]--;
-                found = true;
-            }else{
-                t1_head_data.referenced = false;
-                t1_head_data_internal.at_iterator = caches[T2].insert(caches[T2].end(),t1_head);
-                t1_head_data.in_list = T2;
-            }
-            ret = caches[T1].front();
-            caches[T1].pop_front();
-        }else{
-            // T2 is oversized
-            auto& t2_head_data = page_to_data_internal[caches[T2].front()];
-            auto& t2_head_data_internal = page_to_data_internal[caches[T2].front()];
-            auto t2_head = *t2_head_data_internal.at_iterator;
-            if(!t2_head_data.referenced){
-                t2_head_data_internal.at_iterator = caches[B2].insert(caches[B2].end(),t2_head);
-                t2_head_data.in_list = B2;
-                num_unreferenced[T2]--;
-                found = true;
-            }else{
-                t2_head_data.referenced = false;
-                t2_head_data_internal.at_iterator = caches[T2].insert(caches[T2].end(),t2_head);
-                t2_head_data.in_list = T2;
-            }
-            ret = caches[T2].front();
-            caches[T2].pop_front();
+    while(true){
+        // T2 can only be empty here when evicting before the cache is full
+        const auto l = clocks[T1].size() >= static_cast<size_t>(std::max(1., p)) || clocks[T2].empty() ? T1 : T2;
+        auto& clock = clocks[l];
+        const auto frame = clock.front();
+        if(!referenced(frame)){
+            clock.pop_front();
+            const auto page = frames[frame];
+            frames[frame] = EMPTY_FRAME;
+            free_frames.push_back(frame);
+            page_to_frame.erase(page);
+            ghosts->push_back(l == T1 ? B1 : B2,page);
+            return page;
         }
+        clear_referenced(frame);
+        if(l == T1) clocks[T2].push_back(clock.pop_front());
+        else clock.rotate();
     }
-    return ret;
 }
 
 std::unique_ptr<page_cache_copy_t> CAR::get_page_cache_copy() {
     page_cache_copy_t concatenated_list;
-
-    concatenated_list.insert(concatenated_list.end(), caches[T1].begin(), caches[T1].end());
-    concatenated_list.insert(concatenated_list.end(), caches[T2].begin(), caches[T2].end());
-
+    concatenated_list.reserve(tracked_size());
+    for(const auto& clock : clocks){
+        for(size_t i = 0; i < clock.size(); i++) concatenated_list.push_back(frames[clock.at(i)]);
+    }
     return std::make_unique<page_cache_copy_t>(concatenated_list);
 }
 
@@ -113,15 +105,13 @@ std::unique_ptr<page_cache_copy_t> CAR::get_page_cache_copy() {
 evict_return_t CAR::evict_from_tracked() {
     if(tracked_size()==0)return std::nullopt;
     auto ret = replace();
-    if (caches[T1].size() + caches[B1].size() >= max_page_cache_size) {
+    if (clocks[T1].size() + ghosts->size(B1) >= max_page_cache_size) {
         // Discard LRU in B1
-        page_to_data_internal.erase(caches[B1].front());
-        caches[B1].pop_front();
+        ghosts->pop_front(B1);
     }
-    else if (caches[T1].size() + caches[T2].size() + caches[B1].size() + caches[B2].size() >= 2 * max_page_cache_size) {
+    else if (tracked_size() + ghosts->size(B1) + ghosts->size(B2) >= 2 * max_page_cache_size) {
         // Discard LRU in B2
-        page_to_data_internal.erase(caches[B2].front());
-        caches[B2].pop_front();
+        ghosts->pop_front(B2);
     }
     return ret;
-}
\ No newline at end of file
+}
@@ -2,27 +2,59 @@
 #define C_REWRITE_CAR_H
 
 #include "GenericAlgorithm.h"
-#include <list>
+#include "GhostDirectory.h"
 #include <iostream>
+#include <unordered_map>
 
 
 
+// Fixed-capacity FIFO of frames, front = clock hand
+class FrameRing{
+public:
+    explicit FrameRing(size_t capacity) : ring(std::max<size_t>(capacity,1)) {}
+    [[nodiscard]] size_t size() const {return count;}
+    [[nodiscard]] bool empty() const {return count == 0;}
+    [[nodiscard]] frame_t front() const {return ring[head];}
+    [[nodiscard]] frame_t at(size_t i) const {return ring[wrap(head+i)];}
+    void push_back(frame_t frame){
+        ring[wrap(head+count)] = frame;
+        count++;
+    }
+    frame_t pop_front(){
+        const auto frame = ring[head];
+        head = wrap(head+1);
+        count--;
+        return frame;
+    }
+    // Front to back: when the ring is full, only the hand moves
+    void rotate(){
+        if(count == ring.size()) head = wrap(head+1);
+        else push_back(pop_front());
+    }
+private:
+    [[nodiscard]] size_t wrap(size_t i) const {return i >= ring.size() ? i - ring.size() : i;}
+    std::vector<frame_t> ring;
+    size_t head = 0, count = 0;
+};
+
+// T1 and T2 are clocks over rings of frames (hand = front), reference bits are packed by frame: moving the hand, or a
+// page from one clock to the other, touches neither the page map nor the heap. B1 and B2 are a GhostDirectory
 class CAR : public GenericAlgorithm{
 public:
-    explicit CAR(size_t page_cache_size,untracked_eviction::type evictionType) : GenericAlgorithm(page_cache_size,evictionType){};
+    CAR(size_t page_cache_size,untracked_eviction::type evictionType,ghost_directory::type ghostsType = ghost_directory::EXACT);
     evict_return_t consume_tracked(page_t page_start) override;
-    inline bool is_tracked_page_fault(page_t page) const override {return !page_to_data_internal.contains(page) || page_to_data_internal.at(page).in_list == B1 || page_to_data_internal.at(page).in_list == B2;};
+    inline bool is_tracked_page_fault(page_t page) const override {return !page_to_frame.contains(page);};
     evict_return_t evict_from_tracked() override;
-    size_t tracked_size() override{return caches[T1].size()+caches[T2].size();};
-    std::string name() override {return "CAR";};
+    size_t tracked_size() override{return clocks[T1].size()+clocks[T2].size();};
+    std::string name() override {return ghosts->approximate() ? "CAR-bloom" : "CAR";};
     std::unique_ptr<page_cache_copy_t> get_page_cache_copy() override;
-    const auto* get_cache_iterable() const {return &dcr;}
 private:
     std::string cache_to_string(size_t num_elements) override{
         std::string ret;
         long long num_left_elements = static_cast<long>(num_elements);
         for (int i = T1; i <= T2 && num_left_elements>0; ++i) {
-            auto& relevant_cache = caches.at(i);
+            page_cache_copy_t relevant_cache;
+            for(size_t j = 0; j < clocks[i].size(); j++) relevant_cache.push_back(frames[clocks[i].at(j)]);
             if(i == T2 && num_left_elements>static_cast<long long>(relevant_cache.size())) num_left_elements = static_cast<long>(relevant_cache.size());
             ret += std::to_string(i)+": ";
             std::string cache_answ("[");
@@ -33,12 +65,19 @@ private:
         }
         return ret;
     };
-    std::array<car_cache_t,NUM_CACHES> caches{}; // idx 0 = LRU; idx size-1 = MRU ; tentative for L1, L2 (=== 0 = head, size-1 = tail)
-    std::unordered_map<page_t,CAR_page_data_internal> page_to_data_internal;
+    std::vector<page_t> frames; // EMPTY_FRAME if free
+    std::vector<frame_t> free_frames;
+    std::vector<uint64_t> ref_bits;
+    std::array<FrameRing,2> clocks; // idx T1, T2
+    huge_pages::unordered_map<page_t,frame_t> page_to_frame; // T1 and T2 only
+    std::unique_ptr<GhostDirectory> ghosts;
     double p = 0.;
-    std::array<size_t,2> num_unreferenced{};
+
+    inline bool referenced(frame_t frame) const {return ref_bits[frame/64] >> (frame%64) & 1;}
+    inline void set_referenced(frame_t frame){ref_bits[frame/64] |= 1ull << (frame%64);}
+    inline void clear_referenced(frame_t frame){ref_bits[frame/64] &= ~(1ull << (frame%64));}
+    void make_resident(page_t page, cache_list_idx clock);
     page_t replace();
-    dual_container_range<car_cache_t,car_cache_t> dcr{caches[T1],caches[T2]};
 };
 
 
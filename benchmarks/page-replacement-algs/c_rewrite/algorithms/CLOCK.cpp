@@ -4,52 +4,184 @@
 
 #include "CLOCK.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CLOCK_X86 1
+#endif
+
+CLOCK::CLOCK(size_t page_cache_size,untracked_eviction::type evictionType,uint8_t i) : GenericAlgorithm(page_cache_size,evictionType),i(i){
+    const size_t capacity = page_cache_size + max_holes();
+    frames.reserve(capacity);
+    if(i == 1) ref_bits.reserve((capacity+63)/64);
+    else counters.reserve(capacity);
+}
+
 evict_return_t CLOCK::consume_tracked(page_t page_start){
-    auto page_fault = is_tracked_page_fault(page_start);
-    auto& page_data_internal = page_to_data_internal[page_start];
+    const auto it = page_to_frame.find(page_start);
+    if(it != page_to_frame.end()){
+        set_counter(it->second);
+        return std::nullopt;
+    }
 
     evict_return_t ret = std::nullopt;
-    if(page_fault){
-        if(page_cache_full() && U->size()==0){
-            find_victim();
-            auto head_page = *head;
-            ret = head_page;
-            page_to_data_internal.erase(head_page);
-            *head = page_start;
-            advance_head();
-        }
-        else{
-            if(page_cache_full()) ret = evict(); //Guaranteed to evict from U
-            auto it = page_cache.insert(page_cache.end(),page_start);
-            if(page_cache.size() == 1) head = it;
-        }
+    frame_t frame;
+    if(page_cache_full() && U->size()==0){
+        // Reuse the victim's frame
+        frame = find_victim();
+        ret = frames[frame];
+        page_to_frame.erase(frames[frame]);
+        advance_head_past(frame);
+    }
+    else{
+        if(page_cache_full()) ret = evict(); //Guaranteed to evict from U
+        // At the end of the list, i.e. right before its first page in the hand's sweep
+        if(frames.size() - page_to_frame.size() > max_holes()) compact();
+        frame = static_cast<frame_t>(frames.size());
+        frames.push_back(EMPTY_FRAME);
+        if(i != 1) counters.push_back(0);
+        else if(frames.size() > ref_bits.size()*64) ref_bits.push_back(0);
     }
-    page_data_internal.counter = i;
+    frames[frame] = page_start;
+    page_to_frame[page_start] = frame;
+    set_counter(frame);
     return ret;
 }
 
-void CLOCK::find_victim() {
-    while(auto& counter = page_to_data_internal[*head].counter){
-        counter--;
-        advance_head();
+// Drops the holes, keeping the frames in order, the hand on the same page
+void CLOCK::compact(){
+    frame_t to = 0, new_head = 0;
+    for(frame_t from = 0; from < frames.size(); from++){
+        if(from == head) new_head = to;
+        const auto page = frames[from];
+        if(page == EMPTY_FRAME) continue;
+        frames[to] = page;
+        page_to_frame[page] = to;
+        if(i != 1) counters[to] = counters[from];
+        else if(ref_bits[from/64] >> (from%64) & 1) ref_bits[to/64] |= 1ull << (to%64);
+        else ref_bits[to/64] &= ~(1ull << (to%64));
+        to++;
+    }
+    frames.resize(to);
+    if(i != 1) counters.resize(to);
+    else{
+        ref_bits.resize((to+63)/64);
+        if(to%64) ref_bits.back() &= (1ull << (to%64)) - 1;
+    }
+    head = new_head == to ? 0 : new_head;
+}
+
+// Holes look like unreferenced frames to the scans, and are stepped over
+frame_t CLOCK::find_victim() {
+    while(true){
+        const auto frame = i == 1 ? find_victim_bits() : find_victim_counters();
+        if(frames[frame] != EMPTY_FRAME) return frame;
+        advance_head_past(frame);
+    }
+}
+
+// First clear bit from the head, clearing the set ones on the way
+frame_t CLOCK::find_victim_bits() {
+    const size_t n = frames.size();
+    size_t at = head;
+    while(true){
+        const size_t word = at/64;
+        const uint64_t from_at = ~0ull << (at%64);
+        const uint64_t in_frames = (word+1)*64 <= n ? ~0ull : (1ull << (n%64)) - 1;
+        auto& bits = ref_bits[word];
+        const uint64_t candidates = ~bits & from_at & in_frames;
+        if(candidates){
+            const auto victim = static_cast<size_t>(__builtin_ctzll(candidates));
+            bits &= ~(from_at & ((1ull << victim) - 1));
+            return static_cast<frame_t>(word*64 + victim);
+        }
+        bits &= ~from_at;
+        at = (word+1)*64;
+        if(at >= n) at = 0;
+    }
+}
+
+// Each scan_* looks for the first zero counter in [at,at+width), decrementing the ones before it. Returns its offset,
+// or width if none
+static size_t scan_scalar(uint8_t* counters, size_t width){
+    for(size_t j = 0; j < width; j++){
+        if(counters[j] == 0) return j;
+        counters[j]--;
+    }
+    return width;
+}
+
+#ifdef CLOCK_X86
+static size_t scan_sse2(uint8_t* counters){
+    const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(counters));
+    const auto zeros = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v,_mm_setzero_si128())));
+    if(zeros == 0){
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(counters),_mm_sub_epi8(v,_mm_set1_epi8(1)));
+        return 16;
+    }
+    const auto first = static_cast<size_t>(__builtin_ctz(zeros));
+    scan_scalar(counters,first);
+    return first;
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(uint8_t* counters){
+    const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counters));
+    const auto zeros = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v,_mm256_setzero_si256())));
+    if(zeros == 0){
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(counters),_mm256_sub_epi8(v,_mm256_set1_epi8(1)));
+        return 32;
+    }
+    const auto first = static_cast<size_t>(__builtin_ctz(zeros));
+    scan_scalar(counters,first);
+    return first;
+}
+
+static const bool has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+frame_t CLOCK::find_victim_counters() {
+    const size_t n = frames.size();
+    size_t at = head;
+    while(true){
+        const size_t left = n - at;
+        size_t width, found;
+#ifdef CLOCK_X86
+        if(has_avx2 && left >= 32){
+            width = 32;
+            found = scan_avx2(counters.data()+at);
+        }
+        else if(left >= 16){
+            width = 16;
+            found = scan_sse2(counters.data()+at);
+        }
+        else
+#endif
+        {
+            width = left;
+            found = scan_scalar(counters.data()+at,width);
+        }
+        if(found < width) return static_cast<frame_t>(at+found);
+        at += width;
+        if(at >= n) at = 0;
     }
 }
 
 std::unique_ptr<page_cache_copy_t> CLOCK::get_page_cache_copy() {
     page_cache_copy_t concatenated_list;
-    concatenated_list.insert(concatenated_list.end(), page_cache.begin(), page_cache.end());
+    concatenated_list.reserve(tracked_size());
+    for(auto page : frames){
+        if(page != EMPTY_FRAME) concatenated_list.push_back(page);
+    }
     return std::make_unique<page_cache_copy_t>(concatenated_list);
 }
 
 evict_return_t CLOCK::evict_from_tracked() {
-    return evict_by_removing_from_list();
-}
-
-evict_return_t CLOCK::evict_by_removing_from_list(){
-    find_victim();
-    auto head_page = *head;
-    page_to_data_internal.erase(head_page);
-    advance_head();
-    page_cache.erase(std::prev(head == page_cache.begin()? page_cache.end() : head));
-    return head_page;
+    if(tracked_size()==0) return std::nullopt;
+    const auto frame = find_victim();
+    const auto page = frames[frame];
+    page_to_frame.erase(page);
+    // Out of the list: a hole until the next compaction. Its counter is already 0
+    frames[frame] = EMPTY_FRAME;
+    advance_head_past(frame);
+    return page;
 }
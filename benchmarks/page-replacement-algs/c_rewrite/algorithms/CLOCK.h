@@ -2,39 +2,50 @@
 #define C_REWRITE_CLOCK_H
 
 #include <numeric>
+#include <unordered_map>
 #include "GenericAlgorithm.h"
 
 
 
-
+// Pages live in an array of frames which the hand sweeps, in the order of the original list: a victim found by the hand
+// is replaced in place, other pages faulted in are appended, and pages evicted otherwise leave a hole, which the hand
+// steps over, until there are enough to compact the array. With i == 1 (CLOCK), reference counters are bits packed in
+// 64-bit words, scanned a word at a time ; otherwise (GCLOCK), they're bytes, scanned 32 (AVX2) or 16 (SSE2) at a time
 class CLOCK : public GenericAlgorithm{
 public:
-    CLOCK(size_t page_cache_size,untracked_eviction::type evictionType,uint8_t i) : GenericAlgorithm(page_cache_size,evictionType),head(page_cache.begin()),i(i){};
+    CLOCK(size_t page_cache_size,untracked_eviction::type evictionType,uint8_t i);
     evict_return_t consume_tracked(page_t page_start) override;
-    inline bool is_tracked_page_fault(page_t page) const override {return !page_to_data_internal.contains(page);};
-    size_t tracked_size() override{return page_cache.size();};
+    inline bool is_tracked_page_fault(page_t page) const override {return !page_to_frame.contains(page);};
+    size_t tracked_size() override{return page_to_frame.size();};
     evict_return_t evict_from_tracked() override;
     std::string name() override {return i != 1 ? "GCLOCK" : "CLOCK";};
     std::unique_ptr<page_cache_copy_t> get_page_cache_copy() override;
-    const gclock_cache_t * get_cache_iterable() const {return &page_cache;}
 private:
     std::string cache_to_string(size_t num_elements) override{
-        if(num_elements>page_cache.size()) num_elements = page_cache.size();
+        auto copy = get_page_cache_copy();
+        if(num_elements>copy->size()) num_elements = copy->size();
         std::string ret("[");
-        ret += page_iterable_to_str(page_cache.begin(),num_elements, page_cache.end());
+        ret += page_iterable_to_str(copy->begin(),num_elements,copy->end());
         ret += ']';
         return ret;
     };
-    gclock_cache_t page_cache{}; // idx 0 = should-be LRU; idx size-1 = should-be MRU
-
-    std::unordered_map<page_t,CLOCK_page_data_internal> page_to_data_internal;
-    void find_victim();
-    gclock_cache_t::iterator head;
+    std::vector<page_t> frames; // EMPTY_FRAME for holes
+    huge_pages::unordered_map<page_t,frame_t> page_to_frame;
+    std::vector<uint64_t> ref_bits; // CLOCK
+    std::vector<uint8_t> counters; // GCLOCK
+    frame_t head = 0;
 
     uint8_t i;
-    inline void advance_head(){head = std::next(head); if(head == page_cache.end()) head = page_cache.begin();};
-
-    evict_return_t evict_by_removing_from_list();
+    inline void set_counter(frame_t frame){
+        if(i == 1) ref_bits[frame/64] |= 1ull << (frame%64);
+        else counters[frame] = i;
+    }
+    inline size_t max_holes() const {return max_page_cache_size/4 + 64;};
+    void compact();
+    frame_t find_victim();
+    frame_t find_victim_bits();
+    frame_t find_victim_counters();
+    inline void advance_head_past(frame_t frame){head = frame+1 == frames.size() ? 0 : frame+1;};
 };
 
 
@@ -0,0 +1,120 @@
+#include "CLOCKPro.h"
+
+evict_return_t CLOCKPro::consume_tracked(page_t page_start){
+    evict_return_t ret = std::nullopt;
+    const auto it = page_to_slot.find(page_start);
+    if(it != page_to_slot.end()){
+        const auto s = it->second;
+        if(pages[s].status != CP_TEST){
+            pages[s].referenced = true;
+            return ret;
+        }
+        // Re-accessed during its test period: it would have been a hit with a larger cold share
+        if(cold_target < max_page_cache_size) cold_target++;
+        remove(s);
+        n_test--;
+        if(page_cache_full()) ret = evict();
+        pages[s] = {page_start,CP_HOT,false};
+        insert(s);
+        n_hot++;
+        return ret;
+    }
+    if(page_cache_full()) ret = evict();
+    const auto s = pages.acquire({page_start,CP_COLD,false});
+    page_to_slot[page_start] = s;
+    insert(s);
+    n_cold++;
+    return ret;
+}
+
+evict_return_t CLOCKPro::evict_from_tracked(){
+    if(tracked_size()==0) return std::nullopt;
+    evict_return_t victim = std::nullopt;
+    while(victim == std::nullopt) victim = run_hand_cold();
+    return victim;
+}
+
+evict_return_t CLOCKPro::run_hand_cold(){
+    const auto s = hand_cold;
+    auto& data = pages[s];
+    evict_return_t ret = std::nullopt;
+    hand_cold = clock.next_circular(s);
+    if(data.status == CP_COLD){
+        if(data.referenced){
+            data.status = CP_HOT;
+            data.referenced = false;
+            n_cold--;
+            n_hot++;
+        }
+        else{
+            // Stays in the clock, non-resident, for its test period
+            data.status = CP_TEST;
+            n_cold--;
+            n_test++;
+            ret = data.page;
+            while(n_test > max_page_cache_size) run_hand_test();
+        }
+    }
+    while(n_hot > max_page_cache_size - cold_target) run_hand_hot();
+    return ret;
+}
+
+void CLOCKPro::run_hand_hot(){
+    if(hand_hot == hand_test) run_hand_test();
+    const auto s = hand_hot;
+    auto& data = pages[s];
+    hand_hot = clock.next_circular(s);
+    if(data.status == CP_HOT){
+        if(data.referenced){
+            data.referenced = false;
+        }
+        else{
+            data.status = CP_COLD;
+            n_hot--;
+            n_cold++;
+        }
+    }
+}
+
+void CLOCKPro::run_hand_test(){
+    const auto s = hand_test;
+    if(s == NO_SLOT) return;
+    if(pages[s].status == CP_TEST){
+        remove(s); // moves the hand
+        n_test--;
+        page_to_slot.erase(pages[s].page);
+        pages.release(s);
+        if(cold_target > 1) cold_target--;
+    }
+    else{
+        hand_test = clock.next_circular(s);
+    }
+}
+
+// Behind the hot hand: the last page all hands get to
+void CLOCKPro::insert(slot_t s){
+    if(hand_hot == NO_SLOT){
+        clock.push_back(CLOCK_LIST,s);
+        hand_hot = hand_cold = hand_test = s;
+    }
+    else{
+        clock.insert_before(hand_hot,s);
+    }
+}
+
+void CLOCKPro::remove(slot_t s){
+    const auto next = clock.size(CLOCK_LIST) > 1 ? clock.next_circular(s) : NO_SLOT;
+    for(auto* hand : {&hand_hot,&hand_cold,&hand_test}){
+        if(*hand == s) *hand = next;
+    }
+    clock.erase(s);
+}
+
+std::unique_ptr<page_cache_copy_t> CLOCKPro::get_page_cache_copy() {
+    page_cache_copy_t concatenated_list;
+    concatenated_list.reserve(tracked_size());
+    for(auto s = clock.front(CLOCK_LIST); s != NO_SLOT; s = clock.next(s)){
+        if(pages[s].status != CP_TEST) concatenated_list.push_back(pages[s].page);
+    }
+    return std::make_unique<page_cache_copy_t>(concatenated_list);
+}
@@ -0,0 +1,52 @@
+#ifndef C_REWRITE_CLOCKPRO_H
+#define C_REWRITE_CLOCKPRO_H
+
+#include "GenericAlgorithm.h"
+#include "SlotLists.h"
+#include <unordered_map>
+
+// Jiang, Chen and Zhang's CLOCK-Pro, LIRS' approximation on a clock. Hot (~LIR) and cold (~resident HIR) pages, plus
+// recently evicted cold pages still in their test period, share one clock swept by three hands: the cold hand evicts
+// unreferenced cold pages (and promotes referenced ones), the hot hand demotes unreferenced hot pages, and the test hand
+// ends test periods. A cold page re-accessed during its test period becomes hot, and grows the cold pages' target
+// share; a test period ending without one shrinks it. Follows the reference simulator's structure, except that the test
+// hand never runs the cold hand, so that making room evicts exactly one page
+class CLOCKPro : public GenericAlgorithm{
+public:
+    CLOCKPro(size_t page_cache_size,untracked_eviction::type evictionType) : GenericAlgorithm(page_cache_size,evictionType),cold_target(page_cache_size){};
+    evict_return_t consume_tracked(page_t page_start) override;
+    inline bool is_tracked_page_fault(page_t page) const override {
+        const auto it = page_to_slot.find(page);
+        return it == page_to_slot.end() || pages[it->second].status == CP_TEST;
+    };
+    evict_return_t evict_from_tracked() override;
+    size_t tracked_size() override{return n_hot + n_cold;};
+    std::string name() override {return "CLOCKPro";};
+    std::unique_ptr<page_cache_copy_t> get_page_cache_copy() override;
+private:
+    std::string cache_to_string(size_t num_elements) override{
+        auto copy = get_page_cache_copy();
+        if(num_elements>copy->size()) num_elements = copy->size();
+        std::string ret("[");
+        ret += page_iterable_to_str(copy->begin(),num_elements,copy->end());
+        ret += ']';
+        return ret;
+    };
+    evict_return_t run_hand_cold();
+    void run_hand_hot();
+    void run_hand_test();
+    void insert(slot_t s);
+    void remove(slot_t s);
+
+    static constexpr uint8_t CLOCK_LIST = 0;
+
+    size_t cold_target; // adaptive, in [1,max_page_cache_size]
+    size_t n_hot = 0, n_cold = 0, n_test = 0;
+    slot_t hand_hot = NO_SLOT, hand_cold = NO_SLOT, hand_test = NO_SLOT;
+    huge_pages::unordered_map<page_t,slot_t> page_to_slot;
+    SlotPool<CLOCK_PRO_page_data_internal> pages;
+    SlotLists<1> clock;
+};
+
+
+#endif //C_REWRITE_CLOCKPRO_H
@@ -15,6 +15,9 @@
 #include <variant>
 #include <random>
 #include <iostream>
+#include <limits>
+#include <array>
+#include "HugePageArena.h"
 
 typedef uint64_t ptr_t;
 typedef ptr_t page_t;
@@ -22,6 +25,9 @@ typedef std::optional<page_t> evict_return_t;
 
 typedef uint32_t temp_t;
 
+typedef uint32_t trace_pos_t; // index of a record in the trace
+static constexpr trace_pos_t NEVER_USED_AGAIN = std::numeric_limits<trace_pos_t>::max();
+
 static constexpr uint16_t PAGE_SIZE = 4096;
 
 enum cache_list_idx{T1=0,T2,B1,B2,NUM_CACHES};
@@ -35,11 +41,18 @@ inline static page_t page_start_from_mem_address(ptr_t x) {
 
 typedef std::list<page_t> lru_k_cache_t;
 
+static constexpr uint8_t LRU_K_MAX_K = 4;
+
 struct LRU_K_page_data_internal{
-    std::deque<uint64_t> history;
-    lru_k_cache_t::iterator at_iterator;
-    LRU_K_page_data_internal(): LRU_K_page_data_internal(2) {}
-    explicit LRU_K_page_data_internal(uint8_t K) : history(K){}
+    std::array<uint64_t,LRU_K_MAX_K> history{}; // idx 0 = most recent access ; 0 = no such access
+    size_t heap_index = 0;
+};
+
+struct LRU_K_heap_entry{
+    uint64_t kth_access; // history[K-1]: the smallest, the largest backward K-distance
+    uint64_t last_access; // ties (usually, pages seen less than K times) are broken by LRU
+    page_t page;
+    LRU_K_page_data_internal* data; // std::unordered_map's nodes are stable
 };
 
 ///~~~~
@@ -51,30 +64,76 @@ struct LRU_page_data_internal{
 
 ///~~~~
 
-typedef std::list<page_t> gclock_cache_t;
+typedef uint32_t frame_t; // index in a frame array
+static constexpr page_t EMPTY_FRAME = std::numeric_limits<page_t>::max(); // never page-aligned
 
-struct CLOCK_page_data_internal{
-    uint8_t counter = 0;
-    gclock_cache_t::iterator at_iterator;
+///~~~~
+
+typedef std::list<page_t> arc_cache_t;
+
+struct ARC_page_data_internal{
+    cache_list_idx in_list = NUM_CACHES;
+    arc_cache_t::iterator at_iterator;
 };
 
 ///~~~~
+// Policies on SlotLists (see SlotLists.h): the queue a page is in is kept by the lists themselves
 
-typedef std::list<page_t> car_cache_t;
+enum two_q_list_idx : uint8_t {A1IN=0,AM,A1OUT,NUM_TWO_Q_LISTS};
 
-struct CAR_page_data_internal {
-    uint8_t referenced = 0;
-    cache_list_idx in_list = NUM_CACHES;
-    car_cache_t::iterator at_iterator;
+struct TWO_Q_page_data_internal{
+    page_t page;
+};
+
+enum lirs_status : uint8_t {LIR=0,HIR_RESIDENT,HIR_NONRESIDENT};
+
+struct LIRS_page_data_internal{
+    page_t page;
+    lirs_status status;
+};
+
+enum clock_pro_status : uint8_t {CP_HOT=0,CP_COLD,CP_TEST};
+
+struct CLOCK_PRO_page_data_internal{
+    page_t page;
+    clock_pro_status status;
+    bool referenced;
+};
+
+enum s3_fifo_list_idx : uint8_t {S3_SMALL=0,S3_MAIN,S3_GHOST,NUM_S3_FIFO_LISTS};
+
+struct S3_FIFO_page_data_internal{
+    page_t page;
+    uint8_t freq; // saturates at 3
+};
+
+enum w_tinylfu_list_idx : uint8_t {WINDOW=0,PROBATION,PROTECTED,NUM_W_TINYLFU_LISTS};
+
+struct W_TINYLFU_page_data_internal{
+    page_t page;
+};
+
+// Kernel emulations: `accessed` is the PTE accessed bit, set by sampled accesses and cleared by reclaim
+
+enum linux_lru_list_idx : uint8_t {LINUX_INACTIVE=0,LINUX_ACTIVE,NUM_LINUX_LRU_LISTS};
+
+struct LINUX_LRU_page_data_internal{
+    page_t page;
+    bool accessed;
+};
+
+struct MGLRU_page_data_internal{
+    page_t page;
+    bool accessed;
+    uint8_t refs; // the tier
 };
 
 ///~~~~
 
-typedef std::list<page_t> arc_cache_t;
+typedef std::pair<trace_pos_t,page_t> opt_heap_entry_t; // (next use, page)
 
-struct ARC_page_data_internal{
-    cache_list_idx in_list = NUM_CACHES;
-    arc_cache_t::iterator at_iterator;
+struct OPT_page_data_internal{
+    trace_pos_t next_use = NEVER_USED_AGAIN;
 };
 
 
@@ -232,8 +291,8 @@ public:
 
     size_t size() override{return elems.size();}
 private:
-    std::unordered_map<T,RandomSetInfo> elem_info;
-    std::vector<T> elems;
+    huge_pages::unordered_map<T,RandomSetInfo> elem_info;
+    huge_pages::vector<T> elems;
     std::mt19937 rng;
 };
 
@@ -275,7 +334,7 @@ public:
         return elems.size();
     };
 private:
-    std::unordered_map<T,ListAdapterInfo<T>> elem_info;
+    huge_pages::unordered_map<T,ListAdapterInfo<T>> elem_info;
     std::list<T> elems;
 };
 
@@ -312,7 +371,7 @@ public:
             std::cerr<<"Unknown eviction type" << std::endl;
         }
     };
-    ~GenericAlgorithm(){
+    virtual ~GenericAlgorithm(){
       delete U;
     };
 
@@ -336,6 +395,9 @@ public:
         return ret;
     }
 
+    // Index in the trace of the access about to be checked/consumed, for policies which look ahead (OPT)
+    virtual void set_trace_position([[maybe_unused]] size_t position) {};
+
     [[nodiscard]] virtual inline bool is_page_fault(page_t page) { //TODO rename to `is_page_fault` after refactor
         return !U->contains(page) && is_tracked_page_fault(page);
     };
@@ -0,0 +1,353 @@
+#ifndef C_REWRITE_GHOST_DIRECTORY_H
+#define C_REWRITE_GHOST_DIRECTORY_H
+
+// ARC's and CAR's B1 and B2: FIFOs (front = LRU) of pages evicted from T1 and T2, only ever asked whether (and where)
+// they hold a page. At 8M-page caches, they are most of these policies' metadata, hence the choice of representation:
+//  - list: std::list + std::unordered_map, ~100 B per ghost ; the reference
+//  - exact: page arrays + an open addressing table, ~25 B per ghost, same answers as `list`
+//  - bloom: 32-bit fingerprint arrays + a counting Bloom filter per list, ~12 B per ghost. A page can wrongly be found
+//    in a list, at `expected_false_positive_rate`
+
+#include "GenericAlgorithm.h"
+#include <bit>
+#include <cmath>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace ghost_directory {
+    enum type : uint8_t {
+        LIST = 0, EXACT, BLOOM
+    };
+    static constexpr auto all = std::array{LIST,EXACT,BLOOM};
+    inline std::string get_prefix(type t){
+        switch (t) {
+            case LIST:
+                return "list";
+            case EXACT:
+                return "exact";
+            case BLOOM:
+                return "bloom";
+            default:
+                return "unknown";
+        }
+    }
+    inline std::optional<type> prefix_to_type(const std::string& prefix){
+        for(auto t : all){
+            if(get_prefix(t) == prefix) return t;
+        }
+        return std::nullopt;
+    }
+
+    static constexpr size_t BLOOM_COUNTERS_PER_GHOST = 16;
+    static constexpr size_t BLOOM_NUM_HASHES = 4;
+    // With n fingerprints in the FIFO of a list of `capacity`: (1-e^(-kn/m))^k, plus two pages sharing a fingerprint,
+    // n/2^32. n is the list's size plus its pages taken but not popped yet, so can reach twice the capacity: 0.24% if
+    // n = capacity, 2.4% if twice
+    inline double expected_false_positive_rate(size_t n, size_t capacity){
+        const auto m = static_cast<double>(std::bit_ceil(std::max<size_t>(capacity,1)*BLOOM_COUNTERS_PER_GHOST));
+        const auto k = static_cast<double>(BLOOM_NUM_HASHES);
+        return std::pow(1.-std::exp(-k*static_cast<double>(n)/m),k) + static_cast<double>(n)/4294967296.;
+    }
+}
+
+// Indexed by B1 and B2
+class GhostDirectory{
+public:
+    virtual ~GhostDirectory() = default;
+    virtual void push_back(cache_list_idx l, page_t page) = 0;
+    // Removes the page from whichever list holds it
+    virtual std::optional<cache_list_idx> take(page_t page) = 0;
+    // Drops the LRU page of the list, if any
+    virtual void pop_front(cache_list_idx l) = 0;
+    [[nodiscard]] size_t size(cache_list_idx l) const {return sizes[l-B1];}
+    [[nodiscard]] virtual bool approximate() const {return false;}
+    static std::unique_ptr<GhostDirectory> make(ghost_directory::type t, size_t capacity);
+protected:
+    std::array<size_t,2> sizes{};
+};
+
+class ListGhostDirectory : public GhostDirectory{
+public:
+    void push_back(cache_list_idx l, page_t page) override{
+        where[page] = {l,lists[l-B1].insert(lists[l-B1].end(),page)};
+        sizes[l-B1]++;
+    }
+    std::optional<cache_list_idx> take(page_t page) override{
+        const auto it = where.find(page);
+        if(it == where.end()) return std::nullopt;
+        const auto l = it->second.list;
+        lists[l-B1].erase(it->second.at_iterator);
+        where.erase(it);
+        sizes[l-B1]--;
+        return l;
+    }
+    void pop_front(cache_list_idx l) override{
+        auto& list = lists[l-B1];
+        if(list.empty()) return;
+        where.erase(list.front());
+        list.pop_front();
+        sizes[l-B1]--;
+    }
+private:
+    struct Where{
+        cache_list_idx list;
+        std::list<page_t>::iterator at_iterator;
+    };
+    std::array<std::list<page_t>,2> lists;
+    huge_pages::unordered_map<page_t,Where> where;
+};
+
+// FIFO of evicted pages. Taken pages leave a tombstone (EMPTY_FRAME) behind, skipped when popping ; the array is squeezed
+// once tombstones and popped entries outnumber the live ones
+class GhostRing{
+public:
+    [[nodiscard]] size_t size() const {return live;}
+    uint32_t push_back(page_t page){
+        slots.push_back(page);
+        live++;
+        return static_cast<uint32_t>(slots.size()-1);
+    }
+    void erase(uint32_t pos){
+        slots[pos] = EMPTY_FRAME;
+        live--;
+    }
+    page_t pop_front(){
+        while(slots[head] == EMPTY_FRAME) head++;
+        live--;
+        return slots[head++];
+    }
+    [[nodiscard]] bool needs_compaction() const {return slots.size() > 2*live + 64;}
+    // `moved(page,new_pos)` for every live page
+    template<typename F>
+    void compact(F&& moved){
+        size_t to = 0;
+        for(size_t from = head; from < slots.size(); from++){
+            if(slots[from] == EMPTY_FRAME) continue;
+            slots[to] = slots[from];
+            moved(slots[to],static_cast<uint32_t>(to));
+            to++;
+        }
+        slots.resize(to);
+        head = 0;
+    }
+private:
+    std::vector<page_t> slots;
+    size_t head = 0, live = 0;
+};
+
+// Page -> (list, position in its GhostRing). Linear probing with backward shift deletion, so no tombstones. A key is
+// the page with the list in bit 1 and bit 0 set, 0 = empty slot
+class GhostTable{
+public:
+    GhostTable() : keys(MIN_CAPACITY,0), positions(MIN_CAPACITY){}
+    // Slot of the page, or NOT_FOUND
+    [[nodiscard]] size_t find(page_t page) const{
+        for(size_t s = home(page);; s = (s+1) & mask()){
+            if(keys[s] == 0) return NOT_FOUND;
+            if(page_of(keys[s]) == page) return s;
+        }
+    }
+    void insert(page_t page, cache_list_idx l, uint32_t pos){
+        if((count+1)*10 > keys.size()*7) grow();
+        size_t s = home(page);
+        while(keys[s] != 0) s = (s+1) & mask();
+        keys[s] = page | static_cast<uint64_t>(l-B1) << 1 | 1;
+        positions[s] = pos;
+        count++;
+    }
+    [[nodiscard]] cache_list_idx list_at(size_t slot) const {return static_cast<cache_list_idx>(B1 + (keys[slot] >> 1 & 1));}
+    [[nodiscard]] uint32_t position_at(size_t slot) const {return positions[slot];}
+    void set_position(size_t slot, uint32_t pos) {positions[slot] = pos;}
+    void erase_at(size_t slot){
+        // Shift back the entries of the cluster which would no longer be reachable
+        size_t hole = slot;
+        for(size_t s = (slot+1) & mask(); keys[s] != 0; s = (s+1) & mask()){
+            const auto h = home(page_of(keys[s]));
+            // s's entry can fill the hole iff its home isn't cyclically within (hole,s]
+            if(((s - h) & mask()) >= ((s - hole) & mask())){
+                keys[hole] = keys[s];
+                positions[hole] = positions[s];
+                hole = s;
+            }
+        }
+        keys[hole] = 0;
+        count--;
+    }
+    static constexpr size_t NOT_FOUND = std::numeric_limits<size_t>::max();
+private:
+    static constexpr size_t MIN_CAPACITY = 64;
+    static page_t page_of(uint64_t key) {return key & ~static_cast<uint64_t>(PAGE_SIZE-1);}
+    [[nodiscard]] size_t mask() const {return keys.size()-1;}
+    [[nodiscard]] size_t home(page_t page) const {
+        return static_cast<size_t>(((page >> 12) * 0x9E3779B97F4A7C15ull) >> (64 - std::countr_zero(keys.size())));
+    }
+    void grow(){
+        auto old_keys = std::move(keys);
+        auto old_positions = std::move(positions);
+        keys.assign(old_keys.size()*2,0);
+        positions.assign(old_keys.size()*2,0);
+        for(size_t s = 0; s < old_keys.size(); s++){
+            if(old_keys[s] == 0) continue;
+            size_t to = home(page_of(old_keys[s]));
+            while(keys[to] != 0) to = (to+1) & mask();
+            keys[to] = old_keys[s];
+            positions[to] = old_positions[s];
+        }
+    }
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> positions;
+    size_t count = 0;
+};
+
+class ExactGhostDirectory : public GhostDirectory{
+public:
+    void push_back(cache_list_idx l, page_t page) override{
+        auto& ring = rings[l-B1];
+        table.insert(page,l,ring.push_back(page));
+        sizes[l-B1]++;
+        if(ring.needs_compaction()){
+            ring.compact([this](page_t moved, uint32_t pos){table.set_position(table.find(moved),pos);});
+        }
+    }
+    std::optional<cache_list_idx> take(page_t page) override{
+        const auto slot = table.find(page);
+        if(slot == GhostTable::NOT_FOUND) return std::nullopt;
+        const auto l = table.list_at(slot);
+        rings[l-B1].erase(table.position_at(slot));
+        table.erase_at(slot);
+        sizes[l-B1]--;
+        return l;
+    }
+    void pop_front(cache_list_idx l) override{
+        auto& ring = rings[l-B1];
+        if(ring.size() == 0) return;
+        table.erase_at(table.find(ring.pop_front()));
+        sizes[l-B1]--;
+    }
+private:
+    std::array<GhostRing,2> rings;
+    GhostTable table;
+};
+
+// Counting Bloom filter (4-bit counters, saturated ones stay so) per list, over 32-bit fingerprints of pages: the
+// fingerprint alone gives the counters of a page, so the FIFO need not keep more. The filter holds exactly the FIFO's
+// fingerprints: a taken page's stays in both until popped, and is then skipped ; until then, the taken fingerprint
+// masks the filter's answer, and pushing the page again revives it. A take no pop matched once all the fingerprints
+// pushed before it are popped was a false positive: it is forgotten, and the LRU fingerprint dropped in its place, so
+// that sizes move by one at a time, as ARC and CAR expect (their directory upkeep compares sizes for equality)
+class BloomGhostDirectory : public GhostDirectory{
+public:
+    explicit BloomGhostDirectory(size_t capacity){
+        const auto m = std::bit_ceil(std::max<size_t>(capacity,1)*ghost_directory::BLOOM_COUNTERS_PER_GHOST);
+        for(auto& list : lists) list.filter.counters.assign(m/2,0);
+    }
+    void push_back(cache_list_idx l, page_t page) override{
+        auto& list = lists[l-B1];
+        const auto fp = fingerprint(page);
+        // Back before its taken fingerprint was popped: that one is the page's again, if older than it should be
+        if(!list.match_taken(fp)){
+            list.filter.add(fp);
+            list.fps.push_back(fp);
+            list.pushed++;
+        }
+        sizes[l-B1]++;
+    }
+    std::optional<cache_list_idx> take(page_t page) override{
+        const auto fp = fingerprint(page);
+        for(const auto l : {B1,B2}){
+            auto& list = lists[l-B1];
+            if(sizes[l-B1] == 0 || list.taken.contains(fp) || !list.filter.maybe_contains(fp)) continue;
+            list.taken[fp]++;
+            list.pending.emplace_back(fp,list.pushed);
+            sizes[l-B1]--;
+            return l;
+        }
+        return std::nullopt;
+    }
+    void pop_front(cache_list_idx l) override{
+        if(sizes[l-B1] == 0) return;
+        sizes[l-B1]--;
+        auto& list = lists[l-B1];
+        size_t to_drop = 1;
+        while(to_drop > 0 && list.head < list.fps.size()){
+            const auto fp = list.fps[list.head++];
+            list.popped++;
+            list.filter.remove(fp);
+            if(!list.match_taken(fp)) to_drop--;
+            // Takes older than everything left were false positives
+            while(!list.pending.empty() && list.pending.front().second <= list.popped){
+                if(list.match_taken(list.pending.front().first)) to_drop++;
+                list.pending.pop_front();
+            }
+        }
+        if(list.head > 64 && list.head*2 > list.fps.size()){
+            list.fps.erase(list.fps.begin(),list.fps.begin()+static_cast<long>(list.head));
+            list.head = 0;
+        }
+    }
+    [[nodiscard]] bool approximate() const override {return true;}
+private:
+    static uint32_t fingerprint(page_t page){
+        auto x = (page >> 12) * 0xBF58476D1CE4E5B9ull;
+        return static_cast<uint32_t>((x ^ (x >> 31)) >> 32);
+    }
+    struct Filter{
+        std::vector<uint8_t> counters; // two per byte
+        template<typename F>
+        void for_each_counter(uint32_t fp, F&& f){
+            const auto m_mask = counters.size()*2 - 1;
+            const size_t step = (fp * 0x9E3779B1u >> 16) | 1;
+            for(size_t k = 0, at = fp; k < ghost_directory::BLOOM_NUM_HASHES; k++, at += step){
+                const auto c = at & m_mask;
+                f(counters[c/2],(c%2)*4);
+            }
+        }
+        void add(uint32_t fp){
+            for_each_counter(fp,[](uint8_t& byte, unsigned shift){
+                if((byte >> shift & 0xF) != 0xF) byte += 1 << shift;
+            });
+        }
+        void remove(uint32_t fp){
+            for_each_counter(fp,[](uint8_t& byte, unsigned shift){
+                const auto v = byte >> shift & 0xF;
+                if(v != 0 && v != 0xF) byte -= 1 << shift;
+            });
+        }
+        bool maybe_contains(uint32_t fp){
+            bool all = true;
+            for_each_counter(fp,[&all](uint8_t& byte, unsigned shift){all &= (byte >> shift & 0xF) != 0;});
+            return all;
+        }
+    };
+    struct List{
+        Filter filter;
+        std::vector<uint32_t> fps; // FIFO, from `head`
+        size_t head = 0;
+        uint64_t pushed = 0, popped = 0;
+        std::unordered_map<uint32_t,uint32_t> taken; // fingerprint -> takes not matched yet
+        std::deque<std::pair<uint32_t,uint64_t>> pending; // (fingerprint, `pushed` then) of these takes, oldest first
+        bool match_taken(uint32_t fp){
+            const auto it = taken.find(fp);
+            if(it == taken.end()) return false;
+            if(--it->second == 0) taken.erase(it);
+            return true;
+        }
+    };
+    std::array<List,2> lists;
+};
+
+inline std::unique_ptr<GhostDirectory> GhostDirectory::make(ghost_directory::type t, size_t capacity){
+    switch(t){
+        case ghost_directory::LIST:
+            return std::make_unique<ListGhostDirectory>();
+        case ghost_directory::BLOOM:
+            return std::make_unique<BloomGhostDirectory>(capacity);
+        case ghost_directory::EXACT:
+        default:
+            return std::make_unique<ExactGhostDirectory>();
+    }
+}
+
+#endif //C_REWRITE_GHOST_DIRECTORY_H
@@ -0,0 +1,138 @@
+#ifndef C_REWRITE_HUGE_PAGE_ARENA_H
+#define C_REWRITE_HUGE_PAGE_ARENA_H
+
+// Per-page metadata of the policies (page maps, slot pools and lists) on transparent huge pages, see `--huge-pages`.
+// With millions of pages tracked, their hash table nodes spread over as many 4K pages, and simulating a policy costs
+// about a TLB miss per lookup. Small blocks (hash table nodes) are carved out of 2M chunks and recycled through free
+// lists by size ; large ones (vectors, bucket arrays) get mappings of their own. Both are madvise'd MADV_HUGEPAGE.
+// An arena isn't synchronized: there's one per thread, and a policy must be built, run and destroyed by the same thread,
+// which is the case of every simulation (`simulate_one`)
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <sys/mman.h>
+
+namespace huge_pages{
+    inline constexpr size_t HUGE_PAGE_BYTES = size_t(2) << 20;
+    inline constexpr size_t ALIGNMENT = 16;
+    inline constexpr size_t MAX_SMALL_BYTES = size_t(64) << 10; // larger blocks get their own mapping
+
+    // Whether the policies built from then on keep their metadata in arenas ; set before starting the simulations
+    inline bool enabled = false;
+
+    inline size_t round_up(size_t bytes){return (bytes + HUGE_PAGE_BYTES - 1)/HUGE_PAGE_BYTES*HUGE_PAGE_BYTES;}
+
+    // At least `bytes`, aligned on a huge page so that it can be backed by whole ones ; nullptr if it couldn't be mapped
+    inline void* map(size_t bytes){
+        const auto length = round_up(bytes);
+        void* mapping = mmap(nullptr,length + HUGE_PAGE_BYTES,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+        if(mapping == MAP_FAILED) return nullptr;
+        auto* const start = static_cast<char*>(mapping);
+        auto* const aligned = reinterpret_cast<char*>(round_up(reinterpret_cast<uintptr_t>(start)));
+        if(aligned != start) munmap(start,aligned - start);
+        if(const auto tail = start + HUGE_PAGE_BYTES - aligned; tail != 0) munmap(aligned + length,tail);
+        madvise(aligned,length,MADV_HUGEPAGE); // THP disabled: still works, on 4K pages
+        return aligned;
+    }
+    inline void unmap(void* p, size_t bytes){munmap(p,round_up(bytes));}
+
+    class Arena{
+    public:
+        Arena() : free_lists(MAX_SMALL_BYTES/ALIGNMENT + 1,nullptr){}
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+        ~Arena(){
+            for(auto* chunk : chunks) munmap(chunk,HUGE_PAGE_BYTES);
+        }
+
+        void* allocate(size_t bytes){
+            if(bytes > MAX_SMALL_BYTES){
+                void* p = map(bytes);
+                if(p == nullptr) throw std::bad_alloc();
+                return p;
+            }
+            const auto c = size_class(bytes);
+            if(void* block = free_lists[c]; block != nullptr){
+                free_lists[c] = *static_cast<void**>(block);
+                return block;
+            }
+            const auto rounded = c*ALIGNMENT;
+            if(left < rounded){
+                auto* chunk = static_cast<char*>(map(HUGE_PAGE_BYTES));
+                if(chunk == nullptr) throw std::bad_alloc();
+                chunks.push_back(chunk);
+                bump = chunk;
+                left = HUGE_PAGE_BYTES;
+            }
+            void* p = bump;
+            bump += rounded;
+            left -= rounded;
+            return p;
+        }
+        void deallocate(void* p, size_t bytes){
+            if(bytes > MAX_SMALL_BYTES){
+                unmap(p,bytes);
+                return;
+            }
+            const auto c = size_class(bytes);
+            *static_cast<void**>(p) = free_lists[c];
+            free_lists[c] = p;
+        }
+
+        static Arena& of_this_thread(){
+            thread_local Arena arena;
+            return arena;
+        }
+
+    private:
+        static size_t size_class(size_t bytes){return (std::max(bytes,sizeof(void*)) + ALIGNMENT - 1)/ALIGNMENT;}
+
+        std::vector<char*> chunks;
+        std::vector<void*> free_lists; // by size class, linked through the blocks themselves
+        char* bump = nullptr;
+        size_t left = 0; // in the current chunk
+    };
+
+    // From the arena of the thread it was made by if `enabled` then, from the heap otherwise ; copies (and rebinds) use
+    // the same arena
+    template<typename T>
+    class Allocator{
+    public:
+        static_assert(alignof(T) <= ALIGNMENT);
+        using value_type = T;
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        Allocator() : arena(enabled ? &Arena::of_this_thread() : nullptr){}
+        template<typename U>
+        Allocator(const Allocator<U>& other) : arena(other.arena){} // NOLINT(google-explicit-constructor)
+
+        T* allocate(size_t n){
+            return static_cast<T*>(arena != nullptr ? arena->allocate(n*sizeof(T)) : ::operator new(n*sizeof(T)));
+        }
+        void deallocate(T* p, size_t n){
+            if(arena != nullptr) arena->deallocate(p,n*sizeof(T));
+            else ::operator delete(p);
+        }
+
+        template<typename U>
+        bool operator==(const Allocator<U>& other) const {return arena == other.arena;}
+
+    private:
+        template<typename U> friend class Allocator;
+        Arena* arena;
+    };
+
+    template<typename K, typename V>
+    using unordered_map = std::unordered_map<K,V,std::hash<K>,std::equal_to<K>,Allocator<std::pair<const K,V>>>;
+    template<typename T>
+    using vector = std::vector<T,Allocator<T>>;
+}
+
+#endif //C_REWRITE_HUGE_PAGE_ARENA_H
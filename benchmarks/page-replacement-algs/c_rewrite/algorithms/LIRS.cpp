@@ -0,0 +1,135 @@
+#include "LIRS.h"
+
+#include <algorithm>
+
+// As recommended by the paper
+static constexpr size_t HIR_PERCENT = 1;
+
+LIRS::LIRS(size_t page_cache_size,untracked_eviction::type evictionType) : GenericAlgorithm(page_cache_size,evictionType),
+        lir_capacity(page_cache_size - std::min(page_cache_size,std::max<size_t>(1,page_cache_size*HIR_PERCENT/100))){}
+
+evict_return_t LIRS::consume_tracked(page_t page_start){
+    evict_return_t ret = std::nullopt;
+    const auto it = page_to_slot.find(page_start);
+    if(it == page_to_slot.end()){
+        if(page_cache_full()) ret = evict();
+        const auto s = pages.acquire({page_start,HIR_RESIDENT});
+        page_to_slot[page_start] = s;
+        insert_new(s);
+        return ret;
+    }
+
+    const auto s = it->second;
+    auto& status = pages[s].status;
+    if(status == LIR){
+        const bool was_bottom = stack.front(STACK) == s;
+        stack.move_to_back(STACK,s);
+        if(was_bottom) prune();
+    }
+    else if(status == HIR_RESIDENT){
+        if(stack.contains(s)){
+            // Its inter-reference recency is lower than the bottom LIR page's recency: they swap
+            stack.move_to_back(STACK,s);
+            queues.erase(s);
+            status = LIR;
+            n_lir++;
+            if(n_lir > lir_capacity) demote_bottom_lir();
+        }
+        else{
+            stack.push_back(STACK,s);
+            queues.move_to_back(RESIDENT_HIR,s);
+        }
+    }
+    else{
+        // Resident again. Marked so that it can't be dropped while making room ; it may still lose its place in the stack
+        queues.erase(s);
+        status = HIR_RESIDENT;
+        if(page_cache_full()) ret = evict();
+        if(stack.contains(s)){
+            stack.move_to_back(STACK,s);
+            status = LIR;
+            n_lir++;
+            if(n_lir > lir_capacity) demote_bottom_lir();
+        }
+        else{
+            insert_new(s);
+        }
+    }
+    return ret;
+}
+
+void LIRS::insert_new(slot_t s){
+    stack.push_back(STACK,s);
+    if(n_lir < lir_capacity){ // Until the LIR set first fills up, every page is LIR
+        pages[s].status = LIR;
+        n_lir++;
+    }
+    else{
+        pages[s].status = HIR_RESIDENT;
+        queues.push_back(RESIDENT_HIR,s);
+    }
+}
+
+void LIRS::demote_bottom_lir(){
+    prune();
+    const auto s = stack.pop_front(STACK);
+    pages[s].status = HIR_RESIDENT;
+    n_lir--;
+    queues.push_back(RESIDENT_HIR,s);
+    prune();
+}
+
+// Restores the invariant that the bottom of the stack is a LIR page
+void LIRS::prune(){
+    while(!stack.empty(STACK) && pages[stack.front(STACK)].status != LIR){
+        const auto s = stack.pop_front(STACK);
+        if(pages[s].status == HIR_NONRESIDENT){
+            queues.erase(s);
+            forget(s);
+        }
+    }
+}
+
+evict_return_t LIRS::evict_from_tracked(){
+    if(tracked_size()==0) return std::nullopt;
+    if(!queues.empty(RESIDENT_HIR)){
+        const auto s = queues.pop_front(RESIDENT_HIR);
+        const auto page = pages[s].page;
+        if(stack.contains(s)){
+            pages[s].status = HIR_NONRESIDENT;
+            queues.push_back(NONRESIDENT_HIR,s);
+            if(queues.size(NONRESIDENT_HIR) > max_page_cache_size){
+                const auto oldest = queues.pop_front(NONRESIDENT_HIR);
+                stack.erase(oldest);
+                forget(oldest);
+                prune();
+            }
+        }
+        else{
+            forget(s);
+        }
+        return page;
+    }
+    // Only LIR pages are resident, which a full cache only allows with a very small one
+    const auto s = stack.pop_front(STACK);
+    const auto page = pages[s].page;
+    n_lir--;
+    forget(s);
+    prune();
+    return page;
+}
+
+void LIRS::forget(slot_t s){
+    page_to_slot.erase(pages[s].page);
+    pages.release(s);
+}
+
+std::unique_ptr<page_cache_copy_t> LIRS::get_page_cache_copy() {
+    page_cache_copy_t concatenated_list;
+    concatenated_list.reserve(tracked_size());
+    for(auto s = stack.front(STACK); s != NO_SLOT; s = stack.next(s)){
+        if(pages[s].status == LIR) concatenated_list.push_back(pages[s].page);
+    }
+    for(auto s = queues.front(RESIDENT_HIR); s != NO_SLOT; s = queues.next(s)) concatenated_list.push_back(pages[s].page);
+    return std::make_unique<page_cache_copy_t>(concatenated_list);
+}
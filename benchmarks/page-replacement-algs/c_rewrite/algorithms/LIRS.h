@@ -0,0 +1,50 @@
+#ifndef C_REWRITE_LIRS_H
+#define C_REWRITE_LIRS_H
+
+#include "GenericAlgorithm.h"
+#include "SlotLists.h"
+#include <unordered_map>
+
+// Jiang and Zhang's LIRS: pages are ranked by their inter-reference recency instead of their recency. Most of the cache
+// holds the LIR pages (low inter-reference recency), the rest a FIFO of resident HIR pages, the only eviction candidates.
+// The LIRS stack S holds LIR pages and recently seen HIR ones, resident or not; its bottom is always a LIR page.
+// Non-resident HIR pages are bounded to as many as the cache holds, dropped oldest first
+class LIRS : public GenericAlgorithm{
+public:
+    LIRS(size_t page_cache_size,untracked_eviction::type evictionType);
+    evict_return_t consume_tracked(page_t page_start) override;
+    inline bool is_tracked_page_fault(page_t page) const override {
+        const auto it = page_to_slot.find(page);
+        return it == page_to_slot.end() || pages[it->second].status == HIR_NONRESIDENT;
+    };
+    evict_return_t evict_from_tracked() override;
+    size_t tracked_size() override{return n_lir + queues.size(RESIDENT_HIR);};
+    std::string name() override {return "LIRS";};
+    std::unique_ptr<page_cache_copy_t> get_page_cache_copy() override;
+private:
+    std::string cache_to_string(size_t num_elements) override{
+        auto copy = get_page_cache_copy();
+        if(num_elements>copy->size()) num_elements = copy->size();
+        std::string ret("[");
+        ret += page_iterable_to_str(copy->begin(),num_elements,copy->end());
+        ret += ']';
+        return ret;
+    };
+    void prune();
+    void demote_bottom_lir();
+    void insert_new(slot_t s);
+    void forget(slot_t s);
+
+    static constexpr uint8_t STACK = 0;
+    enum queue_idx : uint8_t {RESIDENT_HIR=0,NONRESIDENT_HIR,NUM_QUEUES};
+
+    const size_t lir_capacity;
+    size_t n_lir = 0;
+    huge_pages::unordered_map<page_t,slot_t> page_to_slot;
+    SlotPool<LIRS_page_data_internal> pages;
+    SlotLists<1> stack; // front = bottom
+    SlotLists<NUM_QUEUES> queues; // front = oldest
+};
+
+
+#endif //C_REWRITE_LIRS_H
@@ -26,7 +26,7 @@ private:
         return ret;
     };
     lru_cache_t page_cache{}; // idx 0 = MRU; idx size-1 = LRU
-    std::unordered_map<page_t,LRU_page_data_internal> page_to_data_internal;
+    huge_pages::unordered_map<page_t,LRU_page_data_internal> page_to_data_internal;
     uint64_t count_stamp = 0;
 
     std::list<lru_cache_t::const_iterator> iterators = {page_cache.end()};
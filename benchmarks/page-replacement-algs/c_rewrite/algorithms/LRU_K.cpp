@@ -1,55 +1,81 @@
 #include "LRU_K.h"
 
+#include <algorithm>
+
+LRU_K::LRU_K(size_t page_cache_size,uint8_t K,untracked_eviction::type evictionType) : GenericAlgorithm(page_cache_size,evictionType),
+        K(std::clamp<uint8_t>(K,1,LRU_K_MAX_K)){
+    if(K != this->K) std::cerr << "LRU_K: K must be in [1," << +LRU_K_MAX_K << "], using " << +this->K << std::endl;
+    heap.reserve(page_cache_size);
+}
+
 evict_return_t LRU_K::consume_tracked(page_t page_start){
-    // TODO: adapt for evict_return_t
-    return std::nullopt;
-    //END TODO
-    bool changed = true;
     count_stamp+=1;
-    auto page_fault = is_tracked_page_fault(page_start); //TODO
+    auto page_fault = is_tracked_page_fault(page_start);
+
+    evict_return_t ret = std::nullopt;
+    if(page_fault && page_cache_full()){ //Full, must replace
+        ret = evict();
+    }
+
     auto& page_data_internal = page_to_data_internal[page_start];
     auto& histories = page_data_internal.history;
-    //For K!=2, if(histories.size() != K) {/*set K empty elements*/}
-    histories.pop_back();
-    histories.push_front(count_stamp);
+    std::copy_backward(histories.begin(),histories.begin()+K-1,histories.begin()+K);
+    histories[0] = count_stamp;
+    const LRU_K_heap_entry entry{histories[K-1],count_stamp,page_start,&page_data_internal};
     if(page_fault){
-        if(page_cache.size() == max_page_cache_size) { //Full, must replace
-            auto victim_page_it = std::prev(page_cache.end());
-            auto modify = latest_first_access_page == victim_page_it;
-            page_to_data_internal.erase(*victim_page_it);
-            page_cache.erase(victim_page_it);
-            if (modify) {
-                latest_first_access_page = page_cache.end();
-            }
-        }
-        page_data_internal.at_iterator = page_cache.insert(latest_first_access_page,page_start);
-        latest_first_access_page = page_data_internal.at_iterator;
+        heap.push_back(entry);
+        page_data_internal.heap_index = heap.size()-1;
+        sift_up(heap.size()-1);
     }
-    else{ //page in cache
-        //Keep the page cache sorted; page_data[K-1] must be compared to all subsequent page_data[K-1]
-        auto it = page_data_internal.at_iterator;
-        if(it != page_cache.begin()) {
-            if(it == latest_first_access_page){
-                latest_first_access_page = std::next(it);
-            }
-            auto page_before = std::prev(page_cache.erase(it));
-            //We must now find where to place the already seen page in our list, which is sorted by K-1th history
-            while (page_before != page_cache.begin() && page_to_data_internal[*page_before].history[K - 1] < histories[K - 1]) {
-                page_before = std::prev(page_before);
-            }
-            if(page_before != page_cache.begin() || /*page_before == page_cache.begin()*/ page_to_data_internal[*page_before].history[K - 1] > histories[K - 1]){
-                page_before = std::next(page_before);
-            }
-            page_data_internal.at_iterator = page_cache.insert(page_before, page_start);
-        }else{
-            changed = false;
-        }
+    else{
+        // Both keys only ever grow
+        place(page_data_internal.heap_index,entry);
+        sift_down(page_data_internal.heap_index);
+    }
+    return ret;
+}
+
+evict_return_t LRU_K::evict_from_tracked(){
+    if(heap.empty()) return std::nullopt;
+    const auto victim = heap.front().page;
+    const auto last = heap.back();
+    heap.pop_back();
+    if(!heap.empty()){
+        place(0,last);
+        sift_down(0);
+    }
+    page_to_data_internal.erase(victim);
+    return victim;
+}
+
+void LRU_K::sift_up(size_t index){
+    const auto entry = heap[index];
+    while(index > 0){
+        const size_t parent = (index-1)/2;
+        if(!evicted_before(entry,heap[parent])) break;
+        place(index,heap[parent]);
+        index = parent;
+    }
+    place(index,entry);
+}
+
+void LRU_K::sift_down(size_t index){
+    const auto entry = heap[index];
+    const size_t size = heap.size();
+    while(true){
+        size_t child = 2*index+1;
+        if(child >= size) break;
+        if(child+1 < size && evicted_before(heap[child+1],heap[child])) child++;
+        if(!evicted_before(heap[child],entry)) break;
+        place(index,heap[child]);
+        index = child;
     }
-    return changed;
+    place(index,entry);
 }
 
 std::unique_ptr<page_cache_copy_t> LRU_K::get_page_cache_copy() {
-    page_cache_copy_t concatenated_list;
-    concatenated_list.insert(concatenated_list.begin(),page_cache.begin(),page_cache.end());
-    return std::make_unique<page_cache_copy_t>(concatenated_list);
+    page_cache_copy_t pages;
+    pages.reserve(heap.size());
+    for(const auto& entry : heap) pages.push_back(entry.page);
+    return std::make_unique<page_cache_copy_t>(pages);
 }
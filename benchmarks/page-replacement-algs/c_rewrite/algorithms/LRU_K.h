@@ -2,34 +2,44 @@
 #define C_REWRITE_LRU_K_H
 
 #include "GenericAlgorithm.h"
-#include <list>
+#include <unordered_map>
 #include <optional>
 
+// O'Neil et al.'s LRU-K: evicts the page whose K-th most recent access is the oldest, pages seen less than K times
+// first. Pages are kept in an indexed min-heap on (K-th access, last access), so every access is O(log n). History is
+// only kept for resident pages (no retained information period)
 class LRU_K : public GenericAlgorithm{
 public:
-    LRU_K(size_t page_cache_size,uint8_t K,untracked_eviction::type evictionType) : GenericAlgorithm(page_cache_size,evictionType),K(K){};
+    LRU_K(size_t page_cache_size,uint8_t K,untracked_eviction::type evictionType);
     evict_return_t consume_tracked(page_t page_start) override;
     inline bool is_tracked_page_fault(page_t page) const override {return !page_to_data_internal.contains(page);};
     std::string name() override {return "LRU_"+std::to_string(K);};
     std::unique_ptr<page_cache_copy_t> get_page_cache_copy() override;
-    const lru_k_cache_t * get_cache_iterable() const {return &page_cache;}
-    evict_return_t evict_from_tracked() override {//TODO
-        return std::nullopt;}
-    size_t tracked_size() override{return page_cache.size();};
+    evict_return_t evict_from_tracked() override;
+    size_t tracked_size() override{return heap.size();};
 private:
     std::string cache_to_string(size_t num_elements) override{
-        if(num_elements>page_cache.size()) num_elements = page_cache.size();
+        auto copy = get_page_cache_copy();
+        if(num_elements>copy->size()) num_elements = copy->size();
         std::string ret("[");
-        ret += page_iterable_to_str(page_cache.begin(),num_elements,page_cache.end());
+        ret += page_iterable_to_str(copy->begin(),num_elements,copy->end());
         ret += ']';
         return ret;
     };
-    lru_k_cache_t page_cache{}; // idx 0 = MRU; idx size-1 = LRU, sorted by second history
+    static bool evicted_before(const LRU_K_heap_entry& a, const LRU_K_heap_entry& b){
+        return a.kth_access < b.kth_access || (a.kth_access == b.kth_access && a.last_access < b.last_access);
+    }
+    void place(size_t index, const LRU_K_heap_entry& entry){
+        heap[index] = entry;
+        entry.data->heap_index = index;
+    }
+    void sift_up(size_t index);
+    void sift_down(size_t index);
+
     const uint8_t K;
-    std::unordered_map<page_t,LRU_K_page_data_internal> page_to_data_internal;
+    std::vector<LRU_K_heap_entry> heap; // heap[0] = victim
+    huge_pages::unordered_map<page_t,LRU_K_page_data_internal> page_to_data_internal;
     uint64_t count_stamp = 0;
-    lru_k_cache_t::iterator latest_first_access_page = page_cache.end();
-
 };
 
 
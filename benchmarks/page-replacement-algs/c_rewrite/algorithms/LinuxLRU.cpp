@@ -0,0 +1,81 @@
+#include "LinuxLRU.h"
+
+#include <cmath>
+
+static constexpr size_t SWAP_CLUSTER_MAX = 32;
+
+// inactive_is_low()'s: sqrt(10 * GBs of memory), 1 under 1GB
+static size_t compute_inactive_ratio(size_t page_cache_size){
+    const size_t gb = (page_cache_size*PAGE_SIZE) >> 30;
+    return gb ? static_cast<size_t>(std::sqrt(10.*static_cast<double>(gb))) : 1;
+}
+
+LinuxLRU::LinuxLRU(size_t page_cache_size,untracked_eviction::type evictionType) : GenericAlgorithm(page_cache_size,evictionType),
+        inactive_ratio(compute_inactive_ratio(page_cache_size)),shadows(page_cache_size){}
+
+evict_return_t LinuxLRU::consume_tracked(page_t page_start){
+    evict_return_t ret = std::nullopt;
+    const auto it = page_to_slot.find(page_start);
+    if(it != page_to_slot.end()){
+        pages[it->second].accessed = true;
+        return ret;
+    }
+    const auto eviction = shadows.take(page_start);
+    if(page_cache_full()) ret = evict();
+    const auto s = pages.acquire({page_start,false});
+    page_to_slot[page_start] = s;
+    // workingset_refault(): it would have stayed resident had the inactive list been larger by its refault distance,
+    // which it can only be by shrinking the active one
+    if(eviction != std::nullopt && nonresident_age - *eviction <= lists.size(LINUX_ACTIVE)){
+        lists.push_back(LINUX_ACTIVE,s);
+        nonresident_age++;
+    }
+    else{
+        lists.push_back(LINUX_INACTIVE,s);
+    }
+    return ret;
+}
+
+evict_return_t LinuxLRU::evict_from_tracked(){
+    if(tracked_size()==0) return std::nullopt;
+    while(true){
+        if(lists.empty(LINUX_INACTIVE) || inactive_is_low()) shrink_active_list();
+        const auto s = lists.front(LINUX_INACTIVE);
+        auto& data = pages[s];
+        if(data.accessed){ // folio_check_references(): referenced swap-backed pages are activated
+            data.accessed = false;
+            activate(s);
+            continue;
+        }
+        const auto page = data.page;
+        lists.erase(s);
+        shadows.insert(page,nonresident_age);
+        nonresident_age++;
+        page_to_slot.erase(page);
+        pages.release(s);
+        return page;
+    }
+}
+
+void LinuxLRU::activate(slot_t s){
+    lists.move_to_back(LINUX_ACTIVE,s);
+    nonresident_age++;
+}
+
+// Anonymous active pages are deactivated whether accessed or not, losing their accessed bit
+void LinuxLRU::shrink_active_list(){
+    for(size_t i = 0; i < SWAP_CLUSTER_MAX && !lists.empty(LINUX_ACTIVE); i++){
+        const auto s = lists.pop_front(LINUX_ACTIVE);
+        pages[s].accessed = false;
+        lists.push_back(LINUX_INACTIVE,s);
+    }
+}
+
+std::unique_ptr<page_cache_copy_t> LinuxLRU::get_page_cache_copy() {
+    page_cache_copy_t concatenated_list;
+    concatenated_list.reserve(tracked_size());
+    for(auto l : {LINUX_INACTIVE,LINUX_ACTIVE}){
+        for(auto s = lists.front(l); s != NO_SLOT; s = lists.next(s)) concatenated_list.push_back(pages[s].page);
+    }
+    return std::make_unique<page_cache_copy_t>(concatenated_list);
+}
@@ -0,0 +1,45 @@
+#ifndef C_REWRITE_LINUX_LRU_H
+#define C_REWRITE_LINUX_LRU_H
+
+#include "GenericAlgorithm.h"
+#include "SlotLists.h"
+#include "ShadowTable.h"
+#include <unordered_map>
+
+// The kernel's two-list LRU (mm/vmscan.c, without MGLRU) for anonymous pages, with workingset refault detection
+// (mm/workingset.c). Accesses only set the page's accessed bit, as a PTE's: faults are the only accesses which move
+// pages. Faulted pages start inactive, unless they were evicted less than |active| evictions + activations ago (their
+// refault distance). Reclaim takes inactive pages from the tail, activating those accessed since, and deactivates
+// active ones (clearing their bit) whenever the inactive list is too small for the active one (inactive_is_low)
+class LinuxLRU : public GenericAlgorithm{
+public:
+    LinuxLRU(size_t page_cache_size,untracked_eviction::type evictionType);
+    evict_return_t consume_tracked(page_t page_start) override;
+    inline bool is_tracked_page_fault(page_t page) const override {return !page_to_slot.contains(page);};
+    evict_return_t evict_from_tracked() override;
+    size_t tracked_size() override{return page_to_slot.size();};
+    std::string name() override {return "LinuxLRU";};
+    std::unique_ptr<page_cache_copy_t> get_page_cache_copy() override;
+private:
+    std::string cache_to_string(size_t num_elements) override{
+        auto copy = get_page_cache_copy();
+        if(num_elements>copy->size()) num_elements = copy->size();
+        std::string ret("[");
+        ret += page_iterable_to_str(copy->begin(),num_elements,copy->end());
+        ret += ']';
+        return ret;
+    };
+    [[nodiscard]] bool inactive_is_low() const {return lists.size(LINUX_INACTIVE)*inactive_ratio < lists.size(LINUX_ACTIVE);}
+    void activate(slot_t s);
+    void shrink_active_list();
+
+    const size_t inactive_ratio;
+    uint64_t nonresident_age = 0; // evictions + activations
+    ShadowTable<uint64_t> shadows; // eviction's nonresident_age
+    huge_pages::unordered_map<page_t,slot_t> page_to_slot;
+    SlotPool<LINUX_LRU_page_data_internal> pages;
+    SlotLists<NUM_LINUX_LRU_LISTS> lists; // front = tail of the kernel's lists
+};
+
+
+#endif //C_REWRITE_LINUX_LRU_H
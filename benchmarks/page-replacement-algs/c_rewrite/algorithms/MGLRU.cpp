@@ -0,0 +1,107 @@
+#include "MGLRU.h"
+
+static constexpr uint64_t MIN_LRU_BATCH = 64;
+static constexpr uint64_t TIER_GAIN = 2; // tier 0's is 1
+
+evict_return_t MGLRU::consume_tracked(page_t page_start){
+    evict_return_t ret = std::nullopt;
+    const auto it = page_to_slot.find(page_start);
+    if(it != page_to_slot.end()){
+        auto& data = pages[it->second];
+        if(!data.accessed){
+            data.accessed = true;
+            accessed_since_aging.push_back(it->second);
+        }
+        return ret;
+    }
+    const auto eviction = shadows.take(page_start);
+    if(page_cache_full()) ret = evict();
+    uint8_t refs = 0;
+    if(eviction != std::nullopt && max_seq - eviction->seq < MAX_NR_GENS){ // lru_gen_refault()
+        tiers[eviction->refs].refaulted++;
+        refs = std::min<uint8_t>(eviction->refs + 1,MAX_NR_TIERS - 1);
+    }
+    const auto s = pages.acquire({page_start,false,refs});
+    page_to_slot[page_start] = s;
+    generations.push_back(gen(max_seq),s);
+    return ret;
+}
+
+evict_return_t MGLRU::evict_from_tracked(){
+    if(tracked_size()==0) return std::nullopt;
+    const auto tier_idx = get_tier_idx();
+    while(true){
+        if(max_seq - min_seq + 1 <= MIN_NR_GENS) age();
+        const auto oldest = gen(min_seq);
+        if(generations.empty(oldest)){
+            inc_min_seq();
+            continue;
+        }
+        const auto s = generations.front(oldest);
+        auto& data = pages[s];
+        if(data.accessed){ // folio_referenced() found it young
+            data.accessed = false;
+            data.refs = 0;
+            generations.move_to_back(gen(max_seq),s);
+            continue;
+        }
+        if(data.refs > tier_idx){ // sort_folio()'s protection
+            data.refs = 0;
+            generations.move_to_back(gen(min_seq + 1),s);
+            continue;
+        }
+        const auto page = data.page;
+        tiers[data.refs].evicted++;
+        shadows.insert(page,{min_seq,data.refs});
+        generations.erase(s);
+        page_to_slot.erase(page);
+        pages.release(s);
+        return page;
+    }
+}
+
+// inc_max_seq() after walk_mm(): accessed pages are promoted to the new generation, whatever their current one
+void MGLRU::age(){
+    max_seq++;
+    const auto youngest = gen(max_seq);
+    for(auto s : accessed_since_aging){
+        auto& data = pages[s];
+        if(!data.accessed || !generations.contains(s)) continue; // evicted, or promoted by eviction, since
+        data.accessed = false;
+        data.refs = 0;
+        generations.move_to_back(youngest,s);
+    }
+    accessed_since_aging.clear();
+}
+
+void MGLRU::inc_min_seq(){
+    min_seq++;
+    for(auto& tier : tiers){
+        tier.avg_refaulted = (tier.avg_refaulted + tier.refaulted)/2;
+        tier.avg_total = (tier.avg_total + tier.refaulted + tier.evicted)/2;
+        tier.refaulted = tier.evicted = 0;
+    }
+}
+
+// The highest tier whose refault rate isn't over TIER_GAIN times tier 0's, every tier up to it included: tiers above it
+// are protected
+uint8_t MGLRU::get_tier_idx() const{
+    const auto refaulted = [this](uint8_t t){return tiers[t].avg_refaulted + tiers[t].refaulted;};
+    const auto total = [this](uint8_t t){return tiers[t].avg_total + tiers[t].refaulted + tiers[t].evicted;};
+    uint8_t tier = 1;
+    for(; tier < MAX_NR_TIERS; tier++){
+        const bool positive_ctrl_err = refaulted(tier) < MIN_LRU_BATCH ||
+                refaulted(tier)*(total(0) + MIN_LRU_BATCH) <= (refaulted(0) + 1)*total(tier)*TIER_GAIN;
+        if(!positive_ctrl_err) break;
+    }
+    return tier - 1;
+}
+
+std::unique_ptr<page_cache_copy_t> MGLRU::get_page_cache_copy() {
+    page_cache_copy_t concatenated_list;
+    concatenated_list.reserve(tracked_size());
+    for(auto seq = min_seq; seq <= max_seq; seq++){
+        for(auto s = generations.front(gen(seq)); s != NO_SLOT; s = generations.next(s)) concatenated_list.push_back(pages[s].page);
+    }
+    return std::make_unique<page_cache_copy_t>(concatenated_list);
+}
@@ -0,0 +1,66 @@
+#ifndef C_REWRITE_MGLRU_H
+#define C_REWRITE_MGLRU_H
+
+#include "GenericAlgorithm.h"
+#include "SlotLists.h"
+#include "ShadowTable.h"
+#include <unordered_map>
+
+// The kernel's multi-generational LRU (mm/vmscan.c, lru_gen) for anonymous pages. Pages belong to one of up to
+// MAX_NR_GENS generations [min_seq,max_seq], faulted ones to the youngest. Accesses only set the page's accessed bit, as
+// a PTE's. Aging, run when only MIN_NR_GENS generations are left, opens a new youngest generation and moves the pages
+// accessed since the last aging to it (the page table walk), clearing their bit. Eviction takes pages from the oldest
+// generation, still promoting those found accessed (as rmap and look-around do).
+// Tiers: pages evicted recently enough (their generation is within MAX_NR_GENS of the current one) refault with one
+// more reference than they had, up to MAX_NR_TIERS-1. A PID controller compares each tier's refault rate to tier 0's,
+// and eviction moves pages of tiers refaulting more than twice as often one generation up instead. The kernel counts
+// references for file descriptor accesses, which samples can't tell apart: refaults are all that's left
+class MGLRU : public GenericAlgorithm{
+public:
+    MGLRU(size_t page_cache_size,untracked_eviction::type evictionType) : GenericAlgorithm(page_cache_size,evictionType),shadows(page_cache_size){};
+    evict_return_t consume_tracked(page_t page_start) override;
+    inline bool is_tracked_page_fault(page_t page) const override {return !page_to_slot.contains(page);};
+    evict_return_t evict_from_tracked() override;
+    size_t tracked_size() override{return page_to_slot.size();};
+    std::string name() override {return "MGLRU";};
+    std::unique_ptr<page_cache_copy_t> get_page_cache_copy() override;
+
+    static constexpr uint8_t MIN_NR_GENS = 2;
+    static constexpr uint8_t MAX_NR_GENS = 4;
+    static constexpr uint8_t MAX_NR_TIERS = 4;
+private:
+    std::string cache_to_string(size_t num_elements) override{
+        auto copy = get_page_cache_copy();
+        if(num_elements>copy->size()) num_elements = copy->size();
+        std::string ret("[");
+        ret += page_iterable_to_str(copy->begin(),num_elements,copy->end());
+        ret += ']';
+        return ret;
+    };
+    [[nodiscard]] static uint8_t gen(uint64_t seq) {return static_cast<uint8_t>(seq % MAX_NR_GENS);}
+    void age();
+    void inc_min_seq();
+    [[nodiscard]] uint8_t get_tier_idx() const;
+
+    struct Eviction{
+        uint64_t seq;
+        uint8_t refs;
+    };
+    // Per tier, as the kernel's lru_gen_folio: current generation's counts, and their running average over the
+    // previous ones
+    struct TierCounts{
+        uint64_t refaulted = 0, evicted = 0;
+        uint64_t avg_refaulted = 0, avg_total = 0;
+    };
+
+    uint64_t min_seq = 0, max_seq = MIN_NR_GENS + 1;
+    std::array<TierCounts,MAX_NR_TIERS> tiers{};
+    std::vector<slot_t> accessed_since_aging; // what the page table walk would find
+    ShadowTable<Eviction> shadows;
+    huge_pages::unordered_map<page_t,slot_t> page_to_slot;
+    SlotPool<MGLRU_page_data_internal> pages;
+    SlotLists<MAX_NR_GENS> generations; // front = oldest
+};
+
+
+#endif //C_REWRITE_MGLRU_H
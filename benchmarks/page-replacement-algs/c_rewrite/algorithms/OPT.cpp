@@ -0,0 +1,197 @@
+#include "OPT.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr uint64_t NEXT_USE_MAGIC = 0x4553555458454e; // "NEXTUSE"
+static constexpr uint64_t NEXT_USE_VERSION = 1;
+static constexpr size_t HEAP_COMPACTION_SLACK = 1024;
+
+struct NextUseHeader{
+    uint64_t magic;
+    uint64_t version;
+    uint64_t trace_size;
+    uint64_t trace_mtime_ns;
+    uint64_t text_trace_format;
+    uint64_t n_records;
+};
+
+static std::vector<trace_pos_t> compute_next_use(const TraceReader& trace){
+    std::vector<trace_pos_t> next_use;
+    next_use.reserve(trace.estimated_records());
+    std::unordered_map<page_t,trace_pos_t> last_use;
+    trace.for_each([&](const TraceRecord& record){
+        const auto position = static_cast<trace_pos_t>(next_use.size());
+        if(position == NEVER_USED_AGAIN) throw std::length_error("Trace too long for trace_pos_t");
+        next_use.push_back(NEVER_USED_AGAIN);
+        auto [it,inserted] = last_use.try_emplace(page_start_from_mem_address(record.address),position);
+        if(!inserted){
+            next_use[it->second] = position;
+            it->second = position;
+        }
+    });
+    return next_use;
+}
+
+// Of the trace as it is now, with no record yet ; nullopt if the trace doesn't exist
+static std::optional<NextUseHeader> header_of(const std::string& trace_path, bool text_format){
+    struct stat trace_stat{};
+    if(stat(trace_path.c_str(),&trace_stat) == -1) return std::nullopt;
+    return NextUseHeader{.magic=NEXT_USE_MAGIC, .version=NEXT_USE_VERSION, .trace_size=static_cast<uint64_t>(trace_stat.st_size),
+                         .trace_mtime_ns=static_cast<uint64_t>(trace_stat.st_mtim.tv_sec)*1000*1000*1000 + trace_stat.st_mtim.tv_nsec,
+                         .text_trace_format=text_format, .n_records=0};
+}
+
+std::unique_ptr<NextUseIndex> NextUseIndex::load(const std::string& trace_path, bool text_format){
+    const auto expected = header_of(trace_path,text_format);
+    if(!expected) return nullptr;
+    const std::string cache_path = trace_path + ".next_use";
+    const int fd = open(cache_path.c_str(),O_RDONLY);
+    if(fd == -1) return nullptr;
+    std::unique_ptr<NextUseIndex> index(new NextUseIndex());
+    NextUseHeader header{};
+    struct stat cache_stat{};
+    if(read(fd,&header,sizeof(header)) == sizeof(header) && fstat(fd,&cache_stat) == 0 && header.magic == expected->magic &&
+       header.version == expected->version && header.trace_size == expected->trace_size && header.trace_mtime_ns == expected->trace_mtime_ns &&
+       header.text_trace_format == expected->text_trace_format &&
+       static_cast<size_t>(cache_stat.st_size) == sizeof(header) + header.n_records*sizeof(trace_pos_t)){
+        index->mapping_length = cache_stat.st_size;
+        index->mapping = mmap(nullptr,index->mapping_length,PROT_READ,MAP_SHARED,fd,0);
+        if(index->mapping != MAP_FAILED){
+            close(fd);
+            index->next_use = reinterpret_cast<const trace_pos_t*>(static_cast<const char*>(index->mapping) + sizeof(header));
+            index->n_records = header.n_records;
+            std::cout << "Loaded next use index from " << cache_path << std::endl;
+            return index;
+        }
+        index->mapping = nullptr;
+    }
+    close(fd);
+    return nullptr;
+}
+
+std::unique_ptr<NextUseIndex> NextUseIndex::load_or_compute(const std::string& trace_path, const TraceReader& trace){
+    if(auto cached = load(trace_path,trace.text_format())) return cached;
+    const auto expected = header_of(trace_path,trace.text_format());
+    if(!expected) return nullptr;
+    const std::string cache_path = trace_path + ".next_use";
+    std::unique_ptr<NextUseIndex> index(new NextUseIndex());
+
+    // Positions are 32-bit, to halve the index
+    if(trace.records() >= NEVER_USED_AGAIN){
+        std::cerr << "The trace has too many records for a next use index (" << trace.records() << ", at most " << NEVER_USED_AGAIN - 1 << ")" << std::endl;
+        return nullptr;
+    }
+    std::cout << "Computing next use index..." << std::endl;
+    try{
+        index->in_memory = compute_next_use(trace);
+    }
+    catch(const std::length_error& e){
+        std::cerr << e.what() << std::endl;
+        return nullptr;
+    }
+    index->next_use = index->in_memory.data();
+    index->n_records = index->in_memory.size();
+
+    // Write to a temporary file first, so that concurrent runs never see a partial index
+    const std::string tmp_path = cache_path + ".tmp" + std::to_string(getpid());
+    const int fd = open(tmp_path.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+    if(fd == -1){
+        std::cerr << "Couldn't cache the next use index to " << cache_path << ", keeping it in memory" << std::endl;
+        return index;
+    }
+    NextUseHeader header = *expected;
+    header.n_records = index->n_records;
+    const size_t data_length = index->n_records*sizeof(trace_pos_t);
+    bool ok = write(fd,&header,sizeof(header)) == sizeof(header);
+    for(size_t written = 0; ok && written < data_length;){
+        const auto ret = write(fd,reinterpret_cast<const char*>(index->next_use) + written,data_length - written);
+        if(ret <= 0) ok = false;
+        else written += ret;
+    }
+    close(fd);
+    if(!ok || rename(tmp_path.c_str(),cache_path.c_str()) == -1){
+        std::cerr << "Couldn't cache the next use index to " << cache_path << ", keeping it in memory" << std::endl;
+        unlink(tmp_path.c_str());
+    }
+    return index;
+}
+
+NextUseIndex::~NextUseIndex(){
+    if(mapping != nullptr) munmap(mapping,mapping_length);
+}
+
+evict_return_t OPT::consume_tracked(page_t page_start){
+    auto page_fault = is_tracked_page_fault(page_start);
+
+    evict_return_t ret = std::nullopt;
+    if(page_fault && page_cache_full()){
+        ret = evict();
+    }
+    const trace_pos_t next = next_use != nullptr ? (*next_use)[position] : NEVER_USED_AGAIN;
+    page_to_data_internal[page_start].next_use = next;
+    push(next,page_start);
+    if(heap.size() > 2*page_to_data_internal.size() + HEAP_COMPACTION_SLACK) compact_heap();
+    return ret;
+}
+
+void OPT::push(trace_pos_t next, page_t page){
+    heap.emplace_back(next,page);
+    std::push_heap(heap.begin(),heap.end());
+    soonest.emplace_back(next,page);
+    std::push_heap(soonest.begin(),soonest.end(),std::greater<>());
+}
+
+void OPT::refresh_past_next_uses(){
+    if(next_use == nullptr) return;
+    while(!soonest.empty() && soonest.front().first < position){
+        std::pop_heap(soonest.begin(),soonest.end(),std::greater<>());
+        const auto [next,page] = soonest.back();
+        soonest.pop_back();
+        auto it = page_to_data_internal.find(page);
+        if(it == page_to_data_internal.end() || it->second.next_use != next) continue;
+        // Accessed since without being considered: its actual next use is further down the chain
+        auto refreshed = next;
+        while(refreshed < position) refreshed = (*next_use)[refreshed];
+        it->second.next_use = refreshed;
+        push(refreshed,page);
+    }
+}
+
+evict_return_t OPT::evict_from_tracked(){
+    refresh_past_next_uses();
+    while(!heap.empty()){
+        std::pop_heap(heap.begin(),heap.end());
+        const auto [next,page] = heap.back();
+        heap.pop_back();
+        auto it = page_to_data_internal.find(page);
+        if(it != page_to_data_internal.end() && it->second.next_use == next){
+            page_to_data_internal.erase(it);
+            return page;
+        }
+    }
+    return std::nullopt;
+}
+
+void OPT::compact_heap(){
+    heap.clear();
+    for(const auto& [page,data] : page_to_data_internal) heap.emplace_back(data.next_use,page);
+    soonest = heap;
+    std::make_heap(heap.begin(),heap.end());
+    std::make_heap(soonest.begin(),soonest.end(),std::greater<>());
+}
+
+std::unique_ptr<page_cache_copy_t> OPT::get_page_cache_copy() {
+    page_cache_copy_t pages;
+    pages.reserve(page_to_data_internal.size());
+    for(const auto& [page,data] : page_to_data_internal) pages.push_back(page);
+    return std::make_unique<page_cache_copy_t>(pages);
+}
@@ -0,0 +1,70 @@
+#ifndef C_REWRITE_OPT_H
+#define C_REWRITE_OPT_H
+
+#include "GenericAlgorithm.h"
+#include "../TraceReader.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// For each record of a trace, the index of the next record accessing the same page (NEVER_USED_AGAIN if none), computed
+// in one pass and cached next to the trace (`<trace>.next_use`), keyed by the trace's size and modification time.
+// nullptr if it can't be: the trace doesn't exist, or has NEVER_USED_AGAIN records or more
+class NextUseIndex{
+public:
+    static std::unique_ptr<NextUseIndex> load_or_compute(const std::string& trace_path, const TraceReader& trace);
+    // Only if cached, without reading the trace
+    static std::unique_ptr<NextUseIndex> load(const std::string& trace_path, bool text_format);
+    ~NextUseIndex();
+    NextUseIndex(const NextUseIndex&) = delete;
+    NextUseIndex& operator=(const NextUseIndex&) = delete;
+    [[nodiscard]] trace_pos_t operator[](size_t position) const {return position < n_records ? next_use[position] : NEVER_USED_AGAIN;}
+    [[nodiscard]] size_t size() const {return n_records;}
+private:
+    NextUseIndex() = default;
+    const trace_pos_t* next_use = nullptr;
+    size_t n_records = 0;
+    void* mapping = nullptr; // of the cache file, when there's one
+    size_t mapping_length = 0;
+    std::vector<trace_pos_t> in_memory; // when the cache file couldn't be written
+};
+
+// Belady's MIN: evicts the tracked page whose next use is the furthest away. Needs the trace position of every access
+// (`set_trace_position`), hence only runs offline. Lower bound of the number of faults when every access is considered ;
+// otherwise a page's next use is only known as of its last considered access, and followed along the index past the
+// accesses which weren't when it comes before the current position
+class OPT : public GenericAlgorithm{
+public:
+    OPT(size_t page_cache_size,untracked_eviction::type evictionType,const NextUseIndex* next_use) : GenericAlgorithm(page_cache_size,evictionType),next_use(next_use){};
+    evict_return_t consume_tracked(page_t page_start) override;
+    inline bool is_tracked_page_fault(page_t page) const override {return !page_to_data_internal.contains(page);};
+    evict_return_t evict_from_tracked() override;
+    size_t tracked_size() override{return page_to_data_internal.size();};
+    std::string name() override {return "OPT";};
+    std::unique_ptr<page_cache_copy_t> get_page_cache_copy() override;
+    void set_trace_position(size_t position) override {this->position = position;};
+private:
+    std::string cache_to_string(size_t num_elements) override{
+        auto copy = get_page_cache_copy();
+        if(num_elements>copy->size()) num_elements = copy->size();
+        std::string ret("[");
+        ret += page_iterable_to_str(copy->begin(),num_elements,copy->end());
+        ret += ']';
+        return ret;
+    };
+    void push(trace_pos_t next, page_t page);
+    void refresh_past_next_uses();
+    void compact_heap();
+
+    const NextUseIndex* next_use;
+    size_t position = 0;
+    huge_pages::unordered_map<page_t,OPT_page_data_internal> page_to_data_internal;
+    // Max-heap on the next use ; entries are never removed but on eviction, stale ones (the page was accessed again
+    // since, or evicted) are skipped then, and compacted away when they outnumber the live ones
+    std::vector<opt_heap_entry_t> heap;
+    // Min-heap on the same entries, to find the next uses the trace went past
+    std::vector<opt_heap_entry_t> soonest;
+};
+
+
+#endif //C_REWRITE_OPT_H
@@ -0,0 +1,89 @@
+#include "S3FIFO.h"
+
+#include <algorithm>
+
+// As recommended by the paper
+static constexpr size_t SMALL_PERCENT = 10;
+static constexpr uint8_t MAX_FREQ = 3;
+
+S3FIFO::S3FIFO(size_t page_cache_size,untracked_eviction::type evictionType) : GenericAlgorithm(page_cache_size,evictionType),
+        small_capacity(std::max<size_t>(1,page_cache_size*SMALL_PERCENT/100)),
+        ghost_capacity(std::max<size_t>(1,page_cache_size - std::min(page_cache_size,small_capacity))){}
+
+evict_return_t S3FIFO::consume_tracked(page_t page_start){
+    evict_return_t ret = std::nullopt;
+    const auto it = page_to_slot.find(page_start);
+    if(it != page_to_slot.end()){
+        const auto s = it->second;
+        if(lists.list_of(s) != S3_GHOST){
+            auto& freq = pages[s].freq;
+            if(freq < MAX_FREQ) freq++;
+            return ret;
+        }
+        lists.erase(s); // so that evicting can't drop it from the ghost FIFO
+        if(page_cache_full()) ret = evict();
+        pages[s].freq = 0;
+        lists.push_back(S3_MAIN,s);
+        return ret;
+    }
+    if(page_cache_full()) ret = evict();
+    const auto s = pages.acquire({page_start,0});
+    page_to_slot[page_start] = s;
+    lists.push_back(S3_SMALL,s);
+    return ret;
+}
+
+evict_return_t S3FIFO::evict_from_tracked(){
+    if(tracked_size()==0) return std::nullopt;
+    if(lists.size(S3_SMALL) >= small_capacity || lists.empty(S3_MAIN)){
+        auto victim = evict_small();
+        if(victim != std::nullopt) return victim;
+    }
+    return evict_main();
+}
+
+// Nothing if all of the small FIFO's pages moved to the main one
+evict_return_t S3FIFO::evict_small(){
+    while(!lists.empty(S3_SMALL)){
+        const auto s = lists.pop_front(S3_SMALL);
+        if(pages[s].freq > 1){
+            lists.push_back(S3_MAIN,s);
+        }
+        else{
+            lists.push_back(S3_GHOST,s);
+            if(lists.size(S3_GHOST) > ghost_capacity) forget(lists.pop_front(S3_GHOST));
+            return pages[s].page;
+        }
+    }
+    return std::nullopt;
+}
+
+page_t S3FIFO::evict_main(){
+    while(true){
+        const auto s = lists.pop_front(S3_MAIN);
+        auto& freq = pages[s].freq;
+        if(freq > 0){
+            freq--;
+            lists.push_back(S3_MAIN,s);
+        }
+        else{
+            const auto page = pages[s].page;
+            forget(s);
+            return page;
+        }
+    }
+}
+
+void S3FIFO::forget(slot_t s){
+    page_to_slot.erase(pages[s].page);
+    pages.release(s);
+}
+
+std::unique_ptr<page_cache_copy_t> S3FIFO::get_page_cache_copy() {
+    page_cache_copy_t concatenated_list;
+    concatenated_list.reserve(tracked_size());
+    for(auto l : {S3_SMALL,S3_MAIN}){
+        for(auto s = lists.front(l); s != NO_SLOT; s = lists.next(s)) concatenated_list.push_back(pages[s].page);
+    }
+    return std::make_unique<page_cache_copy_t>(concatenated_list);
+}
@@ -0,0 +1,44 @@
+#ifndef C_REWRITE_S3FIFO_H
+#define C_REWRITE_S3FIFO_H
+
+#include "GenericAlgorithm.h"
+#include "SlotLists.h"
+#include <unordered_map>
+
+// Yang et al.'s S3-FIFO: new pages go to a small FIFO (10% of the cache), and only those accessed more than once while
+// in it move on to the main FIFO, whose pages are reinserted while they have accesses left (lazy promotion, as CLOCK).
+// Pages evicted from the small FIFO are remembered in a ghost FIFO, and go straight to the main one when faulted again
+class S3FIFO : public GenericAlgorithm{
+public:
+    S3FIFO(size_t page_cache_size,untracked_eviction::type evictionType);
+    evict_return_t consume_tracked(page_t page_start) override;
+    inline bool is_tracked_page_fault(page_t page) const override {
+        const auto it = page_to_slot.find(page);
+        return it == page_to_slot.end() || lists.list_of(it->second) == S3_GHOST;
+    };
+    evict_return_t evict_from_tracked() override;
+    size_t tracked_size() override{return lists.size(S3_SMALL)+lists.size(S3_MAIN);};
+    std::string name() override {return "S3FIFO";};
+    std::unique_ptr<page_cache_copy_t> get_page_cache_copy() override;
+private:
+    std::string cache_to_string(size_t num_elements) override{
+        auto copy = get_page_cache_copy();
+        if(num_elements>copy->size()) num_elements = copy->size();
+        std::string ret("[");
+        ret += page_iterable_to_str(copy->begin(),num_elements,copy->end());
+        ret += ']';
+        return ret;
+    };
+    evict_return_t evict_small();
+    page_t evict_main();
+    void forget(slot_t s);
+
+    const size_t small_capacity;
+    const size_t ghost_capacity; // as many as the main FIFO's target
+    huge_pages::unordered_map<page_t,slot_t> page_to_slot;
+    SlotPool<S3_FIFO_page_data_internal> pages;
+    SlotLists<NUM_S3_FIFO_LISTS> lists; // front = oldest
+};
+
+
+#endif //C_REWRITE_S3FIFO_H
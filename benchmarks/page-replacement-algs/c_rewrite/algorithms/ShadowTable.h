@@ -0,0 +1,50 @@
+#ifndef C_REWRITE_SHADOW_TABLE_H
+#define C_REWRITE_SHADOW_TABLE_H
+
+#include "GenericAlgorithm.h"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+// What a policy remembers of evicted pages, as the kernel's shadow entries (mm/workingset.c), bounded to `capacity`
+// pages: the oldest are dropped first
+template<typename T>
+class ShadowTable{
+public:
+    explicit ShadowTable(size_t capacity) : ring(std::max<size_t>(1,capacity)){}
+    void insert(page_t page, const T& value){
+        auto& oldest = ring[at];
+        if(oldest.stamp != 0){
+            const auto it = shadows.find(oldest.page);
+            if(it != shadows.end() && it->second.stamp == oldest.stamp) shadows.erase(it);
+        }
+        oldest = {page,next_stamp};
+        shadows[page] = {value,next_stamp};
+        next_stamp++;
+        at = at+1 == ring.size() ? 0 : at+1;
+    }
+    // Removes it
+    std::optional<T> take(page_t page){
+        const auto it = shadows.find(page);
+        if(it == shadows.end()) return std::nullopt;
+        const auto value = it->second.value;
+        shadows.erase(it);
+        return value;
+    }
+    [[nodiscard]] size_t size() const {return shadows.size();}
+private:
+    struct Shadow{
+        T value;
+        uint64_t stamp;
+    };
+    struct RingEntry{
+        page_t page = 0;
+        uint64_t stamp = 0; // 0 = empty
+    };
+    huge_pages::unordered_map<page_t,Shadow> shadows;
+    std::vector<RingEntry> ring;
+    size_t at = 0;
+    uint64_t next_stamp = 1;
+};
+
+#endif //C_REWRITE_SHADOW_TABLE_H
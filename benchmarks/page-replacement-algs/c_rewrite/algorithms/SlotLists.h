@@ -0,0 +1,127 @@
+#ifndef C_REWRITE_SLOT_LISTS_H
+#define C_REWRITE_SLOT_LISTS_H
+
+// Array-based replacements of the std::list + iterator-in-the-map scheme of LRU/ARC/CAR: per-page metadata lives in a
+// slot of a SlotPool, and queues are doubly linked lists of 32-bit slot indices (SlotLists), so that moving a page
+// between queues never allocates and the metadata of a page is a handful of bytes
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "HugePageArena.h"
+
+typedef uint32_t slot_t;
+static constexpr slot_t NO_SLOT = std::numeric_limits<slot_t>::max();
+
+// Slots of per-page metadata, recycled through a free list. A slot index stays valid until released
+template<typename T>
+class SlotPool{
+public:
+    slot_t acquire(const T& value){
+        if(!free_slots.empty()){
+            const auto s = free_slots.back();
+            free_slots.pop_back();
+            values[s] = value;
+            return s;
+        }
+        values.push_back(value);
+        return static_cast<slot_t>(values.size()-1);
+    }
+    void release(slot_t s){free_slots.push_back(s);}
+    T& operator[](slot_t s){return values[s];}
+    const T& operator[](slot_t s) const{return values[s];}
+    void reserve(size_t n){values.reserve(n);}
+    [[nodiscard]] size_t size() const {return values.size() - free_slots.size();}
+private:
+    huge_pages::vector<T> values;
+    huge_pages::vector<slot_t> free_slots;
+};
+
+// N doubly linked lists threaded through slot indices, a slot being in at most one of them at a time. Front = oldest,
+// back = newest. Policies whose queues overlap (LIRS' stack and queue) use one SlotLists per set of exclusive queues
+template<uint8_t N>
+class SlotLists{
+public:
+    static constexpr uint8_t NONE = N;
+
+    SlotLists(){
+        heads.fill(NO_SLOT);
+        tails.fill(NO_SLOT);
+        sizes.fill(0);
+    }
+
+    [[nodiscard]] uint8_t list_of(slot_t s) const {return s < links.size() ? links[s].list : NONE;}
+    [[nodiscard]] bool contains(slot_t s) const {return list_of(s) != NONE;}
+    [[nodiscard]] size_t size(uint8_t l) const {return sizes[l];}
+    [[nodiscard]] bool empty(uint8_t l) const {return sizes[l] == 0;}
+    [[nodiscard]] slot_t front(uint8_t l) const {return heads[l];}
+    [[nodiscard]] slot_t back(uint8_t l) const {return tails[l];}
+    [[nodiscard]] slot_t next(slot_t s) const {return links[s].next;}
+    [[nodiscard]] slot_t prev(slot_t s) const {return links[s].prev;}
+    // For lists used as clocks
+    [[nodiscard]] slot_t next_circular(slot_t s) const {return links[s].next != NO_SLOT ? links[s].next : heads[links[s].list];}
+
+    void push_back(uint8_t l, slot_t s){
+        auto& link = at(s);
+        link = {tails[l],NO_SLOT,l};
+        if(tails[l] != NO_SLOT) links[tails[l]].next = s;
+        else heads[l] = s;
+        tails[l] = s;
+        sizes[l]++;
+    }
+    void push_front(uint8_t l, slot_t s){
+        auto& link = at(s);
+        link = {NO_SLOT,heads[l],l};
+        if(heads[l] != NO_SLOT) links[heads[l]].prev = s;
+        else tails[l] = s;
+        heads[l] = s;
+        sizes[l]++;
+    }
+    // Into `pos`'s list, right before it
+    void insert_before(slot_t pos, slot_t s){
+        const auto l = links[pos].list;
+        const auto before = links[pos].prev;
+        auto& link = at(s);
+        link = {before,pos,l};
+        links[pos].prev = s;
+        if(before != NO_SLOT) links[before].next = s;
+        else heads[l] = s;
+        sizes[l]++;
+    }
+    // From whichever list `s` is in
+    void erase(slot_t s){
+        auto& link = links[s];
+        const auto l = link.list;
+        if(link.prev != NO_SLOT) links[link.prev].next = link.next;
+        else heads[l] = link.next;
+        if(link.next != NO_SLOT) links[link.next].prev = link.prev;
+        else tails[l] = link.prev;
+        sizes[l]--;
+        link = {};
+    }
+    slot_t pop_front(uint8_t l){
+        const auto s = heads[l];
+        if(s != NO_SLOT) erase(s);
+        return s;
+    }
+    void move_to_back(uint8_t l, slot_t s){
+        if(contains(s)) erase(s);
+        push_back(l,s);
+    }
+
+private:
+    struct Links{
+        slot_t prev = NO_SLOT, next = NO_SLOT;
+        uint8_t list = NONE;
+    };
+    Links& at(slot_t s){
+        if(s >= links.size()) links.resize(static_cast<size_t>(s)+1);
+        return links[s];
+    }
+    huge_pages::vector<Links> links;
+    std::array<slot_t,N> heads, tails;
+    std::array<size_t,N> sizes;
+};
+
+#endif //C_REWRITE_SLOT_LISTS_H
@@ -0,0 +1,63 @@
+#include "TwoQ.h"
+
+#include <algorithm>
+
+// As recommended by the paper
+static constexpr size_t KIN_PERCENT = 25;
+static constexpr size_t KOUT_PERCENT = 50;
+
+TwoQ::TwoQ(size_t page_cache_size,untracked_eviction::type evictionType) : GenericAlgorithm(page_cache_size,evictionType),
+        kin(std::max<size_t>(1,page_cache_size*KIN_PERCENT/100)),kout(std::max<size_t>(1,page_cache_size*KOUT_PERCENT/100)){}
+
+evict_return_t TwoQ::consume_tracked(page_t page_start){
+    evict_return_t ret = std::nullopt;
+    const auto it = page_to_slot.find(page_start);
+    if(it != page_to_slot.end()){
+        const auto s = it->second;
+        switch(lists.list_of(s)){
+            case AM:
+                lists.move_to_back(AM,s);
+                return ret;
+            case A1IN: // correlated reference, A1in stays a FIFO
+                return ret;
+            default: // A1out: seen again after a while, hot
+                lists.erase(s); // so that evicting can't drop it from A1out
+                if(page_cache_full()) ret = evict();
+                lists.push_back(AM,s);
+                return ret;
+        }
+    }
+    if(page_cache_full()) ret = evict();
+    const auto s = pages.acquire({page_start});
+    page_to_slot[page_start] = s;
+    lists.push_back(A1IN,s);
+    return ret;
+}
+
+evict_return_t TwoQ::evict_from_tracked(){
+    if(tracked_size()==0) return std::nullopt;
+    if(lists.size(A1IN) > kin || lists.empty(AM)){
+        const auto s = lists.pop_front(A1IN);
+        lists.push_back(A1OUT,s);
+        if(lists.size(A1OUT) > kout) forget(lists.pop_front(A1OUT));
+        return pages[s].page;
+    }
+    const auto s = lists.pop_front(AM);
+    const auto page = pages[s].page;
+    forget(s);
+    return page;
+}
+
+void TwoQ::forget(slot_t s){
+    page_to_slot.erase(pages[s].page);
+    pages.release(s);
+}
+
+std::unique_ptr<page_cache_copy_t> TwoQ::get_page_cache_copy() {
+    page_cache_copy_t concatenated_list;
+    concatenated_list.reserve(tracked_size());
+    for(auto l : {A1IN,AM}){
+        for(auto s = lists.front(l); s != NO_SLOT; s = lists.next(s)) concatenated_list.push_back(pages[s].page);
+    }
+    return std::make_unique<page_cache_copy_t>(concatenated_list);
+}
@@ -0,0 +1,41 @@
+#ifndef C_REWRITE_TWOQ_H
+#define C_REWRITE_TWOQ_H
+
+#include "GenericAlgorithm.h"
+#include "SlotLists.h"
+#include <unordered_map>
+
+// Johnson and Shasha's (full) 2Q: first accesses go to the A1in FIFO, pages evicted from it are remembered in the A1out
+// ghost FIFO, and only pages re-accessed while in A1out get into the Am LRU, so that a scan only ever flushes A1in
+class TwoQ : public GenericAlgorithm{
+public:
+    TwoQ(size_t page_cache_size,untracked_eviction::type evictionType);
+    evict_return_t consume_tracked(page_t page_start) override;
+    inline bool is_tracked_page_fault(page_t page) const override {
+        const auto it = page_to_slot.find(page);
+        return it == page_to_slot.end() || lists.list_of(it->second) == A1OUT;
+    };
+    evict_return_t evict_from_tracked() override;
+    size_t tracked_size() override{return lists.size(A1IN)+lists.size(AM);};
+    std::string name() override {return "2Q";};
+    std::unique_ptr<page_cache_copy_t> get_page_cache_copy() override;
+private:
+    std::string cache_to_string(size_t num_elements) override{
+        auto copy = get_page_cache_copy();
+        if(num_elements>copy->size()) num_elements = copy->size();
+        std::string ret("[");
+        ret += page_iterable_to_str(copy->begin(),num_elements,copy->end());
+        ret += ']';
+        return ret;
+    };
+    void forget(slot_t s);
+
+    const size_t kin; // A1in's target size, in pages
+    const size_t kout; // A1out's size, in pages
+    huge_pages::unordered_map<page_t,slot_t> page_to_slot;
+    SlotPool<TWO_Q_page_data_internal> pages;
+    SlotLists<NUM_TWO_Q_LISTS> lists; // front = LRU/oldest
+};
+
+
+#endif //C_REWRITE_TWOQ_H
@@ -0,0 +1,125 @@
+#include "WTinyLFU.h"
+
+#include <algorithm>
+#include <bit>
+
+// Caffeine's defaults
+static constexpr size_t WINDOW_PERCENT = 1;
+static constexpr size_t PROTECTED_PERCENT = 80; // of the main segment
+static constexpr size_t SAMPLE_SIZE_FACTOR = 10;
+static constexpr uint8_t MAX_COUNTER = 15;
+static constexpr uint64_t HALVE_MASK = 0x7777777777777777ull;
+
+static uint64_t mix(uint64_t x){ // splitmix64's finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+FrequencySketch::FrequencySketch(size_t capacity) : sample_size(SAMPLE_SIZE_FACTOR*std::max<size_t>(1,capacity)){
+    const size_t counters_per_row = std::bit_ceil(std::max(capacity,COUNTERS_PER_WORD));
+    row_mask = counters_per_row - 1;
+    table.resize(ROWS*counters_per_row/COUNTERS_PER_WORD);
+}
+
+// Double hashing: row i uses h1 + i * h2
+size_t FrequencySketch::index(page_t page, size_t row) const{
+    const auto h = mix(page / PAGE_SIZE);
+    const auto h1 = h & 0xffffffffu, h2 = (h >> 32) | 1;
+    return row*(row_mask+1) + ((h1 + row*h2) & row_mask);
+}
+
+void FrequencySketch::increment(page_t page){
+    bool incremented = false;
+    for(size_t row = 0; row < ROWS; row++){
+        const auto i = index(page,row);
+        auto& word = table[i/COUNTERS_PER_WORD];
+        const auto shift = (i%COUNTERS_PER_WORD)*4;
+        if(((word >> shift) & 0xf) < MAX_COUNTER){
+            word += 1ull << shift;
+            incremented = true;
+        }
+    }
+    if(incremented && ++additions == sample_size){
+        for(auto& word : table) word = (word >> 1) & HALVE_MASK;
+        additions /= 2;
+    }
+}
+
+uint8_t FrequencySketch::frequency(page_t page) const{
+    uint8_t ret = MAX_COUNTER;
+    for(size_t row = 0; row < ROWS; row++){
+        const auto i = index(page,row);
+        ret = std::min(ret,static_cast<uint8_t>((table[i/COUNTERS_PER_WORD] >> ((i%COUNTERS_PER_WORD)*4)) & 0xf));
+    }
+    return ret;
+}
+
+WTinyLFU::WTinyLFU(size_t page_cache_size,untracked_eviction::type evictionType) : GenericAlgorithm(page_cache_size,evictionType),
+        window_capacity(std::max<size_t>(1,page_cache_size*WINDOW_PERCENT/100)),
+        protected_capacity((page_cache_size - std::min(page_cache_size,window_capacity))*PROTECTED_PERCENT/100),
+        sketch(page_cache_size){}
+
+evict_return_t WTinyLFU::consume_tracked(page_t page_start){
+    sketch.increment(page_start);
+    evict_return_t ret = std::nullopt;
+    const auto it = page_to_slot.find(page_start);
+    if(it != page_to_slot.end()){
+        const auto s = it->second;
+        switch(lists.list_of(s)){
+            case WINDOW:
+                lists.move_to_back(WINDOW,s);
+                break;
+            case PROBATION:
+                lists.move_to_back(PROTECTED,s);
+                if(lists.size(PROTECTED) > protected_capacity) lists.push_back(PROBATION,lists.pop_front(PROTECTED));
+                break;
+            default:
+                lists.move_to_back(PROTECTED,s);
+                break;
+        }
+        return ret;
+    }
+    if(page_cache_full()) ret = evict();
+    const auto s = pages.acquire({page_start});
+    page_to_slot[page_start] = s;
+    lists.push_back(WINDOW,s);
+    // Not full: no need for admission
+    if(lists.size(WINDOW) > window_capacity) lists.push_back(PROBATION,lists.pop_front(WINDOW));
+    return ret;
+}
+
+evict_return_t WTinyLFU::evict_from_tracked(){
+    if(tracked_size()==0) return std::nullopt;
+    auto victim = lists.front(PROBATION);
+    if(victim == NO_SLOT) victim = lists.front(PROTECTED);
+    if(victim == NO_SLOT) return forget(lists.pop_front(WINDOW));
+    if(lists.size(WINDOW) < window_capacity) return forget(victim); // the faulting page fits in the window
+    // The window's LRU page has to leave it for the faulting page: admission
+    const auto candidate = lists.pop_front(WINDOW);
+    if(sketch.frequency(pages[candidate].page) > sketch.frequency(pages[victim].page)){
+        lists.push_back(PROBATION,candidate);
+        return forget(victim);
+    }
+    return forget(candidate);
+}
+
+page_t WTinyLFU::forget(slot_t s){
+    const auto page = pages[s].page;
+    if(lists.contains(s)) lists.erase(s);
+    page_to_slot.erase(page);
+    pages.release(s);
+    return page;
+}
+
+std::unique_ptr<page_cache_copy_t> WTinyLFU::get_page_cache_copy() {
+    page_cache_copy_t concatenated_list;
+    concatenated_list.reserve(tracked_size());
+    for(auto l : {WINDOW,PROBATION,PROTECTED}){
+        for(auto s = lists.front(l); s != NO_SLOT; s = lists.next(s)) concatenated_list.push_back(pages[s].page);
+    }
+    return std::make_unique<page_cache_copy_t>(concatenated_list);
+}
@@ -0,0 +1,57 @@
+#ifndef C_REWRITE_WTINYLFU_H
+#define C_REWRITE_WTINYLFU_H
+
+#include "GenericAlgorithm.h"
+#include "SlotLists.h"
+#include <unordered_map>
+
+// Count-min sketch of 4 rows of 4-bit counters, halved every 10 * capacity increments so that it favours recent
+// popularity (TinyLFU's reset)
+class FrequencySketch{
+public:
+    explicit FrequencySketch(size_t capacity);
+    void increment(page_t page);
+    [[nodiscard]] uint8_t frequency(page_t page) const;
+private:
+    static constexpr size_t ROWS = 4;
+    static constexpr size_t COUNTERS_PER_WORD = 16;
+    [[nodiscard]] size_t index(page_t page, size_t row) const;
+    size_t row_mask; // counters per row - 1
+    size_t additions = 0;
+    size_t sample_size;
+    std::vector<uint64_t> table; // row-major
+};
+
+// Einziger et al.'s W-TinyLFU, as in Caffeine: new pages go to a small LRU window (1% of the cache), and the window's
+// LRU page only enters the main segmented LRU (probation, then protected once re-accessed) if the sketch estimates it
+// was accessed more often than the page it would replace, probation's LRU one
+class WTinyLFU : public GenericAlgorithm{
+public:
+    WTinyLFU(size_t page_cache_size,untracked_eviction::type evictionType);
+    evict_return_t consume_tracked(page_t page_start) override;
+    inline bool is_tracked_page_fault(page_t page) const override {return !page_to_slot.contains(page);};
+    evict_return_t evict_from_tracked() override;
+    size_t tracked_size() override{return page_to_slot.size();};
+    std::string name() override {return "WTinyLFU";};
+    std::unique_ptr<page_cache_copy_t> get_page_cache_copy() override;
+private:
+    std::string cache_to_string(size_t num_elements) override{
+        auto copy = get_page_cache_copy();
+        if(num_elements>copy->size()) num_elements = copy->size();
+        std::string ret("[");
+        ret += page_iterable_to_str(copy->begin(),num_elements,copy->end());
+        ret += ']';
+        return ret;
+    };
+    page_t forget(slot_t s);
+
+    const size_t window_capacity;
+    const size_t protected_capacity;
+    FrequencySketch sketch;
+    huge_pages::unordered_map<page_t,slot_t> page_to_slot;
+    SlotPool<W_TINYLFU_page_data_internal> pages;
+    SlotLists<NUM_W_TINYLFU_LISTS> lists; // front = LRU
+};
+
+
+#endif //C_REWRITE_WTINYLFU_H
@@ -0,0 +1,82 @@
+#ifndef C_REWRITE_PAGE_CACHE_ALGS_H
+#define C_REWRITE_PAGE_CACHE_ALGS_H
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <memory>
+#include <optional>
+#include <string>
+#include "GenericAlgorithm.h"
+#include "LRU.h"
+#include "LRU_K.h"
+#include "CLOCK.h"
+#include "ARC.h"
+#include "CAR.h"
+#include "OPT.h"
+#include "TwoQ.h"
+#include "LIRS.h"
+#include "CLOCKPro.h"
+#include "S3FIFO.h"
+#include "WTinyLFU.h"
+#include "LinuxLRU.h"
+#include "MGLRU.h"
+
+namespace page_cache_algs {
+    enum type {LRU_t, LRU_K_t, GCLOCK_t, ARC_t, CAR_t, TWO_Q_t, LIRS_t, CLOCK_PRO_t, S3_FIFO_t, W_TINYLFU_t, LINUX_LRU_t, MGLRU_t, OPT_t, NUM_ALGS};
+    static constexpr std::array all = {LRU_t, LRU_K_t, GCLOCK_t, ARC_t, CAR_t, TWO_Q_t, LIRS_t, CLOCK_PRO_t, S3_FIFO_t, W_TINYLFU_t, LINUX_LRU_t, MGLRU_t, OPT_t};
+    // Simulated when no `--algs` is given: each policy is a thread per sample ratio and untracked eviction, with up to the
+    // memory size's worth of metadata, so the others are opted into
+    inline constexpr std::array defaults = {LRU_t, LRU_K_t, GCLOCK_t, ARC_t, CAR_t, OPT_t};
+    // Next use index of the trace being simulated, for OPT. Set once before any simulation thread starts
+    inline const NextUseIndex* next_use = nullptr;
+    // B1/B2 representation of ARC and CAR, set likewise
+    inline ghost_directory::type ghosts = ghost_directory::EXACT;
+    inline std::unique_ptr<GenericAlgorithm> get_alg(type t,untracked_eviction::type u_t, size_t mem_size_in_pages){
+        switch(t){
+            case LRU_t:
+                return std::make_unique<LRU>(mem_size_in_pages,u_t);
+            case LRU_K_t:
+                return std::make_unique<LRU_K>(mem_size_in_pages,2,u_t);
+            case GCLOCK_t:
+                return std::make_unique<CLOCK>(mem_size_in_pages,u_t,1);
+            case ARC_t:
+                return std::make_unique<ARC>(mem_size_in_pages,u_t,ghosts);
+            case CAR_t:
+                return std::make_unique<CAR>(mem_size_in_pages,u_t,ghosts);
+            case TWO_Q_t:
+                return std::make_unique<TwoQ>(mem_size_in_pages,u_t);
+            case LIRS_t:
+                return std::make_unique<LIRS>(mem_size_in_pages,u_t);
+            case CLOCK_PRO_t:
+                return std::make_unique<CLOCKPro>(mem_size_in_pages,u_t);
+            case S3_FIFO_t:
+                return std::make_unique<S3FIFO>(mem_size_in_pages,u_t);
+            case W_TINYLFU_t:
+                return std::make_unique<WTinyLFU>(mem_size_in_pages,u_t);
+            case LINUX_LRU_t:
+                return std::make_unique<LinuxLRU>(mem_size_in_pages,u_t);
+            case MGLRU_t:
+                return std::make_unique<MGLRU>(mem_size_in_pages,u_t);
+            case OPT_t:
+                return std::make_unique<OPT>(mem_size_in_pages,u_t,next_use);
+            default:
+                return nullptr;
+        }
+    }
+    inline std::string type_to_alg_name(type t){return get_alg(t,untracked_eviction::FIFO /*here FIFO doesn't matter; we just use the name*/,1)->name();}
+    // Online policies only unless `offline`: OPT needs the future. Case insensitive
+    inline std::optional<type> alg_name_to_type(const std::string& name, bool offline = false){
+        const auto lower = [](std::string str){
+            std::transform(str.begin(),str.end(),str.begin(),[](unsigned char c){return std::tolower(c);});
+            return str;
+        };
+        for(auto t : all){
+            if(t == OPT_t && !offline) continue;
+            if(lower(type_to_alg_name(t)) == lower(name)) return t;
+        }
+        return std::nullopt;
+    }
+}
+
+#endif //C_REWRITE_PAGE_CACHE_ALGS_H
@@ -0,0 +1,160 @@
+// Online counterpart of `main.cpp`: instead of replaying a trace file, feeds a policy the samples custom_perf publishes
+// (`custom_perf -p /NAME`) to a shared memory ring, as the workload runs, and periodically reports the policy's hot and
+// cold pages.
+//
+// $ custom_perf -p /pebs -N -c 100 ./workload &
+// $ c_rewrite_live -a ARC -m 256K /pebs
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <thread>
+#include <chrono>
+#include <unordered_set>
+#include <vector>
+#include "algorithms/page_cache_algs.h"
+#include "utils.h"
+#include "pebs_ring_consumer.h"
+
+namespace fs = std::filesystem;
+
+static constexpr size_t DEFAULT_LIVE_MEM_SIZE_IN_PAGES = 256*1024;
+static constexpr size_t POP_BATCH_SIZE = 4096;
+static constexpr auto EMPTY_RING_SLEEP = std::chrono::milliseconds(1);
+
+static const std::string LIVE_STATS_FN = "live_stats.csv";
+static const std::string HOT_COLD_FN = "hot_cold.txt";
+
+struct LiveArgs {
+    std::string ring_name;
+    page_cache_algs::type alg = page_cache_algs::ARC_t;
+    untracked_eviction::type untracked_eviction_alg = untracked_eviction::FIFO;
+    size_t mem_size_in_pages = DEFAULT_LIVE_MEM_SIZE_IN_PAGES;
+    uint64_t report_period_ns = 1000ul*1000*1000;
+    std::string data_save_dir = "results/live";
+
+    LiveArgs(int argc, char* argv[]) {
+        int i = 1;
+        while (i < argc) {
+            const std::string arg(argv[i++]);
+            if ((arg == "-a" || arg == "--alg") && i < argc) {
+                const auto t = page_cache_algs::alg_name_to_type(argv[i++]);
+                if (!t) {
+                    std::cerr << "Unknown algorithm: " << argv[i-1] << std::endl;
+                    exit(-1);
+                }
+                alg = *t;
+            } else if ((arg == "-u" || arg == "--untracked-eviction") && i < argc) {
+                const std::string u(argv[i++]);
+                if (u == untracked_eviction::get_prefix(untracked_eviction::FIFO)) untracked_eviction_alg = untracked_eviction::FIFO;
+                else if (u == untracked_eviction::get_prefix(untracked_eviction::RANDOM)) untracked_eviction_alg = untracked_eviction::RANDOM;
+                else {
+                    std::cerr << "Unknown untracked eviction: " << u << std::endl;
+                    exit(-1);
+                }
+            } else if (arg == "-m" && i < argc) {
+                mem_size_in_pages = parseMemoryString(argv[i++]);
+            } else if ((arg == "-i" || arg == "--interval") && i < argc) {
+                report_period_ns = std::stoull(argv[i++])*1000*1000;
+            } else if (arg == "--data-save-dir" && i < argc) {
+                data_save_dir = argv[i++];
+            } else if (i == argc) {
+                ring_name = arg;
+            } else {
+                std::cerr << "Invalid argument: " << arg << std::endl;
+                exit(-1);
+            }
+        }
+        if (ring_name.empty() || ring_name[0] != '/') {
+            std::cerr << "Missing argument: ring name (/NAME, as given to custom_perf -p)" << std::endl;
+            exit(-1);
+        }
+        if (mem_size_in_pages == 0 || report_period_ns == 0) {
+            std::cerr << "Memory size and report interval must be positive" << std::endl;
+            exit(-1);
+        }
+        fs::create_directories(data_save_dir);
+        data_save_dir = fs::absolute(data_save_dir).lexically_normal().string() + '/';
+    }
+};
+
+struct LiveStats{
+    uint64_t samples = 0, pfaults = 0, evictions = 0;
+};
+
+// Hot: what the policy currently keeps in memory ; cold: what it evicted since the last report and wasn't referenced since
+static void report(std::ofstream& stats_f, std::ofstream& hot_cold_f, GenericAlgorithm& alg, std::unordered_set<page_t>& cold,
+                   uint64_t time, const LiveStats& stats, uint64_t dropped){
+    const auto hot = alg.get_page_cache_copy();
+    stats_f << time << ',' << stats.samples << ',' << stats.pfaults << ',' << stats.evictions << ',' << dropped << ','
+            << hot->size() << ',' << cold.size() << '\n';
+    stats_f.flush();
+    hot_cold_f << std::dec << time << " hot " << std::hex;
+    for(auto page : *hot) hot_cold_f << page << ',';
+    hot_cold_f << '\n' << std::dec << time << " cold " << std::hex;
+    for(auto page : cold) hot_cold_f << page << ',';
+    hot_cold_f << '\n';
+    hot_cold_f.flush();
+    std::cout << alg.name() << " - t=" << time << " samples=" << stats.samples << " pfaults=" << stats.pfaults
+              << " hot=" << hot->size() << " cold=" << cold.size() << " dropped=" << dropped << std::endl;
+    cold.clear();
+}
+
+int main(int argc, char* argv[]) {
+    const LiveArgs args(argc, argv);
+    auto alg = page_cache_algs::get_alg(args.alg,args.untracked_eviction_alg,args.mem_size_in_pages);
+
+    std::ofstream stats_f(args.data_save_dir + LIVE_STATS_FN, std::ios_base::out | std::ios_base::trunc);
+    std::ofstream hot_cold_f(args.data_save_dir + HOT_COLD_FN, std::ios_base::out | std::ios_base::trunc);
+    if(!stats_f.is_open() || !hot_cold_f.is_open()){
+        std::cerr << "Couldn't create output files in " << args.data_save_dir << std::endl;
+        return -1;
+    }
+    stats_f << "time,samples,pfaults,evictions,dropped,hot,cold\n";
+
+    auto* ring = wait_for_ring(args.ring_name);
+    if(ring == nullptr) return -1;
+    std::cout << "Consuming " << args.ring_name << " with " << alg->name() << ", " << parseMemorySize(args.mem_size_in_pages)
+              << " pages" << std::endl;
+
+    std::vector<pebs_ring_record> batch(POP_BATCH_SIZE);
+    std::unordered_set<page_t> cold;
+    LiveStats stats;
+    uint64_t next_report = 0, last_time = 0;
+    while(true){
+        const auto n = pebs_ring_pop(ring,batch.data(),batch.size());
+        if(n == 0){
+            // `producer_done` is set after the last push: once seen, an empty ring really is the end
+            if(__atomic_load_n(&ring->producer_done,__ATOMIC_ACQUIRE) && __atomic_load_n(&ring->head,__ATOMIC_ACQUIRE) == ring->tail){
+                break;
+            }
+            std::this_thread::sleep_for(EMPTY_RING_SLEEP);
+            continue;
+        }
+        for(size_t i = 0; i < n; i++){
+            const auto& record = batch[i];
+            // Report on the samples' clock rather than ours, so that reports don't depend on how far behind we are
+            if(next_report == 0) next_report = record.time + args.report_period_ns;
+            while(record.time >= next_report){
+                report(stats_f,hot_cold_f,*alg,cold,next_report,stats,__atomic_load_n(&ring->dropped,__ATOMIC_RELAXED));
+                next_report += args.report_period_ns;
+            }
+            last_time = record.time;
+            const auto page_base = page_start_from_mem_address(record.addr);
+            stats.samples++;
+            if(alg->is_page_fault(page_base)) stats.pfaults++;
+            cold.erase(page_base);
+            auto maybe_evicted = alg->consume(page_base,true);
+            if(maybe_evicted != std::nullopt){
+                stats.evictions++;
+                cold.insert(maybe_evicted.value());
+            }
+        }
+    }
+    report(stats_f,hot_cold_f,*alg,cold,last_time,stats,__atomic_load_n(&ring->dropped,__ATOMIC_RELAXED));
+
+    pebs_ring_close(ring);
+    shm_unlink(args.ring_name.c_str()); // custom_perf leaves it to us, see `close_trace_output`
+    std::cout << "Producer finished, exiting." << std::endl;
+    return 0;
+}
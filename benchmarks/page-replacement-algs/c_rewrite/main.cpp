@@ -6,10 +6,15 @@
 #include <regex>
 #include "nlohmann/json.hpp"
 #include "algorithms/LRU_K.h"
-#include "algorithms/CLOCK.h"
-#include "algorithms/ARC.h"
-#include "algorithms/CAR.h"
-#include "algorithms/LRU.h"
+#include "algorithms/page_cache_algs.h"
+#include "utils.h"
+#include "TraceReader.h"
+#include "HyperLogLog.h"
+#include "TraceProfile.h"
+#include "TraceCatalog.h"
+#include "TracePhases.h"
+#include "TraceStream.h"
+#include "TraceContainer.h"
 //Threading
 #include <thread>
 #include <barrier>
@@ -20,10 +25,7 @@
 #include <random>
 #include "tests/test.h"
 #include <unordered_set>
-
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <sys/mman.h>
+#include <unistd.h>
 
 using json = nlohmann::json;
 namespace fs = std::filesystem;
@@ -36,10 +38,6 @@ static constexpr size_t page_cache_size = 8*1024*1024; // ~ 128 KB mem
 #else
 static constexpr size_t max_page_cache_size = 256*1024; // ~ 128 KB mem
 #endif
-static constexpr size_t TEXT_LINE_SIZE_BYTES = 16; // "W0x7fffffffd9a8\n"*1 (===sizeof(char))
-static constexpr size_t BIN_ADDR_BYTES = 8;
-static constexpr size_t BIN_RW_BYTES = 1;
-static constexpr size_t BIN_LINE_SIZE_BYTES = BIN_ADDR_BYTES+BIN_RW_BYTES; // "W0x7fffffffd9a8\n"*1 (===sizeof(char))
 
 static const size_t max_num_threads = std::thread::hardware_concurrency();
 static const size_t num_array_comp_threads = (max_num_threads > 16 ? max_num_threads/4 : 2);
@@ -49,58 +47,6 @@ static double round_to_precision(double f, uint8_t nd){
     return std::round(f*tens)/tens;
 }
 
-size_t parseMemoryString(const std::string& memoryString) {
-    std::string strippedString = memoryString;
-    strippedString.erase(std::remove_if(strippedString.begin(), strippedString.end(), ::isspace), strippedString.end());
-
-    size_t value = 0;
-    size_t multiplier = 1;
-
-    std::istringstream iss(strippedString);
-    iss >> value;
-
-    char unitChar;
-    if (iss >> unitChar) {
-        switch (unitChar) {
-            case 'B':
-                multiplier = 1;
-                break;
-            case 'K':
-                multiplier = 1024;
-                break;
-            case 'M':
-                multiplier = 1024 * 1024;
-                break;
-            case 'G':
-                multiplier = 1024 * 1024 * 1024;
-                break;
-            case 'T':
-                multiplier = static_cast<size_t>(1024) * 1024 * 1024 * 1024;
-                break;
-            default:
-                throw std::invalid_argument("Invalid memory unit: " + strippedString);
-        }
-    } else {
-        throw std::invalid_argument("Invalid memory string: " + strippedString);
-    }
-
-    return value * multiplier;
-}
-
-static std::string parseMemorySize(size_t num) {
-    const auto units = std::array{"B", "KB", "MB", "GB", "TB"};
-    size_t unitIndex = 0;
-
-    while (num >= 1024 && unitIndex < (units.size() - 1)) {
-        num /= 1024;
-        unitIndex++;
-    }
-
-    std::ostringstream oss;
-    oss << num << units[unitIndex];
-    return oss.str();
-}
-
 struct Args {
     bool ratio_realistic = false;
     std::string db_file = "db.json";
@@ -111,7 +57,17 @@ struct Args {
     bool additional_precision_only = false;
     bool multi_run_addition_precision = false;
     bool db_only = false;
+    bool approx = false;
+    bool phases = false;
+    bool stream = false;
+    MappingHints map_hints;
+    bool huge_pages = false;
+    std::string pack_path;
+    uint64_t skip = 0;
+    std::optional<uint64_t> warm;
     size_t mem_size_in_pages = 0;
+    ghost_directory::type ghosts = ghost_directory::EXACT;
+    std::vector<page_cache_algs::type> algs{page_cache_algs::defaults.begin(),page_cache_algs::defaults.end()};
 
     Args(int argc, char* argv[]) {
         int i = 1;
@@ -133,8 +89,64 @@ struct Args {
                 multi_run_addition_precision = true;
             }else if(arg=="--db-only"){
                 db_only = true;
+            } else if(arg=="--approx"){
+                approx = true;
+            } else if(arg=="--phases"){
+                phases = true;
+            } else if(arg=="--stream"){
+                // The simulations share one sequential read of the trace. Finding its phases (`--phases`), or OPT's next
+                // uses if they aren't cached next to it yet, still map it and read it all once beforehand. Compressed
+                // traces, which are inflated in full once mapped, are refused then, and until they're characterized
+                stream = true;
+            } else if(arg=="--map" && i < argc){
+                // E.g. `--map seq,huge,populate`
+                std::stringstream hints(argv[i++]);
+                for(std::string hint; std::getline(hints,hint,',');){
+                    if(hint == "seq") map_hints.sequential = true;
+                    else if(hint == "huge") map_hints.huge_pages = true;
+                    else if(hint == "populate") map_hints.populate = true;
+                    else{
+                        std::cerr << "Unknown mapping hint (seq, huge or populate): " << hint << std::endl;
+                        exit(-1);
+                    }
+                }
+            } else if(arg=="--huge-pages"){
+                huge_pages = true;
+            } else if(arg=="--algs" && i < argc){
+                // E.g. `--algs lru,s3fifo,opt`, or `--algs all`
+                const std::string names(argv[i++]);
+                algs.clear();
+                if(names == "all") algs.assign(page_cache_algs::all.begin(),page_cache_algs::all.end());
+                std::stringstream ss(names == "all" ? "" : names);
+                for(std::string name; std::getline(ss,name,',');){
+                    const auto t = page_cache_algs::alg_name_to_type(name,true);
+                    if(!t){
+                        std::cerr << "Unknown policy: " << name << " ; known ones:";
+                        for(auto known : page_cache_algs::all) std::cerr << " " << page_cache_algs::type_to_alg_name(known);
+                        std::cerr << std::endl;
+                        exit(-1);
+                    }
+                    if(std::find(algs.begin(),algs.end(),*t) == algs.end()) algs.push_back(*t);
+                }
+                if(algs.empty()){
+                    std::cerr << "No policy given to --algs" << std::endl;
+                    exit(-1);
+                }
+            } else if(arg=="--pack" && i < argc) {
+                pack_path = argv[i++];
+            } else if(arg=="--skip" && i < argc) {
+                skip = std::stoull(argv[i++]);
+            } else if(arg=="--warm" && i < argc) {
+                warm = std::stoull(argv[i++]);
             } else if(arg=="-m") {
                 mem_size_in_pages = parseMemoryString(argv[i++]);
+            } else if(arg=="--ghosts" && i < argc) {
+                const auto t = ghost_directory::prefix_to_type(argv[i++]);
+                if (!t) {
+                    std::cerr << "Unknown ghost directory (list, exact or bloom): " << argv[i-1] << std::endl;
+                    exit(-1);
+                }
+                ghosts = *t;
             }
             else if (i == argc) {
                 mem_trace_path = arg;
@@ -219,79 +231,195 @@ struct Args {
     };
 };
 
+static void profile_trace(const TraceReader& trace, TraceProfiler& profiler){
+    trace.for_each([&profiler](const TraceRecord& record){profiler.consume(page_start_from_mem_address(record.address));});
+}
+
+static json profile_to_json(const TraceProfile& profile){
+    std::vector<double> miss_ratios;
+    for(auto r : profile.lru_miss_ratio_log2()) miss_ratios.push_back(round_to_precision(r,4));
+    return {{"sampling_rate", std::ldexp(1.,-static_cast<int>(profile.sampling_shift))}, {"records", profile.records},
+            {"cold_misses", profile.cold_misses}, {"reuse_distance_log2", profile.reuse_distance_log2}, {"lru_miss_ratio_log2", miss_ratios},
+            {"wss_window", profile.wss_window}, {"wss", profile.wss}, {"popularity_log2", profile.popularity_log2},
+            {"zipf_alpha", round_to_precision(profile.zipf_alpha,4)}, {"zipf_r2", round_to_precision(profile.zipf_r2,4)}};
+}
+
+// db.json -> db.profile.json
+static std::string profile_file_of(const std::string& db_file){
+    return fs::path(db_file).replace_extension(".profile.json").string();
+}
+
+struct TraceCharacterization{
+    uint64_t loads = 0, stores = 0;
+    size_t n_unique = 0;
+};
+
+// One record-aligned chunk of the trace per core. Exact: each thread spreads its pages over one set per thread by hash,
+// then thread i merges every thread's i-th set, so that no page is in two merged sets and their sizes add up.
+// Approximate: a HyperLogLog sketch per thread, merged at the end.
+// The profile, if asked for, needs the accesses in order: it's computed by its own thread meanwhile
+static TraceCharacterization characterize_trace(const TraceReader& trace, bool approx, TraceProfiler* profiler){
+    std::jthread profiling;
+    if(profiler != nullptr) profiling = std::jthread(profile_trace,std::cref(trace),std::ref(*profiler));
+    const size_t n_threads = std::max<size_t>(max_num_threads,1);
+    std::vector<TraceCharacterization> per_thread(n_threads);
+    if(approx){
+        std::vector<HyperLogLog<>> sketches(n_threads);
+        trace.for_each_chunk_parallel(n_threads,[&](size_t t, size_t from, size_t to){
+            auto& c = per_thread[t];
+            trace.for_each([&](const TraceRecord& record){
+                c.loads += record.is_load;
+                c.stores += !record.is_load;
+                sketches[t].insert(page_start_from_mem_address(record.address));
+            },from,to);
+        });
+        for(size_t t = 1; t < n_threads; t++) sketches[0].merge(sketches[t]);
+        per_thread[0].n_unique = sketches[0].estimate();
+    }
+    else{
+        std::vector<std::vector<std::unordered_set<page_t>>> shards(n_threads,std::vector<std::unordered_set<page_t>>(n_threads));
+        const auto shard_of = [n_threads](page_t page){
+            return static_cast<size_t>(static_cast<__uint128_t>((page >> 12)*0x9E3779B97F4A7C15ull)*n_threads >> 64);
+        };
+        trace.for_each_chunk_parallel(n_threads,[&](size_t t, size_t from, size_t to){
+            auto& c = per_thread[t];
+            trace.for_each([&](const TraceRecord& record){
+                c.loads += record.is_load;
+                c.stores += !record.is_load;
+                const auto page = page_start_from_mem_address(record.address);
+                shards[t][shard_of(page)].insert(page);
+            },from,to);
+        });
+        std::vector<std::jthread> mergers;
+        for(size_t i = 0; i < n_threads; i++){
+            mergers.emplace_back([&shards,&per_thread,n_threads,i](){
+                auto& merged = shards[0][i];
+                for(size_t t = 1; t < n_threads; t++){
+                    merged.merge(shards[t][i]);
+                    shards[t][i] = {};
+                }
+                per_thread[i].n_unique = merged.size();
+                merged = {};
+            });
+        }
+    }
+    TraceCharacterization total;
+    for(const auto& c : per_thread){
+        total.loads += c.loads;
+        total.stores += c.stores;
+        total.n_unique += c.n_unique;
+    }
+    return total;
+}
+
+// db.json -> db.catalog
+static std::string catalog_file_of(const std::string& db_file){
+    return fs::path(db_file).replace_extension(".catalog").string();
+}
+
+static json read_json_file(const std::string& file){
+    json j{};
+    if(!fs::exists(file)) return j;
+    std::ifstream f(file);
+    try{
+        f >> j;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << " Couldn't parse JSON data from " << file << ", ignoring it" << std::endl;
+        j = json{};
+    }
+    return j;
+}
+
+// Written aside and renamed, so that the Python tools never read half of it
+static void write_json_file(const std::string& file, const json& j){
+    const std::string tmp_file = file + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream f(tmp_file, std::ios_base::out | std::ios_base::trunc);
+        if(!f.is_open() || !(f << j.dump(0))){
+            std::cerr << "Couldn't write " << file << std::endl;
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp_file,file,ec);
+    if(ec) std::cerr << "Couldn't write " << file << ": " << ec.message() << std::endl;
+}
+
+// The JSON files a catalog replaces, for the traces still as they were (the files didn't say how they were then)
+static void import_json_db(TraceCatalog& catalog, const std::string& db_file){
+    for(const auto& [file,k] : {std::pair{db_file,TraceCatalog::CHARACTERIZATION},std::pair{profile_file_of(db_file),TraceCatalog::PROFILE}}){
+        const auto entries = read_json_file(file);
+        if(!entries.is_object()) continue;
+        for(const auto& [trace_path,entry] : entries.items()){
+            if(const auto key = TraceCatalog::key_of(trace_path)) catalog.insert(*key,k,entry.dump());
+        }
+    }
+}
+
+// db.json and db.profile.json, from the latest record of each trace
+static void export_json_db(TraceCatalog& catalog, const std::string& db_file){
+    json db = json::object(), profiles = json::object();
+    catalog.locked([&](){
+        catalog.for_each([&](const TraceCatalog::Key& key, TraceCatalog::kind k, const std::string& payload){
+            (k == TraceCatalog::CHARACTERIZATION ? db : profiles)[key.trace_path] = json::parse(payload,nullptr,false);
+        });
+        write_json_file(db_file,db);
+        write_json_file(profile_file_of(db_file),profiles);
+    });
+}
+
+// The characterization and profile of the trace come from the catalog next to `--db-file`, and are computed (and
+// appended to it) if it doesn't know the trace as it is now. db.json and db.profile.json are exported from it then
 std::unordered_map<std::string, json> populate_or_get_db(const Args& args) {
-    bool in_file;
-    std::ios_base::openmode mode;
-    if (fs::exists(args.db_file)) {
-        mode = std::ios_base::in | std::ios_base::out;
-        in_file = true;
-    } else {
-        mode = std::ios_base::out | std::ios_base::trunc;
-        in_file = false;
-    }
-    std::fstream dbf(fs::absolute(args.db_file).lexically_normal().string(), mode);
-    if (!dbf.is_open()) {
+    const std::string full_path = args.mem_trace_path;
+    TraceCatalog catalog(catalog_file_of(args.db_file));
+    if (!catalog.valid()) {
         std::cerr << "Failed to open db file" << std::endl;
         exit(-1);
     }
-    json db{};
-    if (in_file) {
-        try {
-            dbf >> db;
-        } catch (const std::exception& e) {
-            std::cerr << e.what() << " Couldn't parse JSON data from DB, exiting..." << std::endl;
+    if (catalog.empty()) import_json_db(catalog,args.db_file);
+    const auto key = TraceCatalog::key_of(full_path);
+    if (!key) {
+        std::cerr << "Failed to open memory trace file" << std::endl;
+        exit(-1);
+    }
+    auto characterization = catalog.find(*key,TraceCatalog::CHARACTERIZATION);
+    auto profile = catalog.find(*key,TraceCatalog::PROFILE);
+    // An `--approx` run's estimate of the unique pages doesn't do for an exact one, which then supersedes it
+    const bool approx_for_exact = characterization && !args.approx &&
+                                  json::parse(*characterization,nullptr,false).value("n_unique_approx",false);
+    if (approx_for_exact) characterization.reset();
+
+    if (!characterization || !profile) {
+        if (args.stream && trace_container::read_header(full_path)) {
+            std::cerr << "Characterizing a compressed trace inflates it in full, which --stream is meant to avoid: "
+                         "characterize it once without --stream (e.g. `--db-only`)" << std::endl;
             exit(-1);
         }
-    }
-    const std::string full_path = args.mem_trace_path;
-    in_file = db.contains(full_path);
-    if (!in_file) {
-        std::ios::openmode mt_mode = std::ios::in;
-        if(!args.text_trace_format) mt_mode |= std::ios::binary;
-        std::ifstream mtf(full_path,mt_mode);
-        if (!mtf.is_open()) {
+        const auto opened = trace_container::open_trace(full_path,args.text_trace_format,args.map_hints);
+        const TraceReader& trace = *opened;
+        if (!trace.valid()) {
             std::cerr << "Failed to open memory trace file" << std::endl;
             exit(-1);
         }
-        uint64_t lds = 0, strs = 0;
-        std::string line;
-
-
-        std::function<bool(std::string&)> read;
-        std::function<std::pair<uint8_t,uint64_t>(std::string&)> parse;
-
-        if(args.text_trace_format) {
-            read = [&mtf](std::string &line) { return bool(std::getline(mtf, line)); };
-            parse = [](std::string &line){
-                const uint8_t is_load = line[0]=='R';
-                const uint64_t mem_address = std::stoull(line.substr(1), nullptr, 16);
-                return std::pair{is_load,mem_address};
-            };
-        }else {
-            read = [&mtf](std::string &line) { return bool(mtf.read(&line[0], BIN_LINE_SIZE_BYTES)); };
-            parse = [](std::string &line){
-                const uint8_t is_load = line[0]==0;
-                const uint64_t mem_address = 0;
-                memcpy((void *) &mem_address, &line[1], sizeof(uint64_t));
-                return std::pair{is_load,mem_address};
-            };
-        }
-
-        std::unordered_set<page_t> all_pages;
-        while (read(line)) {
-            auto[is_load,address] = parse(line);
-            if (is_load) {
-                lds += 1;
-            } else {
-                strs += 1;
-            }
-            all_pages.insert(page_start_from_mem_address(address));
+        std::optional<TraceProfiler> profiler;
+        if(!profile) profiler.emplace(trace.estimated_records());
+        if (!characterization) {
+            const auto c = characterize_trace(trace,args.approx,profiler ? &*profiler : nullptr);
+            json entry = {{"loads", c.loads}, {"stores", c.stores}, {"ratio", round_to_precision(static_cast<double>(c.loads)/static_cast<double>(c.stores),4)},
+                          {"count", c.loads + c.stores},{"n_unique",c.n_unique}};
+            if(args.approx) entry["n_unique_approx"] = true;
+            characterization = entry.dump();
+            catalog.insert(*key,TraceCatalog::CHARACTERIZATION,*characterization,approx_for_exact);
         }
-        db[full_path] = {{"loads", lds}, {"stores", strs}, {"ratio", round_to_precision(static_cast<double>(lds)/static_cast<double>(strs),4)}, {"count", lds + strs},{"n_unique",all_pages.size()}};
-        dbf.seekp(0);
-        dbf << db.dump(0);
+        else profile_trace(trace,*profiler);
+        if(profiler){
+            profile = profile_to_json(profiler->finish()).dump();
+            catalog.insert(*key,TraceCatalog::PROFILE,*profile);
+        }
+        export_json_db(catalog,args.db_file);
     }
-    return db;
+    return {{full_path, json::parse(*characterization)}};
 }
 
 
@@ -328,25 +456,6 @@ static constexpr size_t BUFFER_SIZE = 128*1024*1024;
 static constexpr size_t BUFFER_SIZE = 1024*1024;
 #endif
 static constexpr const int ALG_DIV_PRECISION = 3;
-namespace page_cache_algs {
-    enum type {LRU_t, GCLOCK_t, ARC_t, CAR_t, NUM_ALGS};
-    static constexpr std::array all = {LRU_t, GCLOCK_t, ARC_t, CAR_t};
-    std::unique_ptr<GenericAlgorithm> get_alg(type t,untracked_eviction::type u_t, size_t mem_size_in_pages = page_cache_size){
-        switch(t){
-            case LRU_t:
-                return std::make_unique<LRU>(mem_size_in_pages,u_t);
-            case GCLOCK_t:
-                return std::make_unique<CLOCK>(mem_size_in_pages,u_t,1);
-            case ARC_t:
-                return std::make_unique<ARC>(mem_size_in_pages,u_t);
-            case CAR_t:
-                return std::make_unique<CAR>(mem_size_in_pages,u_t);
-            default:
-                return nullptr;
-        }
-    }
-    std::string type_to_alg_name(type t){return get_alg(t,untracked_eviction::FIFO /*here FIFO doesn't matter; we just use the name*/)->name();}
-}
 
 typedef std::pair<const page_cache_algs::type,SimpleRatio> compared_t;
 typedef std::pair<compared_t,compared_t> comparison_t;
@@ -368,6 +477,7 @@ struct ThreadWorkAlgs{
     std::string save_dir = NO_STANDALONE;
     const untracked_eviction::type untracked_eviction_alg;
     const size_t mem_size_in_pages;
+    const TracePhases* phases = nullptr;
 };
 
 template<typename It>
@@ -503,9 +613,25 @@ struct AlgInThread{
     const ThreadWorkAlgs twa;
 };
 
+// What was counted in one window of the trace, extrapolated to the whole of it in stats.csv
+struct WindowCounts{
+    uint64_t seen = 0, considered_loads = 0, considered_stores = 0, pfaults = 0, considered_pfaults = 0;
+};
+
 static const std::string STATS_FN = "stats.csv";
 static const std::string DIP_BPU_FN = "dip_bpu.json";
 static const std::string DIP_MOST_IN_OUT = "dip_mio.json";
+static const std::string PHASES_FN = "phases.json";
+
+static json phases_to_json(const TracePhases& phases){
+    json windows = json::array();
+    for(const auto& w : phases.get_windows()){
+        windows.push_back({{"interval", w.interval}, {"warm_from", w.warm_from_record}, {"from", w.measure_from_record}, {"to", w.to_record},
+                           {"cluster_intervals", w.cluster_intervals}, {"scale", round_to_precision(w.scale,4)}});
+    }
+    return {{"interval_records", phases.get_interval_records()}, {"n_intervals", phases.get_n_intervals()}, {"k", phases.get_k()},
+            {"simulated_records", phases.simulated_records()}, {"measured_records", phases.measured_records()}, {"windows", windows}};
+}
 
 
 void save_to_file_compressed(const std::shared_ptr<temp_log_t>& array, const std::string& savedir, size_t number_writes) {
@@ -537,11 +663,12 @@ std::string print_kvs_vector(const std::vector<std::pair<K,V>>& map_kvs, std::fu
     return ss.str();
 }
 
+#ifdef SERVER
+template<typename Source>
+#endif
 static void simulate_one(
 #ifdef SERVER
-        const char* mmap_file_address,
-        const size_t total_length,
-        bool text_trace_format,
+        Source& trace,
 #else
         std::barrier<>& it_barrier,
 #endif
@@ -558,37 +685,12 @@ static void simulate_one(
 #ifndef SERVER
     while(true){
 #else
-    size_t at = 0;
-    std::function<std::tuple<bool,uint8_t,uint64_t>()> parse;
-    if(text_trace_format){
-        parse = [mmap_file_address,&at,tid](){
-            auto is_load = mmap_file_address[at++] == 'R';
-            char* str_end = nullptr;
-            auto address = std::strtoull(mmap_file_address+at,&str_end,16);
-            bool success = true;
-            if (errno == ERANGE)
-            {
-                errno = 0;
-                std::cout << tid << " - range error, exiting";
-                success = false;
-            }
-            at += (str_end+1-(mmap_file_address+at)); //`+1` skips the \n
-            return std::tuple{success,is_load,address};
-        };
-    }
-    else{
-        parse = [mmap_file_address,&at](){
-            uint8_t temp = mmap_file_address[at++];
-            const auto is_load = temp == 0;
-            uint64_t mem_address = 0;
-            memcpy((void *) &mem_address, mmap_file_address+at, sizeof(uint64_t));
-            at += sizeof(uint64_t);
-            return std::tuple{true,is_load,mem_address};
-        };
-    }
+    const auto& phases = *ait.twa.phases;
+    TracePhases::Cursor<Source> cursor(phases,trace);
+    std::vector<WindowCounts> window_counts(phases.get_windows().size());
     //auto should_break = (ait.twa.alg_info.second.num== ait.twa.alg_info.second.denom) && (ait.twa.alg_info.first == page_cache_algs::LRU_t) && (ait.twa.save_dir.find("random") != std::string::npos);
 
-    const size_t seen_period = (total_length/BIN_LINE_SIZE_BYTES)/(DATA_GRANULARITY);
+    const size_t seen_period = phases.measured_records()/(DATA_GRANULARITY);
     std::cout<<"Using seen_period" << seen_period  << std::endl;
     size_t running_seen_period = seen_period;
     size_t seen_period_index = 0;
@@ -605,7 +707,7 @@ static void simulate_one(
     const size_t print_stats_period = 500'000'000;
     size_t running_print_stats_period = print_stats_period;
 
-    while(at < total_length){
+    while(!cursor.done()){
 #endif
 #ifndef SERVER
         //Wait to be notified you can go ; === value to be 0
@@ -618,17 +720,30 @@ static void simulate_one(
             break;
         }
 #endif
-        for(size_t i = 0;i<BUFFER_SIZE && at < total_length;i++){ // preserve for loop's behavior of saving every BUFFER_SIZE iterartions
+        for(size_t i = 0;i<BUFFER_SIZE && !cursor.done();i++){ // preserve for loop's behavior of saving every BUFFER_SIZE iterartions
 #ifndef SERVER
             auto page_base = page_start_from_mem_address(mem_address_buf[i]);
             auto is_load = mem_reqtype_buf[i];
+            auto& counts = window_counts[0];
+            ait.alg->set_trace_position(seen);
 #else
-            const auto[parse_success,is_load,address] = parse();
-            if(!parse_success) break;
-            auto page_base = page_start_from_mem_address(address);
+            TraceRecord record{};
+            if(!cursor.next(record)) break;
+            const auto is_load = record.is_load;
+            auto page_base = page_start_from_mem_address(record.address);
+            ait.alg->set_trace_position(cursor.position());
+            if(!cursor.measured()){
+                // Fast-forwarding to a window: the policy makes the same decisions, but nothing is recorded
+                const auto pfault = ait.alg->is_page_fault(page_base);
+                if(ait.considerator->should_consider()) (void)ait.alg->consume(page_base,true);
+                else if(pfault) (void)ait.alg->consume(page_base,false);
+                continue;
+            }
+            auto& counts = window_counts[cursor.window_index()];
 #endif
 
             seen += 1;
+            counts.seen++;
             if(seen == running_seen_period){
                 running_seen_period+=seen_period;
 
@@ -683,7 +798,7 @@ static void simulate_one(
 #ifndef SERVER
                 ",i=" << i;
 #else
-                ",at=" << at;
+                ",at=" << cursor.offset();
 #endif
                 std::cout<<ss.str()<<std::endl;
             }
@@ -692,6 +807,7 @@ static void simulate_one(
             if (pfault) {
                 ait.cumulative_unique_pages_between_page_faults+=running_unique_pages_between_pfaults.size();
                 ait.n_pfaults++;
+                counts.pfaults++;
                 running_unique_pages_between_pfaults.clear();
                 running_page_ins_outs.try_emplace(page_base,0,0);
                 running_page_ins_outs[page_base].first++;
@@ -706,11 +822,14 @@ static void simulate_one(
                 // }
                 if(is_load){
                     ait.considered_loads++;
+                    counts.considered_loads++;
                 }else{
                     ait.considered_stores++;
+                    counts.considered_stores++;
                 }
                 if(pfault){
                     ait.considered_pfaults++;
+                    counts.considered_pfaults++;
                 }
 
                 auto maybe_evicted = ait.alg->consume(page_base,true);
@@ -738,8 +857,11 @@ static void simulate_one(
 
         std::ofstream ofs(ait.twa.save_dir + STATS_FN, std::ios_base::out | std::ios_base::trunc);
         ofs << "seen,considered_l,considered_s,pfaults,considered_pfaults\n"
-            << seen << SEPARATOR << ait.considered_loads << SEPARATOR << ait.considered_stores << SEPARATOR
-            << ait.n_pfaults << SEPARATOR << ait.considered_pfaults << "\n";
+            << phases.extrapolate(window_counts,&WindowCounts::seen) << SEPARATOR
+            << phases.extrapolate(window_counts,&WindowCounts::considered_loads) << SEPARATOR
+            << phases.extrapolate(window_counts,&WindowCounts::considered_stores) << SEPARATOR
+            << phases.extrapolate(window_counts,&WindowCounts::pfaults) << SEPARATOR
+            << phases.extrapolate(window_counts,&WindowCounts::considered_pfaults) << "\n";
         ofs.close();
 
         n_writes++;
@@ -767,80 +889,36 @@ static void simulate_one(
 }
 
 
-static bool fill_array_and_updated_page_set(std::ifstream& f,std::unordered_set<page_t>& unique_pages,bool text_trace_format){
+static bool fill_array_and_updated_page_set(TraceReader::Cursor& cursor,std::unordered_set<page_t>& unique_pages){
     size_t i = 0;
-    std::string line;
-    line.resize(BIN_LINE_SIZE_BYTES);
-
-    std::function<bool(std::string&)> read;
-    std::function<std::pair<uint8_t,uint64_t>(std::string&)> parse;
-
-    if(text_trace_format) {
-        read = [&f](std::string &line) { return bool(std::getline(f, line)); };
-        parse = [](std::string &line){
-            const uint8_t is_load = line[0]=='R';
-            const uint64_t mem_address = std::stoull(line.substr(1), nullptr, 16);
-            return std::pair{is_load,mem_address};
-        };
-    }else {
-        read = [&f](std::string &line) { return bool(f.read(&line[0], BIN_LINE_SIZE_BYTES)); };
-        parse = [](std::string &line){
-            const uint8_t is_load = line[0]==0;
-            const uint64_t mem_address = 0;
-            memcpy((void *) &mem_address, &line[1], sizeof(uint64_t));
-            return std::pair{is_load,mem_address};
-        };
-    }
-
-
-    for(; i<BUFFER_SIZE && read(line); i++){
-        auto parsed = parse(line);
-        const page_t page_start = page_start_from_mem_address(parsed.second);
+    TraceRecord record{};
+    for(; i<BUFFER_SIZE && cursor.next(record); i++){
+        const page_t page_start = page_start_from_mem_address(record.address);
         unique_pages.insert(page_start);
         mem_address_buf[i] = (uint64_t)page_start;
-        mem_reqtype_buf[i] = parsed.first;
+        mem_reqtype_buf[i] = record.is_load;
     }
     return i==BUFFER_SIZE;
 }
 
-//#define BIGSKIP 7228143
-#ifdef BIGSKIP
-#define RELAX_NUM_LINES 1000
-#endif
-
-static void reader_thread(std::string path_to_mem_trace,std::string parent_dir, bool text_trace_format){
+static void reader_thread(std::string path_to_mem_trace,std::string parent_dir, bool text_trace_format, uint64_t skip, MappingHints hints){
     const auto total_nm_processes = num_ready;
     const std::string id_str = "READER PROCESS -";
-    std::ios::openmode mode = std::ios::out;
-    if(!text_trace_format) mode |= std::ios::binary;
-    std::ifstream f(path_to_mem_trace,mode);
+    const auto opened = trace_container::open_trace(path_to_mem_trace,text_trace_format,hints);
+    const TraceReader& trace = *opened;
     std::unordered_set<page_t> unique_pages{};
 #ifdef SERVER
     auto stop_condition = [](size_t read){return read>510'000'000;};
 #else
     auto stop_condition = [](size_t read){return read>520'000'000;};
 #endif
-    if (f.is_open()) {
-#ifdef BIGSKIP
-        //After analysis, a new unique page for this benchmark arrives every ~2000 mem accesses before access number
-        // 7228143 and every 50 accesses afterwards. To skip this big uninteresting area of 7 million memory accesses,
-        // we simply seek a little ahead in the file
-        auto left_to_skip = (BIGSKIP-RELAX_NUM_LINES)*(text_trace_format ? TEXT_LINE_SIZE_BYTES : BIN_LINE_SIZE_BYTES;
-        f.seekg(0,std::ios_base::end);
-        std::cout<<"Total size=" <<f.tellg()<<std::endl;
-        f.seekg(0,std::ios_base::beg);
-        std::cout<<f.tellg()<<std::endl;
-        while(left_to_skip!=0) {
-            auto skip_ammount = static_cast<long>(std::min(static_cast<unsigned long long>(std::numeric_limits<long>::max()),left_to_skip));
-            f.seekg(skip_ammount, std::ios_base::beg);
-            left_to_skip-=skip_ammount;
-        }
-        std::cout<<f.tellg()<<std::endl;
-#endif
+    if (trace.valid()) {
+        auto cursor = trace.cursor(trace.skip(0,skip));
+        if(skip != 0) std::cout<<"Total size=" <<trace.size()<<", starting at "<<cursor.offset()<<std::endl;
         size_t n = 0,total_read = 0;
         while(!stop_condition(total_read)){
             //Get new data
-            if(fill_array_and_updated_page_set(f,unique_pages,text_trace_format)){
+            if(fill_array_and_updated_page_set(cursor,unique_pages)){
                 total_read+=BUFFER_SIZE;
             }
             else{
@@ -861,7 +939,6 @@ static void reader_thread(std::string path_to_mem_trace,std::string parent_dir,
                 it_cv.wait(lk,[total_nm_processes](){return num_ready==total_nm_processes;});
             }
         }
-        f.close();
     }
     continue_running = false;
     {
@@ -879,14 +956,31 @@ static void reader_thread(std::string path_to_mem_trace,std::string parent_dir,
 
 template <typename T>
 requires std::is_base_of_v<SimpleRatio,typename T::value_type>
-void start_and_run_processes(const Args &args, const std::string &base_dir_posix,const __off_t &length, const char *&addr,
-                             const T &div_iterable) {
-    const size_t num_comp_processes = div_iterable.size() * page_cache_algs::NUM_ALGS * 2;
+void start_and_run_processes(const Args &args, const std::vector<page_cache_algs::type> &algs, const std::string &base_dir_posix,
+                             const TraceReader &trace, const TracePhases &phases, const T &div_iterable) {
+    const size_t num_comp_processes = div_iterable.size() * algs.size() * untracked_eviction::all.size();
 
     //Setup shared Synchronisation and Memory
     num_ready = num_comp_processes;
     std::barrier it_barrier(static_cast<long>(num_comp_processes));
 
+#ifdef SERVER
+    // Read once for all the simulations, rather than mapped and paged in by each of them
+    std::optional<TraceStream> stream;
+    if(args.stream){
+        stream.emplace(args.mem_trace_path,args.text_trace_format,num_comp_processes);
+        if(!stream->valid()){
+            if(!trace.valid()){
+                std::cerr << "Couldn't open the trace to stream it" << std::endl;
+                return;
+            }
+            std::cerr << "Couldn't open the trace to stream it, mapping it instead" << std::endl;
+            stream.reset();
+        }
+        else if(!stream->direct_io()) std::cout << "No O_DIRECT for the trace, streaming it through the page cache" << std::endl;
+    }
+#endif
+
     std::vector<std::jthread> all_threads{};
     all_threads.reserve(num_comp_processes);
 
@@ -894,24 +988,23 @@ void start_and_run_processes(const Args &args, const std::string &base_dir_posix
         const auto prefix = untracked_eviction::get_prefix(u_eviction_type) + "/";
         for (auto &div_ratio: div_iterable) {
             auto div = div_ratio.toDouble();
-            for (auto alg: page_cache_algs::all) {
+            for (auto alg: algs) {
                 auto path = fs::path(base_dir_posix + prefix + get_alg_div_name(alg, div));
                 fs::create_directories(path);
                 auto save_dir = fs::absolute(path).lexically_normal().string() + '/';
-                ThreadWorkAlgs t{{alg, div_ratio}, save_dir, u_eviction_type, args.mem_size_in_pages};
-                all_threads.emplace_back(simulate_one,
+                ThreadWorkAlgs t{{alg, div_ratio}, save_dir, u_eviction_type, args.mem_size_in_pages, &phases};
 #ifdef SERVER
-                                            addr, length, args.text_trace_format,
+                if(stream) all_threads.emplace_back(simulate_one<TraceStream>,std::ref(*stream),t);
+                else all_threads.emplace_back(simulate_one<const TraceReader>,std::cref(trace),t);
 #else
-                                            std::ref(it_barrier),
+                all_threads.emplace_back(simulate_one,std::ref(it_barrier),t);
 #endif
-                                         t);
             }
         }
     }
 
 #ifndef SERVER
-    std::jthread reader(reader_thread,args.mem_trace_path,base_dir_posix,args.text_trace_format);
+    std::jthread reader(reader_thread,args.mem_trace_path,base_dir_posix,args.text_trace_format,args.skip,args.map_hints);
 
         reader.join();
 #endif
@@ -921,32 +1014,63 @@ void start_and_run_processes(const Args &args, const std::string &base_dir_posix
     }
 }
 
-void start(const Args& args) {
+// `characterization`: of the trace, from the catalog
+void start(const Args& args, const json& characterization) {
+    page_cache_algs::ghosts = args.ghosts;
+    huge_pages::enabled = args.huge_pages;
+    if(args.ghosts == ghost_directory::BLOOM){
+        // Worst case: a list's pages taken but not popped yet count as well, up to as many as the list holds
+        std::cout << "Approximate ARC/CAR ghosts: up to " << ghost_directory::expected_false_positive_rate(2*args.mem_size_in_pages,args.mem_size_in_pages)*100
+                  << "% false positive ghost hits" << std::endl;
+    }
 
+    auto algs = args.algs;
+    const uint64_t records = characterization.value("count",uint64_t(0));
+    const auto container = trace_container::read_header(args.mem_trace_path);
 #ifdef SERVER
-    int fd = open(args.mem_trace_path.c_str(), O_RDONLY);
-    if (fd == -1){
-        std::cout<<"Couldn't syscall open the file"<<std::endl;
+    // Lives until all simulations are done ; only needed by OPT
+    std::unique_ptr<NextUseIndex> next_use;
+    const bool with_opt = std::find(algs.begin(),algs.end(),page_cache_algs::OPT_t) != algs.end();
+    if(with_opt && args.stream) next_use = NextUseIndex::load(args.mem_trace_path,container ? container->text_format != 0 : args.text_trace_format);
+    // Streamed, the trace is only mapped for what needs a pass over all of it before simulating
+    const char* full_pass = !args.stream ? "" : args.phases ? "its phases" : with_opt && next_use == nullptr ? "OPT's next uses" :
+                            records == 0 ? "its length" : nullptr;
+#else
+    const char* full_pass = "";
+#endif
+    if(full_pass != nullptr && args.stream && container){
+        // Mapping a container inflates all of it in memory
+        std::cerr << "Can't stream a compressed trace and read it whole for " << full_pass << ": "
+                  << (args.phases ? "run without --phases or without --stream" :
+                      "run OPT once without --stream to cache them, or leave it out of --algs") << std::endl;
         return;
     }
-
-    // obtain file size
-    struct stat sb;
-    if (fstat(fd, &sb) == -1){
-        std::cout<<"Couldn't fstat the file"<<std::endl;
-        close(fd);
-        return;
+    const auto opened = full_pass != nullptr ? trace_container::open_trace(args.mem_trace_path,args.text_trace_format,args.map_hints) :
+                        std::make_unique<TraceReader>(nullptr,0,args.text_trace_format);
+    const TraceReader& trace = *opened;
+    if (full_pass != nullptr){
+        if (!trace.valid()){
+            std::cout<<"Couldn't mmap the file"<<std::endl;
+            return;
+        }
+        std::cout<<"Successfully mmaped the mem_trace, proceeding"<<std::endl;
+        if(args.stream) std::cout << "Reading the whole trace for " << full_pass << " before streaming it" << std::endl;
     }
-    auto length = sb.st_size;
-    const char* addr = static_cast<const char*>(mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0u));
 
-    close(fd); // man 2 mmap : "After the mmap() call has returned, the file  descriptor,  fd,  can  be closed immediately without invalidating the mapping."
-    if (addr == MAP_FAILED){
-        std::cout<<"Couldn't mmap the file"<<std::endl;
-        return;
+#ifdef SERVER
+    if(with_opt && next_use == nullptr){
+        next_use = NextUseIndex::load_or_compute(args.mem_trace_path, trace);
+        if(next_use == nullptr){
+            std::cerr << "Couldn't get the next use index, skipping OPT" << std::endl;
+            std::erase(algs,page_cache_algs::OPT_t);
+        }
     }
-    std::cout<<"Successfully mmaped the mem_trace, proceeding"<<std::endl;
+    page_cache_algs::next_use = next_use.get();
 #endif
+    if(algs.empty()){
+        std::cerr << "No policy left to simulate" << std::endl;
+        return;
+    }
 
 
     constexpr std::array special_samples_div = {REALISTIC_RATIO_SAMPLED_MEM_TRACE_RATIO,AVERAGE_SAMPLE_RATIO};
@@ -958,22 +1082,34 @@ void start(const Args& args) {
 
     const std::string base_dir_posix = fs::path(args.data_save_dir).lexically_normal().string() + "/";
 
+    // E.g. `--skip 7227143 --warm 1000`: after analysis, one benchmark had a new unique page every ~2000 accesses for its first
+    // 7228143, and every 50 afterwards
+    const auto phases = args.phases ? TracePhases::analyze(trace,args.skip,args.warm) :
+                        trace.valid() ? TracePhases::whole(trace,args.skip,args.warm) : TracePhases::whole(records,args.skip,args.warm);
+    if(args.skip != 0 && !args.phases){
+        const auto& w = phases.get_windows().front();
+        std::cout << "Skipping the first " << args.skip << " accesses, fast-forwarding through " << w.measure_from_record - w.warm_from_record
+                  << " of them" << std::endl;
+    }
+    if(args.phases){
+        std::cout << "Phases: " << phases.get_k() << " clusters of " << phases.get_n_intervals() << " intervals of "
+                  << phases.get_interval_records() << " accesses, simulating " << phases.simulated_records() << "/" << trace.records()
+                  << " accesses (" << phases.measured_records() << " counted)" << std::endl;
+        fs::create_directories(base_dir_posix);
+        std::ofstream pf(base_dir_posix + PHASES_FN, std::ios_base::out | std::ios_base::trunc);
+        pf << phases_to_json(phases).dump(0);
+    }
+
 
     if(!args.additional_precision_only) {
-        start_and_run_processes(args, base_dir_posix, length, addr, samples_div);
+        start_and_run_processes(args, algs, base_dir_posix, trace, phases, samples_div);
         std::cout << std::endl <<"Finished initial read" <<std::endl;
     }
     if(args.multi_run_addition_precision || args.additional_precision_only){
         std::cout << "Starting additional info read" << std::endl;
-        start_and_run_processes(args,base_dir_posix,length,addr,additional_divs_array);
+        start_and_run_processes(args,algs,base_dir_posix,trace,phases,additional_divs_array);
     }
 
-#ifdef SERVER
-    auto ret = munmap((void *) addr, length);
-    if(ret)
-        std::cout<<"Couldn't munmap the file..."<<std::endl;
-#endif
-
     std::cout<<"Got all data!"<<std::endl;
 }
 
@@ -984,8 +1120,16 @@ size_t indexof(It start, It end, double value) { return std::distance(start, std
 
 int main(int argc, char* argv[]) {
     const Args args(argc, argv);
-    auto db = populate_or_get_db(args);
-    (void)db;
+    if(!args.pack_path.empty()){
+        const auto trace = trace_container::open_trace(args.mem_trace_path,args.text_trace_format,args.map_hints);
+        if(!trace->valid() || !trace_container::pack(*trace,args.pack_path,max_num_threads)){
+            std::cerr << "Couldn't pack the trace into " << args.pack_path << std::endl;
+            return -1;
+        }
+        std::cout << "Packed the trace into " << args.pack_path << " (" << fs::file_size(args.pack_path) << "/" << trace->size() << " bytes)" << std::endl;
+        return 0;
+    }
+    const auto db = populate_or_get_db(args);
     if(args.db_only){
         std::cout<<"Finished populating DB, exiting." << std::endl;
         return 0;
@@ -993,7 +1137,7 @@ int main(int argc, char* argv[]) {
 #if (BUILD_TYPE==0 && TESTING == 1)
     test_latest(args.mem_trace_path);
 #else
-    start(args);
+    start(args,db.at(args.mem_trace_path));
 #endif
     return 0;
 }
@@ -0,0 +1,338 @@
+// Experimental userspace pager: LD_PRELOAD'ed into a target, it registers the target's large anonymous mappings (e.g.
+// pmbench's `buf`) with userfaultfd and caps how many of their pages are resident. A handler thread resolves the
+// missing-page faults, and when the cap is reached evicts the victim chosen by a GenericAlgorithm instance, which is also
+// fed the PEBS samples custom_perf publishes (`custom_perf -p`), so that sampled policies can be measured end to end on
+// a real process.
+//
+// $ custom_perf -p /pebs -N -c 100 env LD_PRELOAD=libc_rewrite_pager.so PAGER_RING=/pebs PAGER_MEM=64K PAGER_ALG=CAR ./pmbench ...
+//
+// Configuration, through the environment:
+//  - PAGER_MEM: resident page cap, in pages (parseMemoryString format, e.g. 64K). Required, the pager is off without it
+//  - PAGER_ALG: LRU, CLOCK, ARC or CAR (default: CLOCK) ; PAGER_U: fifo or random (default: fifo)
+//  - PAGER_RING: custom_perf's ring to take the samples from (default: none, the policy only sees the faults)
+//  - PAGER_MIN_REGION: smallest mapping to register, in bytes (default: 64M)
+//  - PAGER_SWAP_DIR: where to create the (unlinked) swap file (default: /tmp). PAGER_SWAP=0 drops evicted pages'
+//    contents instead: only meaningful for targets which don't read back what they wrote
+//  - PAGER_STATS: file to append the final statistics to (default: stderr)
+//
+// Limitations: only private anonymous mmaps are registered ; a munmap'ed page stays in the policy (but not in swap)
+// until evicted ; without userfaultfd write protection (Linux < 5.7), a page written while being evicted loses the write.
+
+#include <iostream>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+#include "algorithms/page_cache_algs.h"
+#include "utils.h"
+#include "pebs_ring.h"
+
+static constexpr size_t DEFAULT_MIN_REGION_BYTES = 64ul*1024*1024;
+static constexpr int HANDLER_POLL_TIMEOUT_MS = 1;
+static constexpr size_t SAMPLES_BATCH_SIZE = 4096;
+
+namespace {
+
+struct PagerStats{
+    uint64_t faults = 0, zero_fills = 0, swap_ins = 0, evictions = 0, swap_outs = 0, wp_faults = 0;
+    uint64_t samples = 0, samples_outside = 0, eviction_errors = 0;
+};
+
+class Pager{
+public:
+    // Called with `mutex` not held, from the target's mmap
+    void register_region(void* addr, size_t len){
+        std::scoped_lock lock(mutex);
+        uffdio_register reg{};
+        reg.range = {.start=reinterpret_cast<uint64_t>(addr), .len=len};
+        reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+#ifdef UFFDIO_REGISTER_MODE_WP
+        if(write_protect) reg.mode |= UFFDIO_REGISTER_MODE_WP;
+#endif
+        if(ioctl(uffd,UFFDIO_REGISTER,&reg) == -1 && (reg.mode == UFFDIO_REGISTER_MODE_MISSING ||
+           (reg.mode = UFFDIO_REGISTER_MODE_MISSING, write_protect = false, ioctl(uffd,UFFDIO_REGISTER,&reg) == -1))){
+            perror("pager: couldn't register region");
+            return;
+        }
+        regions[reg.range.start] = reg.range.start + len;
+    }
+
+    void unregister_region(void* addr, size_t len){
+        std::scoped_lock lock(mutex);
+        const auto start = reinterpret_cast<uint64_t>(addr), end = start + len;
+        auto overlapping = regions.upper_bound(start);
+        if(overlapping != regions.begin() && std::prev(overlapping)->second > start) overlapping = std::prev(overlapping);
+        if(overlapping == regions.end() || overlapping->first >= end) return; // most munmaps: malloc's, not ours
+        // Its contents are gone: never serve them to a later mapping at the same address
+        for(auto page = page_start_from_mem_address(start); page < end; page += PAGE_SIZE){
+            auto slot = swapped.find(page);
+            if(slot != swapped.end()){
+                free_slots.push_back(slot->second);
+                swapped.erase(slot);
+            }
+        }
+        // The kernel unregisters unmapped ranges ; partially unmapped regions are forgotten whole
+        while(overlapping != regions.end() && overlapping->first < end) overlapping = regions.erase(overlapping);
+    }
+
+    bool init(){
+        const char* mem = std::getenv("PAGER_MEM");
+        if(mem == nullptr) return false;
+        size_t mem_size_in_pages;
+        try{
+            mem_size_in_pages = parseMemoryString(mem);
+        } catch(const std::invalid_argument& e){
+            std::cerr << "pager: " << e.what() << std::endl;
+            return false;
+        }
+        auto t = page_cache_algs::GCLOCK_t;
+        if(const char* alg_name = std::getenv("PAGER_ALG")){
+            auto maybe_t = page_cache_algs::alg_name_to_type(alg_name);
+            if(!maybe_t){
+                std::cerr << "pager: unknown algorithm " << alg_name << std::endl;
+                return false;
+            }
+            t = *maybe_t;
+        }
+        auto u_t = untracked_eviction::FIFO;
+        if(const char* u = std::getenv("PAGER_U"); u != nullptr && untracked_eviction::get_prefix(untracked_eviction::RANDOM) == u){
+            u_t = untracked_eviction::RANDOM;
+        }
+        if(const char* min_region = std::getenv("PAGER_MIN_REGION")) min_region_bytes = std::strtoull(min_region,nullptr,10);
+        if(const char* stats_path = std::getenv("PAGER_STATS")) stats_fn = stats_path;
+
+        uffd = static_cast<int>(syscall(SYS_userfaultfd,O_CLOEXEC | O_NONBLOCK));
+        if(uffd == -1){
+            perror("pager: userfaultfd (check vm.unprivileged_userfaultfd)");
+            return false;
+        }
+        uffdio_api api{.api=UFFD_API, .features=0, .ioctls=0};
+#ifdef UFFD_FEATURE_PAGEFAULT_FLAG_WP
+        api.features = UFFD_FEATURE_PAGEFAULT_FLAG_WP;
+#endif
+        if(ioctl(uffd,UFFDIO_API,&api) == -1){
+            api.features = 0; // older kernel, no write protection
+            if(ioctl(uffd,UFFDIO_API,&api) == -1){
+                perror("pager: UFFDIO_API");
+                close(uffd);
+                return false;
+            }
+        }
+#ifdef UFFD_FEATURE_PAGEFAULT_FLAG_WP
+        write_protect = (api.features & UFFD_FEATURE_PAGEFAULT_FLAG_WP) != 0;
+#endif
+
+        const char* swap = std::getenv("PAGER_SWAP");
+        if(swap == nullptr || std::strcmp(swap,"0") != 0){
+            const char* swap_dir = std::getenv("PAGER_SWAP_DIR");
+            std::string path = std::string(swap_dir != nullptr ? swap_dir : "/tmp") + "/pager_swap.XXXXXX";
+            swap_fd = mkstemp(path.data());
+            if(swap_fd == -1){
+                perror("pager: couldn't create swap file");
+                close(uffd);
+                return false;
+            }
+            unlink(path.c_str());
+        }
+
+        alg = page_cache_algs::get_alg(t,u_t,mem_size_in_pages);
+        if(const char* ring_name = std::getenv("PAGER_RING")) this->ring_name = ring_name;
+        return true;
+    }
+
+    [[noreturn]] void handle(){
+        in_pager_thread = true;
+        std::vector<pebs_ring_record> samples(SAMPLES_BATCH_SIZE);
+        pollfd pfd{.fd=uffd, .events=POLLIN, .revents=0};
+        while(true){
+            if(ring == nullptr && !ring_name.empty()) ring = pebs_ring_open(ring_name.c_str()); // custom_perf might not be up yet
+            poll(&pfd,1,ring_name.empty() ? -1 : HANDLER_POLL_TIMEOUT_MS);
+            uffd_msg msg{};
+            while(read(uffd,&msg,sizeof(msg)) == sizeof(msg)){
+                if(msg.event != UFFD_EVENT_PAGEFAULT) continue;
+                std::scoped_lock lock(mutex);
+                on_fault(page_start_from_mem_address(msg.arg.pagefault.address),msg.arg.pagefault.flags);
+            }
+            if(ring != nullptr){
+                const auto n = pebs_ring_pop(ring,samples.data(),samples.size());
+                std::scoped_lock lock(mutex);
+                for(size_t i = 0; i < n; i++) on_sample(page_start_from_mem_address(samples[i].addr));
+            }
+        }
+    }
+
+    void write_stats(){
+        std::scoped_lock lock(mutex);
+        std::ofstream f;
+        if(!stats_fn.empty()) f.open(stats_fn,std::ios_base::out | std::ios_base::app);
+        std::ostream& os = f.is_open() ? f : std::cerr;
+        os << "pager: alg=" << alg->name() << ",max_pages=" << alg->get_max_page_cache_size() << ",faults=" << stats.faults
+           << ",zero_fills=" << stats.zero_fills << ",swap_ins=" << stats.swap_ins << ",evictions=" << stats.evictions
+           << ",swap_outs=" << stats.swap_outs << ",wp_faults=" << stats.wp_faults << ",eviction_errors=" << stats.eviction_errors
+           << ",samples=" << stats.samples << ",samples_outside=" << stats.samples_outside << std::endl;
+    }
+
+    size_t min_region_bytes = DEFAULT_MIN_REGION_BYTES;
+    static thread_local bool in_pager_thread;
+private:
+    bool in_region(page_t page) const{
+        auto it = regions.upper_bound(page);
+        return it != regions.begin() && page < std::prev(it)->second;
+    }
+
+    void on_fault(page_t page, uint64_t flags){
+#ifdef UFFD_PAGEFAULT_FLAG_WP
+        if(flags & UFFD_PAGEFAULT_FLAG_WP){
+            // Wrote to a page while we were evicting it: it's gone by now, retrying gets a missing fault
+            stats.wp_faults++;
+            uffdio_range range{.start=page, .len=PAGE_SIZE};
+            ioctl(uffd,UFFDIO_WAKE,&range);
+            return;
+        }
+#else
+        (void)flags;
+#endif
+        if(!alg->is_page_fault(page)){
+            // Already brought in for another thread that faulted on it too: only wake this one up
+            uffdio_range range{.start=page, .len=PAGE_SIZE};
+            ioctl(uffd,UFFDIO_WAKE,&range);
+            return;
+        }
+        stats.faults++;
+        evict_if_any(alg->consume(page,false));
+        auto slot = swapped.find(page);
+        if(slot != swapped.end()){
+            alignas(PAGE_SIZE) static char buffer[PAGE_SIZE];
+            if(pread(swap_fd,buffer,PAGE_SIZE,static_cast<off_t>(slot->second)*PAGE_SIZE) != PAGE_SIZE){
+                perror("pager: couldn't read back from swap");
+            }
+            uffdio_copy copy{.dst=page, .src=reinterpret_cast<uint64_t>(buffer), .len=PAGE_SIZE, .mode=0, .copy=0};
+            if(ioctl(uffd,UFFDIO_COPY,&copy) == -1 && errno != EEXIST) perror("pager: UFFDIO_COPY");
+            free_slots.push_back(slot->second);
+            swapped.erase(slot);
+            stats.swap_ins++;
+        }
+        else{
+            uffdio_zeropage zero{.range={.start=page, .len=PAGE_SIZE}, .mode=0, .zeropage=0};
+            if(ioctl(uffd,UFFDIO_ZEROPAGE,&zero) == -1 && errno != EEXIST) perror("pager: UFFDIO_ZEROPAGE");
+            stats.zero_fills++;
+        }
+    }
+
+    void on_sample(page_t page){
+        stats.samples++;
+        // Not resident: the fault it'll take is what brings it in
+        if(!in_region(page) || alg->is_page_fault(page)){
+            stats.samples_outside++;
+            return;
+        }
+        evict_if_any(alg->consume(page,true));
+    }
+
+    void evict_if_any(evict_return_t victim){
+        if(victim == std::nullopt) return;
+        const page_t page = victim.value();
+        stats.evictions++;
+        if(!in_region(page)) return; // munmap'ed since
+#ifdef UFFDIO_REGISTER_MODE_WP
+        if(write_protect){
+            uffdio_writeprotect wp{.range={.start=page, .len=PAGE_SIZE}, .mode=UFFDIO_WRITEPROTECT_MODE_WP};
+            if(ioctl(uffd,UFFDIO_WRITEPROTECT,&wp) == -1) stats.eviction_errors++;
+        }
+#endif
+        // Reading a page the target madvise'd away itself would fault, on us
+        unsigned char resident = 0;
+        if(mincore(reinterpret_cast<void*>(page),PAGE_SIZE,&resident) == 0 && !(resident & 1)) return;
+        if(swap_fd != -1){
+            size_t slot_idx;
+            if(!free_slots.empty()){
+                slot_idx = free_slots.back();
+                free_slots.pop_back();
+            }
+            else slot_idx = next_slot++;
+            if(pwrite(swap_fd,reinterpret_cast<const void*>(page),PAGE_SIZE,static_cast<off_t>(slot_idx)*PAGE_SIZE) != PAGE_SIZE){
+                perror("pager: couldn't write to swap, dropping the page's contents");
+                free_slots.push_back(slot_idx);
+                stats.eviction_errors++;
+            }
+            else{
+                swapped[page] = slot_idx;
+                stats.swap_outs++;
+            }
+        }
+        if(madvise(reinterpret_cast<void*>(page),PAGE_SIZE,MADV_DONTNEED) == -1) stats.eviction_errors++;
+        // Writers blocked on the write protection retry, and take a missing fault
+        uffdio_range range{.start=page, .len=PAGE_SIZE};
+        ioctl(uffd,UFFDIO_WAKE,&range);
+    }
+
+    std::mutex mutex;
+    int uffd = -1;
+    bool write_protect = false;
+    std::unique_ptr<GenericAlgorithm> alg;
+    std::map<uint64_t,uint64_t> regions; // start -> end
+    int swap_fd = -1;
+    std::unordered_map<page_t,size_t> swapped; // page -> swap file slot
+    std::vector<size_t> free_slots;
+    size_t next_slot = 0;
+    std::string ring_name;
+    pebs_ring* ring = nullptr;
+    std::string stats_fn;
+    PagerStats stats;
+};
+
+thread_local bool Pager::in_pager_thread = false;
+
+Pager* pager = nullptr;
+pthread_once_t pager_once = PTHREAD_ONCE_INIT;
+
+void init_pager(){
+    Pager::in_pager_thread = true; // the allocations below might mmap, and must not recurse into pthread_once
+    auto* p = new Pager();
+    if(p->init()){
+        std::thread(&Pager::handle,p).detach();
+        pager = p;
+    }
+    else delete p;
+    Pager::in_pager_thread = false;
+}
+
+}
+
+// Interposed through raw syscalls rather than dlsym(RTLD_NEXT): dlsym may allocate, hence mmap, hence recurse
+extern "C" {
+
+void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset){
+    const long raw = syscall(SYS_mmap,addr,length,prot,flags,fd,offset);
+    void* ret = raw == -1 ? MAP_FAILED : reinterpret_cast<void*>(raw);
+    if(ret == MAP_FAILED || Pager::in_pager_thread) return ret; // never register our own allocations
+    if((flags & MAP_ANONYMOUS) && (flags & MAP_PRIVATE)){
+        pthread_once(&pager_once,init_pager);
+        if(pager != nullptr && length >= pager->min_region_bytes) pager->register_region(ret,length);
+    }
+    return ret;
+}
+
+int munmap(void* addr, size_t length){
+    const int ret = static_cast<int>(syscall(SYS_munmap,addr,length));
+    if(ret == 0 && pager != nullptr && !Pager::in_pager_thread) pager->unregister_region(addr,length);
+    return ret;
+}
+
+}
+
+__attribute__((destructor)) static void write_pager_stats(){
+    if(pager != nullptr) pager->write_stats();
+}
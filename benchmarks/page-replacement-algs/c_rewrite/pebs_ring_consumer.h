@@ -0,0 +1,32 @@
+#ifndef C_REWRITE_PEBS_RING_CONSUMER_H
+#define C_REWRITE_PEBS_RING_CONSUMER_H
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "pebs_ring.h"
+
+static constexpr auto RING_OPEN_RETRY_SLEEP = std::chrono::milliseconds(100);
+
+// Blocks until custom_perf (`-p`) created and initialized the ring. Returns nullptr on any other error
+inline pebs_ring* wait_for_ring(const std::string& name){
+    bool announced = false;
+    while(true){
+        auto* ring = pebs_ring_open(name.c_str());
+        if(ring != nullptr) return ring;
+        if(errno != ENOENT && errno != EAGAIN){
+            std::cerr << "Couldn't open ring " << name << ": " << std::strerror(errno) << std::endl;
+            return nullptr;
+        }
+        if(!announced){
+            std::cout << "Waiting for ring " << name << "..." << std::endl;
+            announced = true;
+        }
+        std::this_thread::sleep_for(RING_OPEN_RETRY_SLEEP);
+    }
+}
+
+#endif //C_REWRITE_PEBS_RING_CONSUMER_H
@@ -0,0 +1,267 @@
+// Cold-page reclaim daemon: lighter than the pager (`pager.cpp`), it leaves faulting to the kernel and only advises it.
+// A policy fed by custom_perf's samples (`custom_perf -p`) models the target's hot set with the memory budget as cache
+// size ; every interval, if the target's RSS is over the budget, every page of its anonymous mappings not in that hot set
+// (`get_page_cache_copy`) is paged out with process_madvise(MADV_PAGEOUT), or only deactivated with MADV_COLD when
+// `--cold`. RSS and major faults are logged over time.
+//
+// $ custom_perf -p /pebs -N -c 100 ./workload &
+// $ c_rewrite_reclaim -a CLOCK -m 64K -p $(pgrep workload) /pebs
+//
+// process_madvise needs Linux >= 5.10 and, for another process, CAP_SYS_NICE plus ptrace read access to it.
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "algorithms/page_cache_algs.h"
+#include "utils.h"
+#include "pebs_ring_consumer.h"
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_process_madvise
+#define SYS_process_madvise 440
+#endif
+#ifndef MADV_COLD
+#define MADV_COLD 20
+#endif
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT 21
+#endif
+
+namespace fs = std::filesystem;
+
+static constexpr size_t DEFAULT_RECLAIM_BUDGET_IN_PAGES = 256*1024;
+static constexpr size_t POP_BATCH_SIZE = 4096;
+static constexpr auto EMPTY_RING_SLEEP = std::chrono::milliseconds(1);
+static constexpr size_t MAX_IOVECS_PER_CALL = IOV_MAX;
+
+static const std::string RECLAIM_STATS_FN = "reclaim_stats.csv";
+
+struct ReclaimArgs {
+    std::string ring_name;
+    pid_t pid = 0;
+    page_cache_algs::type alg = page_cache_algs::GCLOCK_t;
+    size_t budget_in_pages = DEFAULT_RECLAIM_BUDGET_IN_PAGES;
+    uint64_t interval_ms = 1000;
+    size_t min_vma_bytes = 0;
+    bool cold_only = false;
+    std::string data_save_dir = "results/reclaim";
+
+    ReclaimArgs(int argc, char* argv[]) {
+        int i = 1;
+        while (i < argc) {
+            const std::string arg(argv[i++]);
+            if ((arg == "-a" || arg == "--alg") && i < argc) {
+                const auto t = page_cache_algs::alg_name_to_type(argv[i++]);
+                if (!t) {
+                    std::cerr << "Unknown algorithm: " << argv[i-1] << std::endl;
+                    exit(-1);
+                }
+                alg = *t;
+            } else if ((arg == "-p" || arg == "--pid") && i < argc) {
+                pid = static_cast<pid_t>(std::stol(argv[i++]));
+            } else if (arg == "-m" && i < argc) {
+                budget_in_pages = parseMemoryString(argv[i++]);
+            } else if ((arg == "-i" || arg == "--interval") && i < argc) {
+                interval_ms = std::stoull(argv[i++]);
+            } else if (arg == "--min-vma" && i < argc) {
+                min_vma_bytes = parseMemoryString(argv[i++]);
+            } else if (arg == "--cold") {
+                cold_only = true;
+            } else if (arg == "--data-save-dir" && i < argc) {
+                data_save_dir = argv[i++];
+            } else if (i == argc) {
+                ring_name = arg;
+            } else {
+                std::cerr << "Invalid argument: " << arg << std::endl;
+                exit(-1);
+            }
+        }
+        if (ring_name.empty() || ring_name[0] != '/') {
+            std::cerr << "Missing argument: ring name (/NAME, as given to custom_perf -p)" << std::endl;
+            exit(-1);
+        }
+        if (pid <= 0) {
+            std::cerr << "Missing argument: -p PID" << std::endl;
+            exit(-1);
+        }
+        if (budget_in_pages == 0 || interval_ms == 0) {
+            std::cerr << "Budget and interval must be positive" << std::endl;
+            exit(-1);
+        }
+        fs::create_directories(data_save_dir);
+        data_save_dir = fs::absolute(data_save_dir).lexically_normal().string() + '/';
+    }
+};
+
+struct ProcMemory{
+    uint64_t rss_pages = 0, majflt = 0;
+};
+
+// /proc/PID/statm's 2nd field, /proc/PID/stat's 12th. False if the process is gone
+static bool read_proc_memory(pid_t pid, ProcMemory& mem){
+    const std::string proc = "/proc/" + std::to_string(pid);
+    std::ifstream statm(proc + "/statm");
+    uint64_t size;
+    if(!(statm >> size >> mem.rss_pages)) return false;
+    std::ifstream stat(proc + "/stat");
+    std::string line;
+    if(!std::getline(stat,line)) return false;
+    // comm, the 2nd field, can contain spaces: start after its closing parenthesis (field 3)
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    for(int f = 3; f <= 12 && fields >> field; f++){
+        if(f == 12) mem.majflt = std::stoull(field);
+    }
+    return true;
+}
+
+struct Vma{
+    uint64_t start, end;
+};
+
+// Private, writable, anonymous (no backing file, or [heap]/[stack]) mappings: what paging out turns into swap
+static std::vector<Vma> read_anonymous_vmas(pid_t pid, size_t min_vma_bytes){
+    std::vector<Vma> vmas;
+    std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+    std::string line;
+    while(std::getline(maps,line)){
+        std::istringstream fields(line);
+        std::string range, perms, offset, dev, inode, path;
+        fields >> range >> perms >> offset >> dev >> inode;
+        std::getline(fields >> std::ws,path);
+        if(perms.size() < 4 || perms[1] != 'w' || perms[3] != 'p') continue;
+        if(!path.empty() && path != "[heap]" && path != "[stack]") continue;
+        const auto dash = range.find('-');
+        Vma vma{std::stoull(range.substr(0,dash),nullptr,16),std::stoull(range.substr(dash+1),nullptr,16)};
+        if(vma.end - vma.start >= min_vma_bytes) vmas.push_back(vma);
+    }
+    return vmas;
+}
+
+// The gaps between the (sorted) hot pages, within the VMAs
+static std::vector<iovec> cold_ranges(const std::vector<Vma>& vmas, const page_cache_copy_t& sorted_hot){
+    std::vector<iovec> ranges;
+    auto hot = sorted_hot.begin();
+    for(const auto& vma : vmas){
+        uint64_t at = vma.start;
+        hot = std::lower_bound(hot,sorted_hot.end(),vma.start);
+        for(; hot != sorted_hot.end() && *hot < vma.end; hot = std::next(hot)){
+            if(*hot > at) ranges.push_back({reinterpret_cast<void*>(at),*hot - at});
+            at = *hot + PAGE_SIZE;
+        }
+        if(at < vma.end) ranges.push_back({reinterpret_cast<void*>(at),vma.end - at});
+    }
+    return ranges;
+}
+
+// Drops the ranges past the first `bytes` of them, shortening the last one kept
+static void truncate_ranges(std::vector<iovec>& ranges, uint64_t bytes){
+    for(size_t i = 0; i < ranges.size(); i++){
+        if(ranges[i].iov_len >= bytes){
+            ranges[i].iov_len = bytes;
+            ranges.resize(bytes == 0 ? i : i + 1);
+            return;
+        }
+        bytes -= ranges[i].iov_len;
+    }
+}
+
+// Returns the number of bytes advised
+static uint64_t advise(int pidfd, const std::vector<iovec>& ranges, int advice){
+    uint64_t advised = 0;
+    for(size_t at = 0; at < ranges.size(); at += MAX_IOVECS_PER_CALL){
+        const size_t n = std::min(MAX_IOVECS_PER_CALL,ranges.size() - at);
+        const long ret = syscall(SYS_process_madvise,pidfd,ranges.data() + at,n,advice,0);
+        if(ret == -1){
+            // Most likely a VMA which changed since we read the maps: the other batches are still worth a try
+            if(errno == EPERM || errno == ENOSYS){
+                std::cerr << "process_madvise: " << std::strerror(errno) << std::endl;
+                break;
+            }
+            continue;
+        }
+        advised += static_cast<uint64_t>(ret);
+    }
+    return advised;
+}
+
+static uint64_t elapsed_ms(std::chrono::steady_clock::time_point since){
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+int main(int argc, char* argv[]) {
+    const ReclaimArgs args(argc, argv);
+    auto alg = page_cache_algs::get_alg(args.alg,untracked_eviction::FIFO,args.budget_in_pages);
+
+    const int pidfd = static_cast<int>(syscall(SYS_pidfd_open,args.pid,0));
+    if(pidfd == -1){
+        std::cerr << "Couldn't open pidfd of " << args.pid << ": " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    std::ofstream stats_f(args.data_save_dir + RECLAIM_STATS_FN, std::ios_base::out | std::ios_base::trunc);
+    if(!stats_f.is_open()){
+        std::cerr << "Couldn't create " << args.data_save_dir + RECLAIM_STATS_FN << std::endl;
+        return -1;
+    }
+    stats_f << "time_ms,rss_pages,majflt,samples,hot,advised_ranges,advised_bytes\n";
+
+    auto* ring = wait_for_ring(args.ring_name);
+    if(ring == nullptr) return -1;
+    std::cout << "Holding " << args.pid << " to " << args.budget_in_pages << " pages (" << parseMemorySize(args.budget_in_pages*PAGE_SIZE) << ") with " << alg->name()
+              << (args.cold_only ? " (MADV_COLD)" : " (MADV_PAGEOUT)") << std::endl;
+
+    std::vector<pebs_ring_record> batch(POP_BATCH_SIZE);
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t samples = 0, next_interval_ms = args.interval_ms;
+    bool producer_done = false;
+    ProcMemory mem;
+    while(true){
+        const auto n = pebs_ring_pop(ring,batch.data(),batch.size());
+        for(size_t i = 0; i < n; i++){
+            (void)alg->consume(page_start_from_mem_address(batch[i].addr),true); // the kernel does the actual evicting
+        }
+        samples += n;
+        if(n == 0){
+            producer_done = __atomic_load_n(&ring->producer_done,__ATOMIC_ACQUIRE);
+            if(producer_done) break;
+            std::this_thread::sleep_for(EMPTY_RING_SLEEP);
+        }
+        const auto now_ms = elapsed_ms(start);
+        if(now_ms < next_interval_ms) continue;
+        next_interval_ms = now_ms + args.interval_ms;
+        if(!read_proc_memory(args.pid,mem)) break;
+
+        size_t n_ranges = 0, hot_size = 0;
+        uint64_t advised = 0;
+        if(mem.rss_pages > args.budget_in_pages){
+            auto hot = alg->get_page_cache_copy();
+            std::sort(hot->begin(),hot->end());
+            hot_size = hot->size();
+            auto ranges = cold_ranges(read_anonymous_vmas(args.pid,args.min_vma_bytes),*hot);
+            // Only what's over budget: the hot set can be much smaller than the budget while there are few samples
+            truncate_ranges(ranges,(mem.rss_pages - args.budget_in_pages)*PAGE_SIZE);
+            n_ranges = ranges.size();
+            advised = advise(pidfd,ranges,args.cold_only ? MADV_COLD : MADV_PAGEOUT);
+        }
+        stats_f << now_ms << ',' << mem.rss_pages << ',' << mem.majflt << ',' << samples << ',' << hot_size << ','
+                << n_ranges << ',' << advised << '\n';
+        stats_f.flush();
+    }
+    std::cout << "Target " << (producer_done ? "finished sampling" : "exited") << ", " << samples << " samples" << std::endl;
+
+    close(pidfd);
+    pebs_ring_close(ring);
+    shm_unlink(args.ring_name.c_str()); // custom_perf leaves it to its consumer
+    return 0;
+}
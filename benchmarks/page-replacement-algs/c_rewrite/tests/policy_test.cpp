@@ -0,0 +1,152 @@
+// Every policy of `page_cache_algs::all`, replayed over generated traces as `simulate_one` does (considered accesses
+// consumed as tracked, the others only when they fault), for several memory sizes, sample ratios and untracked
+// evictions. After each access: no more pages than the memory holds, the page accessed is resident, and the victim if
+// any isn't. Every so often: the page cache copy is the tracked pages, without duplicates, none of which is in U. With
+// every access considered, OPT must fault the least
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <unistd.h>
+#include "../algorithms/page_cache_algs.h"
+#include "../TraceReader.h"
+#include "../utils.h"
+
+static constexpr size_t N_RECORDS = 30000;
+static constexpr size_t CHECK_CACHE_EVERY = 97;
+static constexpr std::array<size_t,4> MEM_SIZES_IN_PAGES = {1,2,37,500};
+static constexpr std::array<std::pair<size_t,size_t>,5> RATIOS = {{{0,1},{1,1},{1,2},{1,5},{3,5}}}; // I considered out of J
+
+// A hot set skewed toward its first pages, sequential scans, and uniformly random pages, interleaved
+static std::vector<TraceRecord> generate(uint64_t seed){
+    std::mt19937_64 rng(seed);
+    std::vector<TraceRecord> records;
+    records.reserve(N_RECORDS);
+    uint64_t scan = 0;
+    while(records.size() < N_RECORDS){
+        const auto kind = rng()%10;
+        for(size_t n = 1 + rng()%64; n > 0 && records.size() < N_RECORDS; n--){
+            uint64_t page;
+            if(kind < 6) page = std::min(rng()%1200,rng()%1200);
+            else if(kind < 8) page = 100000 + scan++%3000;
+            else page = 200000 + rng()%5000;
+            records.push_back({page*PAGE_SIZE + rng()%PAGE_SIZE,rng()%2 == 0});
+        }
+    }
+    return records;
+}
+
+// OPT's next use index is loaded from, or cached next to, the trace file
+class TempTrace{
+public:
+    explicit TempTrace(const std::vector<TraceRecord>& records){
+        const char* dir = std::getenv("TMPDIR");
+        path = std::string(dir != nullptr ? dir : "/tmp") + "/c_rewrite_policy_test.XXXXXX";
+        const int fd = mkstemp(path.data());
+        if(fd == -1){
+            path.clear();
+            return;
+        }
+        std::string bytes;
+        for(const auto& record : records){
+            bytes += static_cast<char>(record.is_load ? 0 : 1);
+            bytes.append(reinterpret_cast<const char*>(&record.address),TraceReader::BIN_ADDR_BYTES);
+        }
+        if(write(fd,bytes.data(),bytes.size()) != static_cast<ssize_t>(bytes.size())) path.clear();
+        close(fd);
+    }
+    ~TempTrace(){
+        if(path.empty()) return;
+        unlink(path.c_str());
+        unlink((path + ".next_use").c_str());
+    }
+    std::string path;
+};
+
+struct Replay{
+    size_t faults = 0, violations = 0;
+};
+
+static Replay replay(GenericAlgorithm& alg, const std::vector<TraceRecord>& records, size_t sampled, size_t out_of){
+    Replay r;
+    const auto fail = [&](const std::string& what, size_t position){
+        if(r.violations++ == 0) std::cerr << alg.name() << ": " << what << " at record " << position << std::endl;
+    };
+    for(size_t position = 0; position < records.size(); position++){
+        const auto page = page_start_from_mem_address(records[position].address);
+        alg.set_trace_position(position);
+        const bool considered = position%out_of < sampled;
+        const auto pfault = alg.is_page_fault(page);
+        r.faults += pfault;
+        evict_return_t victim = std::nullopt;
+        if(considered) victim = alg.consume(page,true);
+        else if(pfault) victim = alg.consume(page,false);
+
+        if(alg.get_total_size() > alg.get_max_page_cache_size()) fail("more pages than the memory holds",position);
+        if(alg.is_page_fault(page)) fail("accessed page not resident",position);
+        if(victim && (*victim == page || !alg.is_page_fault(*victim))) fail("victim still resident",position);
+        if(position%CHECK_CACHE_EVERY != 0) continue;
+        const auto tracked = alg.get_page_cache_copy();
+        const std::unordered_set<page_t> unique(tracked->begin(),tracked->end());
+        if(unique.size() != tracked->size()) fail("page cache copy with duplicates",position);
+        if(tracked->size() != alg.get_total_size() - alg.U->size()) fail("page cache copy isn't the tracked pages",position);
+        for(const auto p : *tracked){
+            if(alg.U->contains(p)){
+                fail("tracked page in U",position);
+                break;
+            }
+        }
+    }
+    return r;
+}
+
+int main(){
+    size_t n_failures = 0;
+    for(const uint64_t seed : {1201u,74417u}){
+        const auto records = generate(seed);
+        const TempTrace file(records);
+        if(file.path.empty()){
+            std::cerr << "Couldn't write the trace" << std::endl;
+            return 1;
+        }
+        const TraceReader trace(file.path,false);
+        const auto index = NextUseIndex::load_or_compute(file.path,trace);
+        if(index == nullptr || index->size() != records.size()){
+            std::cerr << "Couldn't compute the next use index" << std::endl;
+            return 1;
+        }
+        page_cache_algs::next_use = index.get();
+        for(const auto mem_size : MEM_SIZES_IN_PAGES){
+            for(const auto& [sampled,out_of] : RATIOS){
+                for(const auto u_t : untracked_eviction::all){
+                    std::array<size_t,page_cache_algs::NUM_ALGS> faults{};
+                    for(const auto t : page_cache_algs::all){
+                        const auto alg = page_cache_algs::get_alg(t,u_t,mem_size);
+                        const auto r = replay(*alg,records,sampled,out_of);
+                        faults[t] = r.faults;
+                        if(r.violations != 0){
+                            std::cerr << "  seed " << seed << ", " << mem_size << " pages, " << sampled << '/' << out_of << ", "
+                                      << untracked_eviction::get_prefix(u_t) << ": " << r.violations << " violations" << std::endl;
+                            n_failures++;
+                        }
+                    }
+                    if(sampled != out_of) continue;
+                    for(const auto t : page_cache_algs::all){
+                        if(faults[t] >= faults[page_cache_algs::OPT_t]) continue;
+                        std::cerr << page_cache_algs::type_to_alg_name(t) << " faulted less than OPT (" << faults[t] << " < "
+                                  << faults[page_cache_algs::OPT_t] << "), seed " << seed << ", " << mem_size << " pages" << std::endl;
+                        n_failures++;
+                    }
+                }
+            }
+        }
+        page_cache_algs::next_use = nullptr;
+    }
+    std::cout << page_cache_algs::all.size() << " policies, " << n_failures << " failures" << std::endl;
+    return n_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+// How fast policies replay a trace depending on how it's mapped (`--map`) and where their metadata is (`--huge-pages`).
+// Accesses are replayed as `simulate_one` does: the sampled ones are consumed as tracked, the others only when they
+// fault. Every run starts from a cold page cache, on a thread of its own so that it starts from an empty arena ; the
+// best of `-n` runs is reported, and every combination must fault as many times.
+//
+// $ c_rewrite_replay_bench -a S3FIFO,ARC -m 256K -s 1/2 trace.bin
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../algorithms/page_cache_algs.h"
+#include "../TraceReader.h"
+#include "../utils.h"
+
+struct BenchArgs {
+    std::string mem_trace_path;
+    bool text_trace_format = false;
+    std::vector<page_cache_algs::type> algs = {page_cache_algs::S3_FIFO_t, page_cache_algs::ARC_t, page_cache_algs::LRU_t};
+    size_t mem_size_in_pages = 256*1024;
+    size_t sampled = 1, out_of = 2; // accesses considered
+    size_t n_runs = 3;
+
+    BenchArgs(int argc, char* argv[]) {
+        int i = 1;
+        while (i < argc) {
+            const std::string arg(argv[i++]);
+            if ((arg == "-a" || arg == "--algs") && i < argc) {
+                algs.clear();
+                std::stringstream names(argv[i++]);
+                for(std::string name; std::getline(names,name,',');){
+                    const auto t = page_cache_algs::alg_name_to_type(name);
+                    if(!t){
+                        std::cerr << "Unknown policy: " << name << std::endl;
+                        exit(-1);
+                    }
+                    algs.push_back(*t);
+                }
+            } else if (arg == "-m" && i < argc) {
+                mem_size_in_pages = parseMemoryString(argv[i++]);
+            } else if ((arg == "-s" || arg == "--sampled") && i < argc) {
+                const std::string ratio(argv[i++]);
+                const auto slash = ratio.find('/');
+                sampled = std::stoull(ratio.substr(0,slash));
+                out_of = slash == std::string::npos ? 1 : std::stoull(ratio.substr(slash+1));
+            } else if (arg == "-n" && i < argc) {
+                n_runs = std::max<size_t>(std::stoull(argv[i++]),1);
+            } else if (arg == "-o" || arg == "--old-trace") {
+                text_trace_format = true;
+            } else if (i == argc) {
+                mem_trace_path = arg;
+            } else {
+                std::cerr << "Invalid argument: " << arg << std::endl;
+                exit(-1);
+            }
+        }
+        if (mem_trace_path.empty() || algs.empty() || sampled > out_of || out_of == 0) {
+            std::cerr << "Usage: c_rewrite_replay_bench [-a ALG,ALG...] [-m SIZE] [-s I/J] [-n RUNS] [-o] mem_trace_path" << std::endl;
+            exit(-1);
+        }
+    }
+};
+
+struct Run {
+    double seconds = 0;
+    size_t n_records = 0, n_faults = 0;
+};
+
+static Run replay(const BenchArgs& args, page_cache_algs::type t, const MappingHints& hints, bool arena){
+    if(const int fd = open(args.mem_trace_path.c_str(),O_RDONLY); fd != -1){
+        posix_fadvise(fd,0,0,POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+    Run run;
+    std::jthread([&](){
+        huge_pages::enabled = arena;
+        const auto start = std::chrono::steady_clock::now();
+        const TraceReader trace(args.mem_trace_path,args.text_trace_format,hints);
+        if(!trace.valid()) return;
+        const auto alg = page_cache_algs::get_alg(t,untracked_eviction::FIFO,args.mem_size_in_pages);
+        size_t left_in_batch = 0, left_to_consider = 0;
+        trace.for_each([&](const TraceRecord& record){
+            if(left_in_batch == 0){
+                left_in_batch = args.out_of;
+                left_to_consider = args.sampled;
+            }
+            left_in_batch--;
+            const bool considered = left_to_consider != 0;
+            if(considered) left_to_consider--;
+            const auto page = page_start_from_mem_address(record.address);
+            const auto pfault = alg->is_page_fault(page);
+            run.n_records++;
+            run.n_faults += pfault;
+            if(considered) (void)alg->consume(page,true);
+            else if(pfault) (void)alg->consume(page,false);
+        });
+        run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }).join();
+    huge_pages::enabled = false;
+    return run;
+}
+
+int main(int argc, char* argv[]) {
+    const BenchArgs args(argc, argv);
+    const std::array<std::pair<std::string,MappingHints>,5> mappings = {{
+        {"plain",{}},{"seq",{.sequential=true}},{"huge",{.huge_pages=true}},{"populate",{.populate=true}},
+        {"seq,huge,populate",{.sequential=true,.huge_pages=true,.populate=true}}
+    }};
+    bool consistent = true;
+    for(const auto t : args.algs){
+        std::map<std::pair<bool,std::string>,double> best; // (arena, mapping) -> M records/s
+        std::optional<size_t> n_faults;
+        for(const bool arena : {false,true}){
+            for(const auto& [name,hints] : mappings){
+                double& rate = best[{arena,name}];
+                for(size_t r = 0; r < args.n_runs; r++){
+                    const auto run = replay(args,t,hints,arena);
+                    if(run.n_records == 0){
+                        std::cerr << "Couldn't replay " << args.mem_trace_path << std::endl;
+                        return -1;
+                    }
+                    if(n_faults && *n_faults != run.n_faults) consistent = false;
+                    n_faults = run.n_faults;
+                    rate = std::max(rate,static_cast<double>(run.n_records)/run.seconds/1e6);
+                }
+                std::cout << page_cache_algs::type_to_alg_name(t) << ", " << (arena ? "huge page arena" : "heap") << ", " << name
+                          << ": " << rate << " M records/s, " << *n_faults << " faults" << std::endl;
+            }
+        }
+        for(const auto& [name,hints] : mappings){
+            std::cout << page_cache_algs::type_to_alg_name(t) << ", " << name << ": arena speedup "
+                      << best[{true,name}]/best[{false,name}] << "x" << std::endl;
+        }
+    }
+    if(!consistent) std::cerr << "Runs faulted differently" << std::endl;
+    return consistent ? 0 : 1;
+}
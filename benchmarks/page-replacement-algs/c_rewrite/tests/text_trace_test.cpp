@@ -0,0 +1,117 @@
+// Every text trace decoder must give the scalar one's records, and those must be the ones the lines were generated from.
+// The fixture covers what the format allows: with and without "0x"/"0X", mixed case digits, 0 to 16 of them, blank
+// lines, junk after the digits, and lines of any length, so that they start and end anywhere in the decoders' 64 byte
+// blocks, some spanning several. It's decoded from several first lines on, in batches of several sizes, and sits right
+// before an inaccessible page so that reading past its end faults
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "../TraceReader.h"
+
+static constexpr size_t N_LINES = 20000;
+static constexpr std::array<size_t,4> BATCH_SIZES = {1,3,17,TraceReader::TEXT_BATCH};
+
+struct Fixture{
+    std::string text;
+    std::vector<TraceRecord> expected;
+};
+
+static Fixture generate(){
+    static constexpr char DIGITS[] = "0123456789abcdef0123456789ABCDEF";
+    static constexpr char JUNK[] = " \t\r;,gzG"; // none of which could be taken for a digit or a prefix
+    std::mt19937_64 rng(791625679);
+    const auto below = [&](size_t n){return static_cast<size_t>(rng()%n);};
+    Fixture f;
+    for(size_t i = 0; i < N_LINES; i++){
+        if(below(20) == 0){
+            f.text += '\n'; // decoded as a store to address 0
+            f.expected.push_back({0,false});
+            continue;
+        }
+        const bool is_load = below(2) == 0;
+        f.text += is_load ? 'R' : 'W';
+        switch(below(3)){
+            case 0: f.text += "0x"; break;
+            case 1: f.text += "0X"; break;
+            default: break;
+        }
+        uint64_t address = 0;
+        for(size_t n = below(17), d = 0; d < n; d++){
+            const auto digit = below(32);
+            f.text += DIGITS[digit];
+            address = address << 4 | digit%16;
+        }
+        if(below(4) == 0){
+            for(size_t n = 1 + below(below(8) == 0 ? 150 : 6), j = 0; j < n; j++) f.text += JUNK[below(sizeof(JUNK)-1)];
+        }
+        f.text += '\n';
+        f.expected.push_back({address,is_load});
+    }
+    f.text += "R0x1"; // no '\n' at the end of the trace
+    f.expected.push_back({1,true});
+    return f;
+}
+
+// `text` copied to end right before a PROT_NONE page
+class Guarded{
+public:
+    explicit Guarded(const std::string& text){
+        const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        length = (text.size() + page - 1)/page*page + page;
+        mapping = static_cast<char*>(mmap(nullptr,length,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0));
+        if(mapping == MAP_FAILED){
+            mapping = nullptr;
+            return;
+        }
+        mprotect(mapping + length - page,page,PROT_NONE);
+        data = mapping + length - page - text.size();
+        memcpy(data,text.data(),text.size());
+    }
+    ~Guarded(){if(mapping != nullptr) munmap(mapping,length);}
+    char* data = nullptr;
+private:
+    char* mapping = nullptr;
+    size_t length = 0;
+};
+
+static bool same(const TraceRecord& a, const TraceRecord& b){return a.address == b.address && a.is_load == b.is_load;}
+
+// From the `first`th line on, `batch` lines at a time at most ; the number of records differing from the expected ones
+static size_t check(const char* text, size_t length, const std::vector<TraceRecord>& expected, size_t first, size_t batch, trace_text::isa with){
+    size_t at = trace_text::skip_lines(text,length,0,first), n_records = first, mismatches = 0;
+    std::array<TraceRecord,TraceReader::TEXT_BATCH> records;
+    for(size_t n; (n = trace_text::decode_lines(text,length,at,length,records.data(),batch,with)) != 0; n_records += n){
+        for(size_t i = 0; i < n; i++){
+            if(n_records + i >= expected.size() || !same(records[i],expected[n_records + i])) mismatches++;
+        }
+    }
+    return mismatches + (n_records > expected.size() ? n_records - expected.size() : expected.size() - n_records);
+}
+
+int main(){
+    const auto fixture = generate();
+    const Guarded guarded(fixture.text);
+    if(guarded.data == nullptr){
+        std::cerr << "Couldn't map the fixture" << std::endl;
+        return 1;
+    }
+    size_t n_failures = 0;
+    for(int i = trace_text::SCALAR; i <= trace_text::best_isa; i++){
+        const auto with = static_cast<trace_text::isa>(i);
+        size_t mismatches = 0;
+        // Starting further in, and stopping after fewer lines, moves the lines against the blocks
+        for(size_t first = 0; first < 8; first++){
+            for(const auto batch : BATCH_SIZES) mismatches += check(guarded.data,fixture.text.size(),fixture.expected,first,batch,with);
+        }
+        std::cout << trace_text::get_name(with) << ": " << fixture.expected.size() << " lines, " << mismatches << " mismatches" << std::endl;
+        if(mismatches != 0) n_failures++;
+    }
+    return n_failures == 0 ? 0 : 1;
+}
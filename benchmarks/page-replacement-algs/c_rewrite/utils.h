@@ -0,0 +1,63 @@
+#ifndef C_REWRITE_UTILS_H
+#define C_REWRITE_UTILS_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+inline size_t parseMemoryString(const std::string& memoryString) {
+    std::string strippedString = memoryString;
+    strippedString.erase(std::remove_if(strippedString.begin(), strippedString.end(), ::isspace), strippedString.end());
+
+    size_t value = 0;
+    size_t multiplier = 1;
+
+    std::istringstream iss(strippedString);
+    iss >> value;
+
+    char unitChar;
+    if (iss >> unitChar) {
+        switch (unitChar) {
+            case 'B':
+                multiplier = 1;
+                break;
+            case 'K':
+                multiplier = 1024;
+                break;
+            case 'M':
+                multiplier = 1024 * 1024;
+                break;
+            case 'G':
+                multiplier = 1024 * 1024 * 1024;
+                break;
+            case 'T':
+                multiplier = static_cast<size_t>(1024) * 1024 * 1024 * 1024;
+                break;
+            default:
+                throw std::invalid_argument("Invalid memory unit: " + strippedString);
+        }
+    } else {
+        throw std::invalid_argument("Invalid memory string: " + strippedString);
+    }
+
+    return value * multiplier;
+}
+
+static std::string parseMemorySize(size_t num) {
+    const auto units = std::array{"B", "KB", "MB", "GB", "TB"};
+    size_t unitIndex = 0;
+
+    while (num >= 1024 && unitIndex < (units.size() - 1)) {
+        num /= 1024;
+        unitIndex++;
+    }
+
+    std::ostringstream oss;
+    oss << num << units[unitIndex];
+    return oss.str();
+}
+
+#endif //C_REWRITE_UTILS_H
@@ -1,12 +1,13 @@
 #include <string>
 #include <iostream>
 #include <fstream>
-#include <functional>
 #include <unordered_map>
 #include <cstring>
 #include <sstream>
+#include <vector>
+#include <algorithm>
+#include "../c_rewrite/TraceReader.h"
 
-#define BIN_LINE_SIZE_BYTES 9
 #define PAGE_SIZE 4096
 
 typedef uint64_t ptr_t;
@@ -36,16 +37,12 @@ std::string print_vector(const std::vector<map_kv_t>& map_kvs){
 int main(int argc, char* argv[]){
     if(argc != 2) return -1;
     auto mem_trace_file = std::string(argv[1]);
-    std::ifstream mtf(mem_trace_file,std::ios::in | std::ios::binary);
-    if (!mtf.is_open()) {
+    const TraceReader trace(mem_trace_file,false);
+    if (!trace.valid()) {
         std::cerr << "Failed to open memory trace file" << std::endl;
         exit(-1);
     }
-    auto fsize = mtf.tellg();
-    mtf.seekg( 0, std::ios::end );
-    fsize = mtf.tellg() - fsize;
-    mtf.clear();
-    mtf.seekg(0,std::ios::beg);
+    const auto fsize = trace.size();
 
 #define PERIOD 10
 #define TO_USE_PERIOD ((PERIOD)-1)
@@ -54,33 +51,22 @@ int main(int argc, char* argv[]){
 
 
     uint64_t lds = 0,strs = 0;
-    std::function<bool(std::string&)> read;
-    std::function<std::pair<uint8_t,page_t>(std::string&)> parse;
-    std::string line;
-
-
-    read = [&mtf](std::string &line) { return bool(mtf.read(&line[0], BIN_LINE_SIZE_BYTES)); };
-    parse = [](std::string &line){
-        const uint8_t is_load = line[0]==0;
-        const uint64_t mem_address = 0;
-        memcpy((void *) &mem_address, &line[1], sizeof(uint64_t));
-        return std::pair{is_load,mem_address};
-    };
+    auto cursor = trace.cursor();
+    TraceRecord record{};
 
     timestamp at = 0;
 #define N 15
 
     for(size_t i =0;i<PERIOD;i++) {
         std::unordered_map<page_t, page_data> all_pages;
-        while (read(line) && ((++at)%at_period)!=0) {
+        while (cursor.next(record) && ((++at)%at_period)!=0) {
 
-            auto [is_load, address] = parse(line);
-            if (is_load) {
+            if (record.is_load) {
                 lds += 1;
             } else {
                 strs += 1;
             }
-            all_pages[page_start_from_mem_address(address)].timestamps.push_back(at);
+            all_pages[page_start_from_mem_address(record.address)].timestamps.push_back(at);
         }
 
         std::vector<map_kv_t> top_n(N);
@@ -96,7 +82,6 @@ int main(int argc, char* argv[]){
         std::cout<< "at:" << at << "iteration:" << i << "\nn_unique pages" << all_pages.size() << "\nn_unique addresses" << lds+strs <<"\nTop N pages" << print_vector(top_n) <<std::endl;
 
     }
-    mtf.close();
 
 
 